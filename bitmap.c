@@ -0,0 +1,201 @@
+/**
+ * @file
+ * @brief This file implements the bitmap indexes declared in bitmap.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "bitmap.h"
+#include "bufpool.h"
+#include "colstats.h"
+
+// Takes a slot out of the bitmap of its value.
+static void bitmap_remove (struct bitmap_column* bcol, int index) {
+	struct bitmap_value* bval;
+	if (bcol->slotValue[index] < 0)
+		return;
+	bval = &bcol->values[(int)bcol->slotValue[index]];
+	bval->bits[index / 64] &= ~((uint64_t)1 << (index % 64));
+	bval->numRows -= 1;
+	bcol->slotValue[index] = -1;
+}
+
+// Puts a slot in the bitmap of a value, giving the value a free entry if it has none.
+// Returns 0, or -1 if the column holds too many values.
+static int bitmap_add (struct bitmap_column* bcol, int index, const char* value) {
+	struct bitmap_value* bval;
+	int v, freeValue = -1;
+	// Usually a row is edited without changing the value.
+	if (bcol->slotValue[index] >= 0 && strcmp (bcol->values[(int)bcol->slotValue[index]].value, value) == 0)
+		return 0;
+	bitmap_remove (bcol, index);
+	for (v = 0; v < bcol->numValues; v++) {
+		if (bcol->values[v].numRows == 0) {
+			if (freeValue < 0)
+				freeValue = v;
+		}
+		else if (strcmp (bcol->values[v].value, value) == 0)
+			break;
+	}
+	if (v == bcol->numValues) {
+		if (freeValue < 0 && bcol->numValues == BITMAP_MAX_VALUES)
+			return -1;
+		if (freeValue < 0) {
+			freeValue = bcol->numValues;
+			bcol->numValues += 1;
+		}
+		v = freeValue;
+		bval = &bcol->values[v];
+		strcpy (bval->value, value);
+		memset (bval->bits, 0, sizeof bval->bits);
+	}
+	bval = &bcol->values[v];
+	bval->bits[index / 64] |= (uint64_t)1 << (index % 64);
+	bval->numRows += 1;
+	bcol->slotValue[index] = v;
+	return 0;
+}
+
+// Brings the index of a column up to date with a slot.
+static void bitmap_sync_column (struct table* node, int col, int index) {
+	struct bitmap_column* bcol = ((struct bitmap*)node->bitmaps)->cols[col];
+	if (bcol == NULL || bcol->overflow)
+		return;
+	if (node->slots[index].state != SLOT_LIVE)
+		bitmap_remove (bcol, index);
+	else if (bitmap_add (bcol, index, node->entries[index]->value[col]) != 0)
+		bcol->overflow = 1;	// Too many values for an index to help.
+}
+
+/**
+ * @brief Indexes a column and the live rows of the table.
+ * @return Returns 0 on success, -1 if out of memory.
+ */
+int bitmap_enable (struct table* node, int col) {
+	struct bitmap* bm = node->bitmaps;
+	struct bitmap_column* bcol;
+	int i;
+	if (bm == NULL) {
+		bm = calloc (1, sizeof(struct bitmap));
+		if (bm == NULL)
+			return -1;
+		node->bitmaps = bm;
+	}
+	if (bm->cols[col] != NULL)
+		return 0;
+	bcol = calloc (1, sizeof(struct bitmap_column));
+	if (bcol == NULL)
+		return -1;
+	memset (bcol->slotValue, -1, sizeof bcol->slotValue);
+	bm->cols[col] = bcol;
+	for (i = 0; i < MAX_RECORDS_PER_TABLE; i++) {
+		if (node->slots[i].state != SLOT_LIVE)
+			continue;
+		bufpool_touch (node, node->entries[i], 0);
+		bitmap_sync_column (node, col, i);
+	}
+	return 0;
+}
+
+/**
+ * @brief Brings the indexes of a table up to date with a slot.
+ */
+void bitmap_sync (struct table* node, int index) {
+	int i;
+	if (node->bitmaps == NULL)
+		return;
+	for (i = 0; i < node->numCol; i++)
+		bitmap_sync_column (node, i, index);
+}
+
+// Returns the index usable for the column of a predicate, or NULL.
+static struct bitmap_column* bitmap_find (const struct pred_plan* plan, int t) {
+	struct bitmap* bm = plan->node->bitmaps;
+	struct bitmap_column* bcol = bm->cols[plan->terms[t].col];
+	return bcol != NULL && !bcol->overflow ? bcol : NULL;
+}
+
+// Finds the slots that meet the groups of a plan whose predicates are all indexed, leaving
+// out the groups the statistics expect most rows to meet, if given.  Returns as bitmap_plan().
+static int bitmap_plan_groups (const struct pred_plan* plan, const struct colstats* stats, uint64_t* bits) {
+	const struct pred_group* group;
+	struct bitmap_column* bcol;
+	uint64_t groupBits[BITMAP_WORDS];
+	int numIndexed = 0;
+	int g, t, v, w;
+	if (plan->node->bitmaps == NULL || plan->numGroups == 0)
+		return -1;
+	memset (bits, 0xff, BITMAP_WORDS * sizeof(uint64_t));
+	for (g = 0; g < plan->numGroups; g++) {
+		group = &plan->groups[g];
+		for (t = group->first; t < group->first + group->numTerms; t++) {
+			if (bitmap_find (plan, t) == NULL)
+				break;
+		}
+		if (t < group->first + group->numTerms)
+			continue;
+		// Such a group rules out few rows, so ORing its bitmaps costs more than it saves.
+		if (stats != NULL && pred_group_pass (plan, stats, g) > BITMAP_MAX_PASS)
+			continue;
+		// Each predicate is tested once per distinct value, not per row.
+		memset (groupBits, 0, sizeof groupBits);
+		for (t = group->first; t < group->first + group->numTerms; t++) {
+			bcol = bitmap_find (plan, t);
+			for (v = 0; v < bcol->numValues; v++) {
+				if (bcol->values[v].numRows == 0 || !pred_term_match (plan, t, bcol->values[v].value))
+					continue;
+				for (w = 0; w < BITMAP_WORDS; w++)
+					groupBits[w] |= bcol->values[v].bits[w];
+			}
+		}
+		for (w = 0; w < BITMAP_WORDS; w++)
+			bits[w] &= groupBits[w];
+		numIndexed += 1;
+	}
+	if (numIndexed == 0)
+		return -1;
+	return numIndexed == plan->numGroups;
+}
+
+/**
+ * @brief Finds the slots that meet the groups of a plan whose predicates are all indexed,
+ * unless the column statistics expect most rows to meet them.
+ * @return Returns 1 if every group was used, 0 if some were, -1 if none was.
+ */
+int bitmap_plan (const struct pred_plan* plan, uint64_t* bits) {
+	struct colstats* stats;
+	if (plan->node->bitmaps == NULL || plan->numGroups == 0)
+		return -1;
+	stats = colstats_get (plan->node);
+	return bitmap_plan_groups (plan, stats != NULL && stats->numRows > 0 ? stats : NULL, bits);
+}
+
+/**
+ * @brief Counts the rows that meet a plan with a popcount of its bitmap.
+ * @return Returns the count, or -1 if some rows or predicates are not indexed.
+ */
+int bitmap_count (const struct pred_plan* plan) {
+	uint64_t bits[BITMAP_WORDS];
+	int count = 0;
+	int w;
+	// A popcount never reads a row, so every indexed group is worth using.
+	if (plan->node->lsm != NULL || bitmap_plan_groups (plan, NULL, bits) != 1)
+		return -1;
+	for (w = 0; w < BITMAP_WORDS; w++)
+		count += __builtin_popcountll (bits[w]);
+	return count;
+}
+
+/**
+ * @brief Frees the indexes of a table.
+ */
+void bitmap_free (struct table* node) {
+	struct bitmap* bm = node->bitmaps;
+	int i;
+	if (bm == NULL)
+		return;
+	for (i = 0; i < MAX_COLUMNS_PER_TABLE; i++)
+		free (bm->cols[i]);
+	free (bm);
+	node->bitmaps = NULL;
+}
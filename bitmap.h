@@ -0,0 +1,119 @@
+/**
+ * @file
+ * @brief This file declares the bitmap indexes of columns with few distinct
+ * values.
+ *
+ * A column listed in the config file with "bitmap_index <table> <column>"
+ * keeps, for each of its distinct values, a bitmap of the slots of the table
+ * whose row holds it.  A query then evaluates each predicate on the indexed
+ * columns once per distinct value instead of once per row: the bitmaps of
+ * the values that meet a predicate are ORed, those of the predicates joined
+ * by OR are ORed too, and the groups are ANDed.  The scan only reads the rows
+ * whose bit is set, and when every predicate is on an indexed column the
+ * matches are counted with a popcount.  A scan leaves out the groups that
+ * the column statistics (see colstats.h) expect most rows to meet: they
+ * rule out few rows, so the rows are read anyway and testing them costs
+ * less than ORing the bitmaps.
+ *
+ * The bitmaps are kept up to date through syncSlot() and the edits of
+ * setEntry().  A column holding more than BITMAP_MAX_VALUES distinct values
+ * at once is not a good fit: its index is given up and its predicates are
+ * tested row by row again.  Rows flushed to SSTs are not in any slot, so
+ * they are always tested row by row.
+ */
+
+#ifndef BITMAP_H
+#define BITMAP_H
+
+#include <stdint.h>
+#include "utils.h"
+#include "pred.h"
+
+/**
+ * @brief Words of a bitmap of the slots of a table.
+ */
+#define BITMAP_WORDS ((MAX_RECORDS_PER_TABLE + 63) / 64)
+
+/**
+ * @brief Distinct values an index can hold at once.
+ */
+#define BITMAP_MAX_VALUES 64
+
+/**
+ * @brief Share of the rows above which a scan tests a group row by row
+ * instead of with its bitmaps.
+ */
+#define BITMAP_MAX_PASS 0.5
+
+/**
+ * @brief A distinct value and the slots holding it.
+ */
+struct bitmap_value {
+	char value[MAX_STRTYPE_SIZE];
+	/// Slots holding the value; 0 if the entry is free.
+	int numRows;
+	uint64_t bits[BITMAP_WORDS];
+};
+
+/**
+ * @brief The index of one column.
+ */
+struct bitmap_column {
+	struct bitmap_value values[BITMAP_MAX_VALUES];
+	int numValues;
+	/// 1 once the column held too many values, and the index is no longer kept.
+	int overflow;
+	/// Value of each slot, or -1 if the slot holds no row.
+	signed char slotValue[MAX_RECORDS_PER_TABLE];
+};
+
+/**
+ * @brief The indexes of a table, NULL for the columns not indexed.
+ */
+struct bitmap {
+	struct bitmap_column* cols[MAX_COLUMNS_PER_TABLE];
+};
+
+/**
+ * @brief Index a column of a table, and the rows it already holds.
+ *
+ * @return Return 0 on success, -1 if out of memory.
+ */
+int bitmap_enable(struct table* node, int col);
+
+/**
+ * @brief Bring the indexes up to date with a slot whose row was inserted,
+ * edited or deleted.
+ */
+void bitmap_sync(struct table* node, int index);
+
+/**
+ * @brief Find the slots that may meet the predicates of a plan.
+ *
+ * @param bits Set to the slots that meet every group whose predicates are
+ * all on indexed columns, except the groups the column statistics expect
+ * more than BITMAP_MAX_PASS of the rows to meet.
+ * @return Return 1 if those are all the groups (the slots set are then
+ * exactly the matches), 0 if the rows set must still be tested against
+ * the plan, and -1 if no group could be indexed (bits is not set).
+ */
+int bitmap_plan(const struct pred_plan* plan, uint64_t* bits);
+
+/**
+ * @brief Count the rows that meet the predicates of a plan.
+ *
+ * @return Return the count, or -1 if the bitmaps cannot answer it alone.
+ */
+int bitmap_count(const struct pred_plan* plan);
+
+/**
+ * @brief Test the bit of a slot.
+ */
+#define BITMAP_TEST(bits, index) (((bits)[(index) / 64] >> ((index) % 64)) & 1)
+
+/**
+ * @brief Free the indexes of a table.
+ */
+void bitmap_free(struct table* node);
+
+#endif
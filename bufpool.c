@@ -0,0 +1,336 @@
+/**
+ * @file
+ * @brief This file implements the buffer pool declared in bufpool.h.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include "bufpool.h"
+#include "file.h"
+#include "slab.h"
+
+/**
+ * @brief Buffer pool state of a table (node->pool).
+ */
+struct bufpool_table {
+	/// Spill file of the evicted rows.
+	int fd;
+	/// Size in bytes of a row.
+	size_t rowBytes;
+	/// 1 for a copy made by bufpool_attach_copy(), which evicts only its own rows.
+	int own;
+	/// Position of the clock hand of such a copy.
+	int hand;
+};
+
+/// Maximum bytes of resident rows (0 if the pool is off) and bytes in use.
+static size_t poolLimit = 0;
+static size_t poolUsed = 0;
+
+/// Pooled tables, swept by the clock hand.
+static struct table* pooled[MAX_TABLES];
+static int numPooled = 0;
+
+/// Position of the clock hand.
+static int handTable = 0;
+static int handSlot = 0;
+
+/// Guards the state above and the rows of pooled tables.
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+
+/// Copies of the spill files of the pooled tables, made for a forked process, or -1.
+static int copyFds[MAX_TABLES];
+
+/**
+ * @brief Sets the memory limit of the pool.
+ */
+void bufpool_init (size_t limit) {
+	poolLimit = limit;
+}
+
+// Puts a table under the pool with the spill file at path.  Returns 0 on success, -1 otherwise.
+static int bufpool_attach_file (struct table* node, const char* path, int own) {
+	struct bufpool_table* pool;
+	int i;
+
+	int fd = open (path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0)
+		return -1;
+	pool = malloc (sizeof(struct bufpool_table));
+	pool->fd = fd;
+	pool->rowBytes = node->numCol * MAX_STRTYPE_SIZE;
+	pool->own = own;
+	pool->hand = 0;
+	// Rows are allocated when first written.
+	slab_clear (node->rowSlab);
+	for (i = 0; i < MAX_RECORDS_PER_TABLE; i++) {
+		node->entries[i]->value = NULL;
+		node->entries[i]->referenced = 0;
+		node->entries[i]->dirty = 0;
+		node->entries[i]->cold = 0;
+	}
+	node->pool = pool;
+	return 0;
+}
+
+/**
+ * @brief Puts a table under the pool and creates its spill file.
+ * @return Returns 0 on success, -1 otherwise.
+ */
+int bufpool_attach (struct table* node, const char* dir) {
+	char path[MAX_PATH_LEN + MAX_TABLE_LEN + 8];
+
+	if (poolLimit == 0 || numPooled >= MAX_TABLES)
+		return 0;
+	snprintf (path, sizeof path, "%s%s.cold", dir, node->name);
+	if (bufpool_attach_file (node, path, 0) != 0)
+		return -1;
+	pthread_mutex_lock (&poolLock);
+	pooled[numPooled] = node;
+	numPooled += 1;
+	pthread_mutex_unlock (&poolLock);
+	return 0;
+}
+
+/**
+ * @brief Puts a private copy of a table under the pool, with a spill file that is unlinked at once.
+ * @return Returns 0 on success, -1 otherwise.
+ */
+int bufpool_attach_copy (struct table* node, const char* dir) {
+	char path[MAX_PATH_LEN + MAX_TABLE_LEN + 16];
+
+	if (poolLimit == 0)
+		return 0;
+	snprintf (path, sizeof path, "%s%s.cold.copy", dir, node->name);
+	if (bufpool_attach_file (node, path, 1) != 0)
+		return -1;
+	unlink (path);
+	return 0;
+}
+
+// Spills the row of an entry, if changed, and frees it.  Returns 0, or -1 if the row
+// could not be written and stays resident.  Called with poolLock held.
+static int bufpool_spill (struct table* node, struct hashEntry* entry) {
+	struct bufpool_table* pool = node->pool;
+	char buff[MAX_PATH_LEN];
+	if (entry->dirty) {
+		if (pwrite (pool->fd, entry->value, pool->rowBytes, (off_t)entry->index * pool->rowBytes) != pool->rowBytes) {
+			sprintf (buff, "Spilling a row of %s failed.\n", node->name);
+			if (LOGGING == 1) logger(stdout, buff);
+			else if (LOGGING == 2) logger(file, buff);
+			return -1;
+		}
+		entry->dirty = 0;
+	}
+	slab_free (node->rowSlab, entry->value);
+	entry->value = NULL;
+	entry->cold = 1;
+	poolUsed -= pool->rowBytes;
+	return 0;
+}
+
+// Evicts rows until need more bytes fit under the limit, or every resident row
+// was used since the hand last passed it twice.  Called with poolLock held.
+static void bufpool_evict (size_t need) {
+	struct table* node;
+	struct hashEntry* entry;
+	long budget = 2L * numPooled * MAX_RECORDS_PER_TABLE;
+
+	while (poolUsed + need > poolLimit && budget-- > 0) {
+		node = pooled[handTable];
+		entry = node->entries[handSlot];
+		handSlot += 1;
+		if (handSlot == MAX_RECORDS_PER_TABLE) {
+			handSlot = 0;
+			handTable = (handTable + 1) % numPooled;
+		}
+		if (entry->value == NULL)
+			continue;
+		if (entry->referenced) {
+			entry->referenced = 0;
+			continue;
+		}
+		bufpool_spill (node, entry);
+	}
+}
+
+// Same as bufpool_evict(), for a copy that only evicts its own rows: the rows of the
+// server's tables may be in use by other threads.  Called with poolLock held.
+static void bufpool_evict_own (struct table* node, size_t need) {
+	struct bufpool_table* pool = node->pool;
+	struct hashEntry* entry;
+	long budget = 2L * MAX_RECORDS_PER_TABLE;
+
+	while (poolUsed + need > poolLimit && budget-- > 0) {
+		entry = node->entries[pool->hand];
+		pool->hand = (pool->hand + 1) % MAX_RECORDS_PER_TABLE;
+		if (entry->value == NULL)
+			continue;
+		if (entry->referenced) {
+			entry->referenced = 0;
+			continue;
+		}
+		bufpool_spill (node, entry);
+	}
+}
+
+/**
+ * @brief Makes the row of an entry resident, reading it back from the spill file if it was evicted.
+ */
+void bufpool_touch (struct table* node, struct hashEntry* entry, int write) {
+	struct bufpool_table* pool = node->pool;
+	char buff[MAX_PATH_LEN];
+	if (pool == NULL)
+		return;
+	pthread_mutex_lock (&poolLock);
+	if (entry->value == NULL) {
+		if (pool->own)
+			bufpool_evict_own (node, pool->rowBytes);
+		else
+			bufpool_evict (pool->rowBytes);
+		entry->value = slab_alloc (node->rowSlab);
+		if (entry->cold && pread (pool->fd, entry->value, pool->rowBytes, (off_t)entry->index * pool->rowBytes) != pool->rowBytes) {
+			sprintf (buff, "Reading a row of %s back failed.\n", node->name);
+			if (LOGGING == 1) logger(stdout, buff);
+			else if (LOGGING == 2) logger(file, buff);
+		}
+		// Until it is spilled, a new row only exists in memory.
+		if (!entry->cold)
+			entry->dirty = 1;
+		poolUsed += pool->rowBytes;
+	}
+	entry->referenced = 1;
+	if (write)
+		entry->dirty = 1;
+	pthread_mutex_unlock (&poolLock);
+}
+
+/**
+ * @brief Frees the row of a deleted entry; its spilled copy is stale from now on.
+ */
+void bufpool_drop (struct table* node, struct hashEntry* entry) {
+	struct bufpool_table* pool = node->pool;
+	if (pool == NULL)
+		return;
+	pthread_mutex_lock (&poolLock);
+	if (entry->value != NULL) {
+		slab_free (node->rowSlab, entry->value);
+		entry->value = NULL;
+		poolUsed -= pool->rowBytes;
+	}
+	entry->referenced = 0;
+	entry->dirty = 0;
+	entry->cold = 0;
+	pthread_mutex_unlock (&poolLock);
+}
+
+/**
+ * @brief Frees the rows of a table and closes its spill file.
+ */
+void bufpool_detach (struct table* node) {
+	struct bufpool_table* pool = node->pool;
+	int i;
+	if (pool == NULL)
+		return;
+	pthread_mutex_lock (&poolLock);
+	for (i = 0; i < MAX_RECORDS_PER_TABLE; i++) {
+		if (node->entries[i]->value != NULL) {
+			slab_free (node->rowSlab, node->entries[i]->value);
+			node->entries[i]->value = NULL;
+			poolUsed -= pool->rowBytes;
+		}
+	}
+	for (i = 0; i < numPooled; i++) {
+		if (pooled[i] == node) {
+			pooled[i] = pooled[numPooled - 1];
+			numPooled -= 1;
+			break;
+		}
+	}
+	if (!pool->own) {
+		handTable = 0;
+		handSlot = 0;
+	}
+	pthread_mutex_unlock (&poolLock);
+	close (pool->fd);
+	free (pool);
+	node->pool = NULL;
+}
+
+// Copies a spill file into a new file that is unlinked at once.  Returns its descriptor, or -1.
+static int bufpool_copy_file (int fd, const char* path) {
+	char buff[64 * 1024];
+	off_t offset = 0;
+	ssize_t len;
+	int copy = open (path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if (copy < 0)
+		return -1;
+	unlink (path);
+	while ((len = pread (fd, buff, sizeof buff, offset)) > 0) {
+		if (pwrite (copy, buff, len, offset) != len)
+			break;
+		offset += len;
+	}
+	if (len != 0) {
+		close (copy);
+		return -1;
+	}
+	return copy;
+}
+
+/**
+ * @brief Copies the spill files and holds off evictions until bufpool_fork_end().
+ * @return Returns 0 on success, -1 otherwise (then nothing is held).
+ */
+int bufpool_fork_begin (const char* dir) {
+	char path[MAX_PATH_LEN + MAX_TABLE_LEN + 16];
+	struct bufpool_table* pool;
+	int i;
+	pthread_mutex_lock (&poolLock);
+	for (i = 0; i < numPooled; i++)
+		copyFds[i] = -1;
+	for (i = 0; i < numPooled; i++) {
+		pool = pooled[i]->pool;
+		snprintf (path, sizeof path, "%s%s.cold.fork", dir, pooled[i]->name);
+		copyFds[i] = bufpool_copy_file (pool->fd, path);
+		if (copyFds[i] < 0) {
+			bufpool_fork_end ();
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief Closes the copies of the spill files in the server and lets rows be evicted again.
+ */
+void bufpool_fork_end () {
+	int i;
+	for (i = 0; i < numPooled; i++) {
+		if (copyFds[i] >= 0)
+			close (copyFds[i]);
+		copyFds[i] = -1;
+	}
+	pthread_mutex_unlock (&poolLock);
+}
+
+/**
+ * @brief Stops evicting rows in a forked child, and reads the copies of the spill files.
+ */
+void bufpool_freeze () {
+	struct bufpool_table* pool;
+	int i;
+	// Only the forking thread survives, and the lock it held is the parent's.
+	pthread_mutex_init (&poolLock, NULL);
+	// The server goes on spilling rows into its own files.
+	for (i = 0; i < numPooled; i++) {
+		pool = pooled[i]->pool;
+		close (pool->fd);
+		pool->fd = copyFds[i];
+	}
+	poolLimit = (size_t)-1;
+}
@@ -0,0 +1,105 @@
+/**
+ * @file
+ * @brief This file declares the buffer pool that bounds the memory used by
+ * the rows of on-disk tables.
+ *
+ * With "memory_limit" set, the key, transaction count and list pointers of
+ * every entry stay in memory but its row (the column values) is only kept
+ * while it is hot.  When loading a row would go over the limit, a CLOCK hand
+ * sweeps the rows of all pooled tables, clearing reference bits and evicting
+ * the first row that was not used since its last pass.  Evicted rows are
+ * written (if changed) to the spill file "<table>.cold" in the data
+ * directory, at the offset of their hash table slot, and read back on the
+ * next access.
+ *
+ * The spill file is a cache: durability still comes from the write-ahead log
+ * and the table files, and it is truncated when the server starts.
+ */
+
+#ifndef BUFPOOL_H
+#define BUFPOOL_H
+
+#include <stddef.h>
+#include "utils.h"
+
+/**
+ * @brief Set the maximum number of bytes of rows kept in memory.
+ *
+ * @param limit The limit in bytes; 0 keeps every row in memory.
+ */
+void bufpool_init(size_t limit);
+
+/**
+ * @brief Put a table (with no entries yet) under the buffer pool.
+ *
+ * @param node The table.  Its preallocated rows are freed.
+ * @param dir The data directory (ending with '/').
+ * @return Return 0 on success, -1 if the spill file cannot be created.
+ */
+int bufpool_attach(struct table* node, const char* dir);
+
+/**
+ * @brief Put a private copy of a table (with no entries yet) under the buffer
+ * pool, such as the one a checkpoint merges the log into.
+ *
+ * Its rows count against the memory limit, but it only ever evicts its own
+ * rows, to a spill file of its own that is unlinked at once: the rows of the
+ * server's tables may be in use by other threads.  It is not swept by the
+ * clock of the server's tables either.
+ *
+ * @param node The copy.  Its preallocated rows are freed.
+ * @param dir The data directory (ending with '/').
+ * @return Return 0 on success, -1 if the spill file cannot be created.
+ */
+int bufpool_attach_copy(struct table* node, const char* dir);
+
+/**
+ * @brief Make the row of an entry resident before it is read or written.
+ *
+ * Does nothing for tables that are not pooled.  The row stays valid until the
+ * next call to bufpool_touch().
+ *
+ * @param node The table of the entry.
+ * @param entry The entry.
+ * @param write 1 if the row is about to be changed, 0 otherwise.
+ */
+void bufpool_touch(struct table* node, struct hashEntry* entry, int write);
+
+/**
+ * @brief Forget the row of a deleted entry.
+ */
+void bufpool_drop(struct table* node, struct hashEntry* entry);
+
+/**
+ * @brief Free the rows of a table and close its spill file.
+ */
+void bufpool_detach(struct table* node);
+
+/**
+ * @brief Copy the spill files before forking, and hold off evictions until
+ * bufpool_fork_end(), so the copies match the rows in memory at the fork.
+ *
+ * After the fork the server keeps evicting rows into its spill files, so a
+ * forked process must read the rows it does not have from the copies.
+ *
+ * @param dir The data directory (ending with '/').
+ * @return Return 0 on success, -1 if a copy failed (then evictions are not
+ * held off).
+ */
+int bufpool_fork_begin(const char* dir);
+
+/**
+ * @brief In the server, after forking: close the copies of the spill files
+ * and allow evictions again.
+ */
+void bufpool_fork_end();
+
+/**
+ * @brief Stop evicting rows, in a process forked between bufpool_fork_begin()
+ * and bufpool_fork_end(), and read the copies of the spill files.
+ *
+ * Rows the process touches stay in its (copy-on-write) memory.
+ */
+void bufpool_freeze();
+
+#endif
@@ -0,0 +1,130 @@
+/**
+ * @file
+ * @brief This file implements the background checkpoint thread declared in
+ * checkpoint.h.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include "checkpoint.h"
+#include "tablefile.h"
+#include "wal.h"
+#include "lsm.h"
+#include "lazyload.h"
+#include "bufpool.h"
+#include "file.h"
+
+/// Tables checkpointed by the background thread.
+static struct table* checkpointHead;
+
+/// Data directory of the background thread.
+static char checkpointDir[MAX_PATH_LEN];
+
+/// Seconds between checkpoints.
+static int checkpointInterval;
+
+// Merges the sealed log into every table file, while no table is being loaded.
+static int checkpoint_merge (struct table* head, const char* dir) {
+	char sealed[MAX_PATH_LEN];
+	char path[MAX_PATH_LEN];
+	char buff[MAX_PATH_LEN + 50];
+	struct stat info;
+	struct table* node;
+	unsigned long seq;
+	int status;
+
+	// Seal the live log.  This is the only step that blocks clients, along with
+	// flushing the memtables of LSM tables, whose SSTs then contain the sealed log.
+	// The sealed log is synced after the lock is released.
+	pthread_mutex_lock (&lock);
+	seq = wal_last_seq ();
+	status = wal_rotate (dir);
+	for (node = head; status >= 0 && node != NULL; node = node->next) {
+		if (node->lsm != NULL && lsm_flush (node) != 0)
+			status = -1;
+	}
+	pthread_mutex_unlock (&lock);
+	wal_sync_sealed ();
+	if (status < 0)
+		return -1;
+	// A sealed log left over from an interrupted checkpoint is compacted first; its
+	// own records tell how far it goes.
+	if (status == 1)
+		seq = 0;
+
+	snprintf (sealed, sizeof sealed, "%s%s", dir, WAL_SEALED_NAME);
+	if (stat (sealed, &info) == 0 && info.st_size == 0) {
+		unlink (sealed);
+		return 0;	// Nothing was written since the last checkpoint.
+	}
+
+	for (node = head; node != NULL; node = node->next) {
+		if (node->lsm != NULL)
+			continue;
+		struct table* copy = newTable (node->name, node->numCol, node->col, node->type);
+		snprintf (path, sizeof path, "%s%s", dir, node->name);
+		unsigned long last = seq;
+		// The copy goes through the buffer pool too, so merging stays within the memory limit.
+		if (bufpool_attach_copy (copy, dir) != 0 || tablefile_load (copy, path) != 0
+				|| wal_replay_file (copy, sealed, &last) < 0) {
+			freeTable (copy);
+			return -1;
+		}
+		if (copy->snapSeq > last)
+			last = copy->snapSeq;
+		status = tablefile_write (copy, path, last);
+		freeTable (copy);
+		if (status != 0) {
+			sprintf (buff, "Checkpoint of %s failed.\n", path);
+			if (LOGGING == 1) logger(stdout, buff);
+			else if (LOGGING == 2) logger(file, buff);
+			return -1;
+		}
+	}
+	// Every table file now contains the sealed log.
+	unlink (sealed);
+	return 0;
+}
+
+/**
+ * @brief Merges the sealed log into every table file.
+ * @return Returns 0 on success, -1 otherwise.
+ */
+int checkpoint_run (struct table* head, const char* dir) {
+	int status;
+
+	// Tables being loaded read the files this rewrites.
+	lazyload_pause ();
+	status = checkpoint_merge (head, dir);
+	lazyload_resume ();
+	return status;
+}
+
+// Runs a checkpoint every checkpointInterval seconds.
+static void* checkpoint_loop (void* ptr) {
+	while (1) {
+		sleep (checkpointInterval);
+		checkpoint_run (checkpointHead, checkpointDir);
+	}
+	return NULL;
+}
+
+/**
+ * @brief Starts the background checkpoint thread.
+ * @return Returns 0 on success, -1 otherwise.
+ */
+int checkpoint_start (struct table* head, const char* dir, int interval) {
+	pthread_t thread;
+	checkpointHead = head;
+	strncpy (checkpointDir, dir, MAX_PATH_LEN - 1);
+	checkpointDir[MAX_PATH_LEN - 1] = '\0';
+	checkpointInterval = interval;
+	if (pthread_create (&thread, NULL, checkpoint_loop, NULL) != 0)
+		return -1;
+	pthread_detach (thread);
+	return 0;
+}
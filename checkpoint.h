@@ -0,0 +1,43 @@
+/**
+ * @file
+ * @brief This file declares the background checkpoint thread used by the
+ * on-disk storage policy.
+ *
+ * A checkpoint seals the live write-ahead log (a short rename done under the
+ * server lock), then, without the lock, merges the sealed log into a copy of
+ * each table file and atomically replaces the file.  The sealed log is
+ * removed once every table file contains it, so the log never holds more
+ * than about two checkpoint intervals of writes.
+ *
+ * Tables under the LSM storage policy have no table file: their memtables
+ * are flushed to SSTs (see lsm.h) instead, under the lock.
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "utils.h"
+
+/**
+ * @brief Default number of seconds between checkpoints.
+ */
+#define DEFAULT_CHECKPOINT_INTERVAL 60
+
+/**
+ * @brief Run one checkpoint.
+ *
+ * @param head The first table of the server.  Only the table schemas are
+ * read, so the caller must not hold the server lock.
+ * @param dir The data directory (ending with '/').
+ * @return Return 0 on success, -1 otherwise.
+ */
+int checkpoint_run(struct table* head, const char* dir);
+
+/**
+ * @brief Start the background thread that runs a checkpoint every interval
+ * seconds.
+ * @return Return 0 on success, -1 otherwise.
+ */
+int checkpoint_start(struct table* head, const char* dir, int interval);
+
+#endif
@@ -9,14 +9,13 @@
 
 #include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "storage.h"
 #include <time.h>
 #include <sys/time.h>
 #include "file.h"
-#include "storage.c"
 #include "utils.h"
-#include "utils.c"
 
 #define MAX_KEYS 10
 
@@ -0,0 +1,309 @@
+/**
+ * @file
+ * @brief This file implements the column statistics declared in colstats.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "colstats.h"
+#include "pred.h"
+
+/**
+ * @brief Creates stale statistics.
+ */
+struct colstats* colstats_new () {
+	struct colstats* stats = calloc (1, sizeof(struct colstats));
+	if (stats != NULL)
+		stats->stale = 1;
+	return stats;
+}
+
+/**
+ * @brief Frees statistics.
+ */
+void colstats_free (struct colstats* stats) {
+	free (stats);
+}
+
+// Hashes a value of a column (ints by their number, so "07" and "7" are the same value).
+static uint64_t colstats_hash (int isInt, const char* value) {
+	uint64_t h = 14695981039346656037ULL;
+	long v;
+	size_t i, len;
+	const unsigned char* bytes = (const unsigned char*)value;
+	if (isInt) {
+		v = atol (value);
+		bytes = (const unsigned char*)&v;
+		len = sizeof v;
+	}
+	else
+		len = strlen (value);
+	// FNV-1a, then a final mix so the high bits are spread too.
+	for (i = 0; i < len; i++) {
+		h ^= bytes[i];
+		h *= 1099511628211ULL;
+	}
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return h;
+}
+
+// Adds a value to the sketch, minimum and maximum of a column.
+static void colstats_add_value (struct colstats_column* col, int isInt, const char* value) {
+	uint64_t h = colstats_hash (isInt, value);
+	int reg = h >> (64 - COLSTATS_HLL_BITS);
+	int rank = 1;
+	long v;
+
+	// The register keeps the longest run of leading zeros seen after the index bits.
+	h <<= COLSTATS_HLL_BITS;
+	while (rank <= 64 - COLSTATS_HLL_BITS && !(h & (1ULL << 63))) {
+		rank += 1;
+		h <<= 1;
+	}
+	if (rank > col->hll[reg])
+		col->hll[reg] = rank;
+
+	if (isInt) {
+		v = atol (value);
+		if (!col->hasRange || v < col->min)
+			col->min = v;
+		if (!col->hasRange || v > col->max)
+			col->max = v;
+	}
+	else {
+		if (!col->hasRange || strcmp (value, col->smin) < 0)
+			strcpy (col->smin, value);
+		if (!col->hasRange || strcmp (value, col->smax) > 0)
+			strcpy (col->smax, value);
+	}
+	col->hasRange = 1;
+}
+
+// Adds the values of a row to the statistics, and to the buckets of the histograms.
+static void colstats_add_row (struct table* node, struct colstats* stats, char (*values)[MAX_STRTYPE_SIZE]) {
+	struct colstats_column* col;
+	long v;
+	int i, b;
+	for (i = 0; i < node->numCol; i++) {
+		col = &stats->cols[i];
+		colstats_add_value (col, node->type[i] == -1, values[i]);
+		if (node->type[i] != -1 || col->numBuckets == 0)
+			continue;
+		v = atol (values[i]);
+		for (b = 0; b < col->numBuckets - 1 && v > col->bounds[b]; b++)
+			;
+		if (v > col->bounds[b])
+			col->bounds[b] = v;
+		col->counts[b] += 1;
+	}
+}
+
+/**
+ * @brief Counts an inserted row.
+ */
+void colstats_insert (struct table* node, char (*values)[MAX_STRTYPE_SIZE]) {
+	struct colstats* stats = node->stats;
+	if (stats == NULL)
+		return;
+	stats->numRows += 1;
+	stats->changes += 1;
+	colstats_add_row (node, stats, values);
+}
+
+/**
+ * @brief Counts an edited row.
+ */
+void colstats_update (struct table* node, char (*values)[MAX_STRTYPE_SIZE]) {
+	struct colstats* stats = node->stats;
+	int i;
+	if (stats == NULL)
+		return;
+	// The old values stay in the histograms until the next rebuild.
+	stats->changes += 1;
+	for (i = 0; i < node->numCol; i++)
+		colstats_add_value (&stats->cols[i], node->type[i] == -1, values[i]);
+}
+
+/**
+ * @brief Counts a deleted row.
+ */
+void colstats_delete (struct table* node) {
+	struct colstats* stats = node->stats;
+	if (stats == NULL)
+		return;
+	if (stats->numRows > 0)
+		stats->numRows -= 1;
+	stats->changes += 1;
+}
+
+/**
+ * @brief Marks the statistics of a table as unknown.
+ */
+void colstats_invalidate (struct table* node) {
+	if (node->stats != NULL)
+		((struct colstats*)node->stats)->stale = 1;
+}
+
+/**
+ * @brief Values of the int columns collected while the statistics are rebuilt.
+ */
+struct colstats_rebuild {
+	struct table* node;
+	struct colstats* stats;
+	long* values[MAX_COLUMNS_PER_TABLE];
+	size_t numValues;
+	size_t alloc;
+};
+
+// Adds a row to the rebuilt statistics.
+static int colstats_visit (const char* key, char (*values)[MAX_STRTYPE_SIZE], void* arg) {
+	struct colstats_rebuild* rebuild = arg;
+	struct table* node = rebuild->node;
+	long* grown;
+	int i;
+	if (rebuild->numValues == rebuild->alloc) {
+		rebuild->alloc = rebuild->alloc > 0 ? 2 * rebuild->alloc : 256;
+		for (i = 0; i < node->numCol; i++) {
+			if (node->type[i] != -1)
+				continue;
+			grown = realloc (rebuild->values[i], rebuild->alloc * sizeof(long));
+			if (grown == NULL)
+				return -1;
+			rebuild->values[i] = grown;
+		}
+	}
+	for (i = 0; i < node->numCol; i++) {
+		colstats_add_value (&rebuild->stats->cols[i], node->type[i] == -1, values[i]);
+		if (node->type[i] == -1)
+			rebuild->values[i][rebuild->numValues] = atol (values[i]);
+	}
+	rebuild->numValues += 1;
+	return 0;
+}
+
+// Orders longs.
+static int colstats_cmp (const void* a, const void* b) {
+	long x = *(const long*)a;
+	long y = *(const long*)b;
+	return x < y ? -1 : x > y;
+}
+
+// Rebuilds the statistics of a table with one scan.  Returns 0, or -1 if out of memory.
+static int colstats_rebuild (struct table* node, struct colstats* stats) {
+	struct colstats_rebuild rebuild;
+	struct pred_plan plan;
+	struct colstats_column* col;
+	size_t n, start, end;
+	int i, b, numBuckets, status;
+
+	memset (&rebuild, 0, sizeof rebuild);
+	memset (stats->cols, 0, sizeof stats->cols);
+	rebuild.node = node;
+	rebuild.stats = stats;
+	// A plan without predicates visits every row, those in SSTs included.
+	plan.node = node;
+	plan.numGroups = 0;
+	plan.numTerms = 0;
+	plan.orderCol = -1;
+	plan.limit = 0;
+	status = scan_plan (&plan, 1, colstats_visit, &rebuild);
+	n = rebuild.numValues;
+	for (i = 0; i < node->numCol && status == 0; i++) {
+		if (node->type[i] != -1 || n == 0)
+			continue;
+		// Equi-depth: every bucket gets the same share of the sorted values.
+		col = &stats->cols[i];
+		qsort (rebuild.values[i], n, sizeof(long), colstats_cmp);
+		numBuckets = n < COLSTATS_BUCKETS ? n : COLSTATS_BUCKETS;
+		for (b = 0; b < numBuckets; b++) {
+			start = b * n / numBuckets;
+			end = (b + 1) * n / numBuckets;
+			// A value repeated across buckets ends up in one.
+			if (col->numBuckets > 0 && col->bounds[col->numBuckets - 1] == rebuild.values[i][end - 1])
+				col->counts[col->numBuckets - 1] += end - start;
+			else {
+				col->bounds[col->numBuckets] = rebuild.values[i][end - 1];
+				col->counts[col->numBuckets] = end - start;
+				col->numBuckets += 1;
+			}
+		}
+	}
+	for (i = 0; i < node->numCol; i++)
+		free (rebuild.values[i]);
+	if (status != 0) {
+		stats->stale = 1;
+		return -1;
+	}
+	stats->numRows = n;
+	stats->changes = 0;
+	stats->stale = 0;
+	return 0;
+}
+
+/**
+ * @brief Returns the statistics of a table, rebuilt if stale.
+ */
+struct colstats* colstats_get (struct table* node) {
+	struct colstats* stats = node->stats;
+	if (stats == NULL)
+		return NULL;
+	if ((stats->stale || (stats->changes >= COLSTATS_MIN_CHANGES && stats->changes >= stats->numRows / 4))
+			&& colstats_rebuild (node, stats) != 0)
+		return NULL;
+	return stats;
+}
+
+/**
+ * @brief Estimates the distinct values of a column from its sketch.
+ */
+double colstats_distinct (const struct colstats* stats, int col) {
+	const unsigned char* hll = stats->cols[col].hll;
+	double m = COLSTATS_HLL_SIZE;
+	double sum = 0;
+	double estimate;
+	int zeros = 0;
+	int i;
+	for (i = 0; i < COLSTATS_HLL_SIZE; i++) {
+		sum += ldexp (1.0, -hll[i]);
+		zeros += hll[i] == 0;
+	}
+	estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+	// Few values: count the empty registers instead.
+	if (estimate <= 2.5 * m && zeros > 0)
+		estimate = m * log (m / zeros);
+	// No column has more distinct values than rows.
+	if (estimate > stats->numRows)
+		estimate = stats->numRows;
+	return estimate;
+}
+
+/**
+ * @brief Estimates the share of rows below a value from the histogram of an int column.
+ */
+double colstats_below (const struct colstats* stats, int col, long value) {
+	const struct colstats_column* c = &stats->cols[col];
+	double below = 0;
+	double total = 0;
+	long low;
+	int b;
+	if (c->numBuckets == 0)
+		return -1;
+	for (b = 0; b < c->numBuckets; b++)
+		total += c->counts[b];
+	for (b = 0; b < c->numBuckets; b++) {
+		low = b == 0 ? c->min : c->bounds[b - 1];
+		if (value > c->bounds[b])
+			below += c->counts[b];
+		else {
+			// Values are taken as spread evenly within a bucket.
+			if (value > low)
+				below += c->counts[b] * (double)(value - low) / (c->bounds[b] - low + 1);
+			break;
+		}
+	}
+	return total > 0 ? below / total : 0;
+}
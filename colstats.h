@@ -0,0 +1,126 @@
+/**
+ * @file
+ * @brief This file declares the per-column statistics of a table, used to
+ * plan queries and answered by the STATS command.
+ *
+ * For every column a table keeps a HyperLogLog sketch of its distinct
+ * values, its smallest and largest value and, for int columns, an
+ * equi-depth histogram: buckets holding about the same number of rows, so
+ * the histogram stays accurate where the values are dense.
+ *
+ * setEntry() keeps the statistics up to date as rows change: inserts add
+ * the new values everywhere, while deletes and old values of edited rows
+ * are only counted, since a sketch or a histogram bucket cannot forget a
+ * value.  Once the changes reach a quarter of the rows (or the table was
+ * loaded from a file without setEntry()), the next reader rebuilds the
+ * statistics with one scan of the table.
+ */
+
+#ifndef COLSTATS_H
+#define COLSTATS_H
+
+#include "utils.h"
+
+/**
+ * @brief Registers of a HyperLogLog sketch (standard error about 6.5%).
+ */
+#define COLSTATS_HLL_BITS 8
+#define COLSTATS_HLL_SIZE (1 << COLSTATS_HLL_BITS)
+
+/**
+ * @brief Buckets of the histogram of an int column.
+ */
+#define COLSTATS_BUCKETS 16
+
+/**
+ * @brief Changes that never make the statistics stale.
+ */
+#define COLSTATS_MIN_CHANGES 64
+
+/**
+ * @brief The statistics of one column.
+ */
+struct colstats_column {
+	/// HyperLogLog registers.
+	unsigned char hll[COLSTATS_HLL_SIZE];
+	/// 1 once min and max hold a value.
+	int hasRange;
+	/// Smallest and largest value (ints, or strings in byte order).
+	long min;
+	long max;
+	char smin[MAX_STRTYPE_SIZE];
+	char smax[MAX_STRTYPE_SIZE];
+	/// Histogram of an int column: bucket i holds the values above bucket
+	/// i - 1 (or from min) up to bounds[i].
+	int numBuckets;
+	long bounds[COLSTATS_BUCKETS];
+	unsigned long counts[COLSTATS_BUCKETS];
+};
+
+/**
+ * @brief The statistics of a table.
+ */
+struct colstats {
+	/// Number of rows.
+	unsigned long numRows;
+	/// Rows inserted, edited or deleted since the last rebuild.
+	unsigned long changes;
+	/// 1 if rows were added without setEntry(), so the counts are unknown.
+	int stale;
+	struct colstats_column cols[MAX_COLUMNS_PER_TABLE];
+};
+
+/**
+ * @brief Create the (stale) statistics of a table.
+ *
+ * @return Return them, or NULL if out of memory.
+ */
+struct colstats* colstats_new();
+
+/**
+ * @brief Free the statistics of a table.
+ */
+void colstats_free(struct colstats* stats);
+
+/**
+ * @brief Count a row inserted by setEntry().
+ */
+void colstats_insert(struct table* node, char (*values)[MAX_STRTYPE_SIZE]);
+
+/**
+ * @brief Count a row edited by setEntry(), with its new values.
+ */
+void colstats_update(struct table* node, char (*values)[MAX_STRTYPE_SIZE]);
+
+/**
+ * @brief Count a row deleted by setEntry().
+ */
+void colstats_delete(struct table* node);
+
+/**
+ * @brief Mark the statistics of a table as unknown, after rows were added
+ * without setEntry().
+ */
+void colstats_invalidate(struct table* node);
+
+/**
+ * @brief Get the statistics of a table, rebuilding them first if they are
+ * stale.  The caller must hold the server lock.
+ *
+ * @return Return the statistics, or NULL if out of memory.
+ */
+struct colstats* colstats_get(struct table* node);
+
+/**
+ * @brief Estimate the number of distinct values of a column.
+ */
+double colstats_distinct(const struct colstats* stats, int col);
+
+/**
+ * @brief Estimate the share of rows whose int column is below a value.
+ *
+ * @return Return a number from 0 to 1, or -1 if the column has no histogram.
+ */
+double colstats_below(const struct colstats* stats, int col, long value);
+
+#endif
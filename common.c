@@ -0,0 +1,148 @@
+/**
+ * @file
+ * @brief This file implements the utility functions declared in utils.h
+ * that the client library needs as well as the server, so that the library
+ * does not pull in the storage engine along with utils.c.
+ */
+
+#define _XOPEN_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "utils.h"
+
+/**
+ * @brief Parse and process a line across the network.
+ */
+int sendall(const int sock, const char *buf, const size_t len)
+{
+	size_t tosend = len;
+	while (tosend > 0) {
+		ssize_t bytes = send(sock, buf, tosend, 0);
+		if (bytes <= 0) 
+			break; // send() was not successful, so stop.
+		tosend -= (size_t) bytes;
+		buf += bytes;
+	};
+
+	return tosend == 0 ? 0 : -1;
+}
+
+/**
+ * In order to avoid reading more than a line from the stream,
+ * this function only reads one byte at a time.  This is very
+ * inefficient, and you are free to optimize it or implement your
+ * own function.
+ */
+int recvline(const int sock, char *buf, const size_t buflen)
+{
+	int status = 0; // Return status.
+	size_t bufleft = buflen;
+
+	while (bufleft > 1) {
+		// Read one byte from scoket.
+		ssize_t bytes = recv(sock, buf, 1, 0);
+		if (bytes <= 0) {
+			// recv() was not successful, so stop.
+			status = -1;
+			break;
+		} else if (*buf == '\n') {
+			// Found end of line, so stop.
+			*buf = 0; // Replace end of line with a null terminator.
+			status = 0;
+			break;
+		} else {
+			// Keep going.
+			bufleft -= 1;
+			buf += 1;
+		}
+	}
+	*buf = 0; // add null terminator in case it's not already there.
+	return status;
+}
+/**
+ * @brief helper funtion used to print
+ * @return void
+ */
+void logger(FILE *file, char *message)
+{
+	fprintf(file,"%s",message);
+	fflush(file);
+}
+/**
+ * @brief Encrypts the password
+ * @return char*, i.e. the encrypted password
+ */
+char *generate_encrypted_password(const char *passwd, const char *salt)
+{
+	if(salt != NULL)
+		return crypt(passwd, salt);
+	else
+		return crypt(passwd, DEFAULT_CRYPT_SALT);
+}
+
+/**
+ * @brief Validates a string based on the type specified.
+ * @return Returns 1 if it fails and 0 otherwise.
+ */
+int my_strvalidate(char *str, int type) {
+
+	int i,j;
+  	j=strlen(str);
+  	int k;
+	// Alphanumeric chars only.
+	if (type == 1) {
+   		for (i = 0; i < j; i++){
+	  		k=(int)str[i];
+      			if (!((k>=(int)'a'&&k<=(int)'z') || (k>=(int)'A'&&k<=(int)'Z') || (k>=(int)'0' && k<=(int)'9'))) {
+    	  			return 1;
+      			}
+   		}
+	}
+	// Integers only.
+	else if (type == 2) {
+		for (i = 0; i < j; i++){
+	  		k=(int)str[i];
+      			if (!(k >= (int)'0' && k <= (int)'9')) {
+      				if (i == 0 && k != 45 && k != 43)	// 45 = (int)'-', 43 = (int) '+'
+      					return 1;
+      			}
+   		}
+	}
+	// Specific to hostname.
+	else if (type == 3) {
+		if (strcmp (str, "localhost") == 0) {
+			return 0;
+		}
+		for (i = 0; i < j; i++){
+	  		k=(int)str[i];
+      			if (!((k>=(int)'a'&&k<=(int)'z') || (k>=(int)'A'&&k<=(int)'Z') || (k >= (int)'0' && k <= (int)'9') || (k == (int)'.') )) {
+    	  			return 1;
+      			}
+   		}
+	}
+	// Alphanumeric with spaces.
+	else if (type == 4) {
+		for (i = 0; i < j; i++){
+	  		k=(int)str[i];
+      			if (!((k>=(int)'a'&&k<=(int)'z') || (k>=(int)'A'&&k<=(int)'Z') || (k>=(int)'0' && k<=(int)'9') || (k == (int)' '))) {
+    	  			return 1;
+      			}
+   		}
+	}
+	// Numbers only.
+	else if (type == 5) {
+		for (i = 0; i < j; i++){
+	  		k=(int)str[i];
+      			if (!(k >= (int)'0' && k <= (int)'9')) {
+      				return 1;
+      			}
+   		}
+	}
+  	return 0;
+}
+
@@ -0,0 +1,164 @@
+/**
+ * @file
+ * @brief This file implements the dictionary encoding declared in dict.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "dict.h"
+#include "bufpool.h"
+
+// Finds the bucket of a value in the index: the one holding it, or the free one it would take.
+static int dict_bucket (const struct dict_column* dcol, const char* value) {
+	int b = keyHash (value) & (dcol->indexSize - 1);
+	while (dcol->index[b] != 0 && strcmp (dcol->strings[dcol->index[b] - 1], value) != 0)
+		b = (b + 1) & (dcol->indexSize - 1);
+	return b;
+}
+
+// Doubles the index, keeping it at most half full.  Returns 0, or -1 if out of memory.
+static int dict_grow_index (struct dict_column* dcol) {
+	int* old = dcol->index;
+	int oldSize = dcol->indexSize;
+	int i;
+	dcol->indexSize = oldSize > 0 ? oldSize * 2 : 64;
+	dcol->index = calloc (dcol->indexSize, sizeof(int));
+	if (dcol->index == NULL) {
+		dcol->index = old;
+		dcol->indexSize = oldSize;
+		return -1;
+	}
+	for (i = 0; i < oldSize; i++) {
+		if (old[i] != 0)
+			dcol->index[dict_bucket (dcol, dcol->strings[old[i] - 1])] = old[i];
+	}
+	free (old);
+	return 0;
+}
+
+// Keeps a code in the field of a row.
+static void dict_store (char* field, int code) {
+	field[DICT_CODE_OFFSET] = code & 0xFF;
+	field[DICT_CODE_OFFSET + 1] = (code >> 8) & 0xFF;
+}
+
+// Returns the code of a value, giving it the next one if it has none, or DICT_NONE.
+static int dict_intern (struct dict_column* dcol, const char* value) {
+	char (*strings)[MAX_STRTYPE_SIZE];
+	int b = dict_bucket (dcol, value);
+	if (dcol->index[b] != 0)
+		return dcol->index[b] - 1;
+	if (dcol->numStrings == DICT_MAX_CODES)
+		return DICT_NONE;
+	if (dcol->numStrings == dcol->alloc) {
+		strings = realloc (dcol->strings, dcol->alloc * 2 * MAX_STRTYPE_SIZE);
+		if (strings == NULL)
+			return DICT_NONE;
+		dcol->strings = strings;
+		dcol->alloc *= 2;
+	}
+	if (2 * (dcol->numStrings + 1) > dcol->indexSize) {
+		if (dict_grow_index (dcol) != 0)
+			return DICT_NONE;
+		b = dict_bucket (dcol, value);
+	}
+	strcpy (dcol->strings[dcol->numStrings], value);
+	dcol->numStrings += 1;
+	dcol->index[b] = dcol->numStrings;
+	return dcol->numStrings - 1;
+}
+
+/**
+ * @brief Encodes a string column and the live rows of the table.
+ * @return Returns 0 on success, -1 if out of memory and -2 for an int or too wide column.
+ */
+int dict_enable (struct table* node, int col) {
+	struct dict* dict = node->dict;
+	struct dict_column* dcol;
+	struct hashEntry* entry;
+	int i;
+	if (node->type[col] == -1 || node->type[col] > DICT_CODE_OFFSET)
+		return -2;
+	if (dict == NULL) {
+		dict = calloc (1, sizeof(struct dict));
+		if (dict == NULL)
+			return -1;
+		node->dict = dict;
+	}
+	if (dict->cols[col] != NULL)
+		return 0;
+	dcol = calloc (1, sizeof(struct dict_column));
+	if (dcol == NULL)
+		return -1;
+	dcol->alloc = 16;
+	dcol->strings = malloc (dcol->alloc * MAX_STRTYPE_SIZE);
+	if (dcol->strings == NULL || dict_grow_index (dcol) != 0) {
+		free (dcol->strings);
+		free (dcol);
+		return -1;
+	}
+	for (i = 0; i < MAX_RECORDS_PER_TABLE; i++) {
+		entry = node->entries[i];
+		if (node->slots[i].state != SLOT_LIVE)
+			continue;
+		bufpool_touch (node, entry, 1);
+		dict_store (entry->value[col], dict_intern (dcol, entry->value[col]));
+	}
+	dict->cols[col] = dcol;
+	return 0;
+}
+
+/**
+ * @brief Encodes the values of a row in its fields.
+ */
+void dict_set (struct table* node, struct hashEntry* entry) {
+	struct dict* dict = node->dict;
+	int i;
+	if (dict == NULL)
+		return;
+	for (i = 0; i < node->numCol; i++) {
+		if (dict->cols[i] != NULL)
+			dict_store (entry->value[i], dict_intern (dict->cols[i], entry->value[i]));
+	}
+}
+
+/**
+ * @brief Tells whether the rows of a column keep codes.
+ * @return Returns 1 if the column is encoded, 0 otherwise.
+ */
+int dict_encoded (struct table* node, int col) {
+	struct dict* dict = node->dict;
+	return dict != NULL && dict->cols[col] != NULL;
+}
+
+/**
+ * @brief Finds the code of a value.
+ * @return Returns the code, or -1 if the column never held the value.
+ */
+int dict_code (struct table* node, int col, const char* value) {
+	struct dict* dict = node->dict;
+	struct dict_column* dcol;
+	if (dict == NULL || dict->cols[col] == NULL)
+		return -1;
+	dcol = dict->cols[col];
+	return dcol->index[dict_bucket (dcol, value)] - 1;
+}
+
+/**
+ * @brief Frees the dictionaries of a table.
+ */
+void dict_free (struct table* node) {
+	struct dict* dict = node->dict;
+	int i;
+	if (dict == NULL)
+		return;
+	for (i = 0; i < MAX_COLUMNS_PER_TABLE; i++) {
+		if (dict->cols[i] != NULL) {
+			free (dict->cols[i]->strings);
+			free (dict->cols[i]->index);
+			free (dict->cols[i]);
+		}
+	}
+	free (dict);
+	node->dict = NULL;
+}
@@ -0,0 +1,102 @@
+/**
+ * @file
+ * @brief This file declares the dictionary encoding of string columns.
+ *
+ * A string column with few distinct values, listed in the config file with
+ * "dictionary <table> <column>", gets a dictionary: every distinct value it
+ * ever held is given a small integer code, and each row keeps the code of
+ * its value in the last bytes of the column's field, past the longest string
+ * the column can hold.  Equality predicates (=, != and IN) on the column then
+ * compare two codes instead of two strings (see pred.h).
+ *
+ * The encoding speeds up these predicates but does not make rows smaller.
+ * Every column of a row is a field of MAX_STRTYPE_SIZE bytes, read in place
+ * by the buffer pool, the mapped and table files, the log, the indexes and
+ * the scans, so the rows keep the strings and a code in place of a string
+ * would save no memory.  The codes take no memory beyond the values of the
+ * dictionary; they are kept up to date by setEntry() and putEntry().  Only
+ * char columns declared at most DICT_CODE_OFFSET wide leave room for a code;
+ * the server refuses to start if another column is listed.  Codes are never taken back, so a code found when a query is compiled stays
+ * right for as long as the query is prepared.  A value that cannot be given
+ * a code (the dictionary is full, or out of memory) is marked DICT_NONE and
+ * compared as a string.
+ */
+
+#ifndef DICT_H
+#define DICT_H
+
+#include "utils.h"
+
+/**
+ * @brief Code of a slot whose value has none.
+ */
+#define DICT_NONE 0xFFFF
+
+/**
+ * @brief Distinct values of a dictionary.
+ */
+#define DICT_MAX_CODES DICT_NONE
+
+/**
+ * @brief Offset of the code of a row in the field of an encoded column.
+ */
+#define DICT_CODE_OFFSET (MAX_STRTYPE_SIZE - 2)
+
+/**
+ * @brief Read the code kept in the field of an encoded column.
+ */
+#define DICT_CODE(field) (((const unsigned char*)(field))[DICT_CODE_OFFSET] | ((const unsigned char*)(field))[DICT_CODE_OFFSET + 1] << 8)
+
+/**
+ * @brief The dictionary of one column.
+ */
+struct dict_column {
+	/// The values, by code.
+	char (*strings)[MAX_STRTYPE_SIZE];
+	int numStrings;
+	int alloc;
+	/// Open addressing table of the values: code + 1, or 0 if the bucket is free.
+	int* index;
+	int indexSize;
+};
+
+/**
+ * @brief The dictionaries of a table, NULL for the columns not encoded.
+ */
+struct dict {
+	struct dict_column* cols[MAX_COLUMNS_PER_TABLE];
+};
+
+/**
+ * @brief Encode a string column of a table, and the rows it already holds.
+ *
+ * @return Return 0 on success, -1 if out of memory and -2 if the column is
+ * an int or too wide to keep a code.
+ */
+int dict_enable(struct table* node, int col);
+
+/**
+ * @brief Encode the values of a row just written, in the fields of the row.
+ */
+void dict_set(struct table* node, struct hashEntry* entry);
+
+/**
+ * @brief Tell whether the rows of a column keep codes (see DICT_CODE).
+ *
+ * @return Return 1 if the column is encoded, 0 otherwise.
+ */
+int dict_encoded(struct table* node, int col);
+
+/**
+ * @brief Find the code of a value of an encoded column.
+ *
+ * @return Return the code, or -1 if the column never held the value.
+ */
+int dict_code(struct table* node, int col, const char* value);
+
+/**
+ * @brief Free the dictionaries of a table.
+ */
+void dict_free(struct table* node);
+
+#endif
@@ -0,0 +1,125 @@
+/**
+ * @file
+ * @brief This file implements the ordered key index declared in keyindex.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "keyindex.h"
+
+/**
+ * @brief Creates an empty index.
+ */
+struct keyindex* keyindex_new () {
+	struct keyindex* index = calloc (1, sizeof(struct keyindex));
+	if (index != NULL) {
+		index->height = 1;
+		index->seed = 1;
+	}
+	return index;
+}
+
+/**
+ * @brief Removes every key from the index.
+ */
+void keyindex_clear (struct keyindex* index) {
+	struct keyindex_node* node = index->head[0];
+	struct keyindex_node* next;
+	while (node != NULL) {
+		next = node->next[0];
+		free (node);
+		node = next;
+	}
+	memset (index->head, 0, sizeof index->head);
+	index->height = 1;
+	index->size = 0;
+}
+
+/**
+ * @brief Frees an index and its nodes.
+ */
+void keyindex_free (struct keyindex* index) {
+	if (index == NULL)
+		return;
+	keyindex_clear (index);
+	free (index);
+}
+
+// Fills prev with the link, on every level, after which key belongs.
+static void keyindex_find (struct keyindex* index, const char* key, struct keyindex_node*** prev) {
+	struct keyindex_node** link = NULL;
+	int level;
+	for (level = index->height - 1; level >= 0; level--) {
+		// Start from the node reached on the level above, or from the head.
+		struct keyindex_node** next = link != NULL ? &(*link)->next[level] : &index->head[level];
+		while (*next != NULL && strcmp ((*next)->entry->key, key) < 0) {
+			link = next;
+			next = &(*next)->next[level];
+		}
+		prev[level] = next;
+	}
+}
+
+/**
+ * @brief Adds an entry to the index.
+ * @return Returns 0 on success, -1 otherwise.
+ */
+int keyindex_insert (struct keyindex* index, struct hashEntry* entry) {
+	struct keyindex_node** prev[KEYINDEX_MAX_LEVEL];
+	struct keyindex_node* node;
+	int height = 1;
+	int level;
+
+	// Every level is kept by half the nodes of the level below.
+	while (height < KEYINDEX_MAX_LEVEL && (rand_r (&index->seed) & 1))
+		height += 1;
+	node = malloc (sizeof(struct keyindex_node) + height * sizeof(struct keyindex_node*));
+	if (node == NULL)
+		return -1;
+	node->entry = entry;
+	node->height = height;
+	keyindex_find (index, entry->key, prev);
+	// New levels start at the head.
+	for (level = index->height; level < height; level++)
+		prev[level] = &index->head[level];
+	if (height > index->height)
+		index->height = height;
+	for (level = 0; level < height; level++) {
+		node->next[level] = *prev[level];
+		*prev[level] = node;
+	}
+	index->size += 1;
+	return 0;
+}
+
+/**
+ * @brief Removes a key from the index.
+ */
+void keyindex_remove (struct keyindex* index, const char* key) {
+	struct keyindex_node** prev[KEYINDEX_MAX_LEVEL];
+	struct keyindex_node* node;
+	int level;
+
+	keyindex_find (index, key, prev);
+	node = *prev[0];
+	if (node == NULL || strcmp (node->entry->key, key) != 0)
+		return;
+	for (level = 0; level < node->height; level++)
+		*prev[level] = node->next[level];
+	while (index->height > 1 && index->head[index->height - 1] == NULL)
+		index->height -= 1;
+	index->size -= 1;
+	free (node);
+}
+
+/**
+ * @brief Finds the first key not below the given key.
+ * @return Returns its node, or NULL if there is none.
+ */
+struct keyindex_node* keyindex_seek (struct keyindex* index, const char* key) {
+	struct keyindex_node** prev[KEYINDEX_MAX_LEVEL];
+	if (key == NULL)
+		return index->head[0];
+	keyindex_find (index, key, prev);
+	return *prev[0];
+}
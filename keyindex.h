@@ -0,0 +1,94 @@
+/**
+ * @file
+ * @brief This file declares the ordered key index kept alongside the hash
+ * table of every table.
+ *
+ * The hash table finds one key in constant time but keeps its entries in
+ * insertion order, so a range of keys could only be found by visiting every
+ * entry.  The index is a skiplist of the table's entries sorted by key: each
+ * node links forward on 1 to KEYINDEX_MAX_LEVEL levels, a level being kept
+ * by about half the nodes of the level below, so finding the first key of a
+ * range takes O(log n) steps and the k keys after it are read in order from
+ * the bottom level.
+ *
+ * The index points at the entries, so it follows setEntry() and putEntry()
+ * and is rebuilt whenever the entries are relinked (see mmaptable.c) or the
+ * memtable is emptied (see lsm.c).
+ */
+
+#ifndef KEYINDEX_H
+#define KEYINDEX_H
+
+#include "utils.h"
+
+/**
+ * @brief Number of levels of the skiplist (enough for 2^16 keys).
+ */
+#define KEYINDEX_MAX_LEVEL 16
+
+/**
+ * @brief A key in the index.
+ */
+struct keyindex_node {
+	/// The entry holding the key.
+	struct hashEntry* entry;
+	/// Number of levels the node is linked on.
+	int height;
+	/// Next node on every level, or NULL.
+	struct keyindex_node* next[];
+};
+
+/**
+ * @brief The index of a table.
+ */
+struct keyindex {
+	/// Links to the first node on every level.
+	struct keyindex_node* head[KEYINDEX_MAX_LEVEL];
+	/// Highest level in use.
+	int height;
+	/// Number of keys.
+	int size;
+	/// State of the level generator.
+	unsigned int seed;
+};
+
+/**
+ * @brief Create an empty index.
+ *
+ * @return Return the index, or NULL if out of memory.
+ */
+struct keyindex* keyindex_new();
+
+/**
+ * @brief Free an index and its nodes (not the entries).
+ */
+void keyindex_free(struct keyindex* index);
+
+/**
+ * @brief Add an entry, whose key must not be in the index yet.
+ *
+ * @return Return 0 on success, -1 if out of memory.
+ */
+int keyindex_insert(struct keyindex* index, struct hashEntry* entry);
+
+/**
+ * @brief Remove a key from the index, if it is there.
+ */
+void keyindex_remove(struct keyindex* index, const char* key);
+
+/**
+ * @brief Remove every key from the index.
+ */
+void keyindex_clear(struct keyindex* index);
+
+/**
+ * @brief Find the first key of a range.
+ *
+ * @param index The index.
+ * @param key The lowest key of the range, or NULL for the first key.
+ * @return Return the node of the first key not below key, or NULL if there
+ * is none.  Following next[0] from it visits the keys in order.
+ */
+struct keyindex_node* keyindex_seek(struct keyindex* index, const char* key);
+
+#endif
@@ -0,0 +1,150 @@
+/**
+ * @file
+ * @brief This file implements lazy loading of on-disk tables as declared in
+ * lazyload.h.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "lazyload.h"
+#include "tablefile.h"
+#include "wal.h"
+#include "file.h"
+
+/// Data directory of the lazily loaded tables.
+static char loadDir[MAX_PATH_LEN];
+
+/// Held for reading while a table is loaded, and for writing by checkpoints.
+static pthread_rwlock_t checkpointLock = PTHREAD_RWLOCK_INITIALIZER;
+
+/**
+ * @brief Marks a table as not loaded and reads the sequence number of its file.
+ * @return Returns 0 on success, -1 otherwise.
+ */
+int lazyload_attach (struct table* node, const char* dir) {
+	char path[MAX_PATH_LEN + MAX_TABLE_LEN];
+	strncpy (loadDir, dir, MAX_PATH_LEN - 1);
+	loadDir[MAX_PATH_LEN - 1] = '\0';
+	snprintf (path, sizeof path, "%s%s", dir, node->name);
+	// wal_replay() counts the sequence number of the file, but skips the table's records.
+	if (tablefile_read_seq (path, &node->snapSeq) != 0)
+		return -1;
+	node->loaded = 0;
+	return 0;
+}
+
+// Reads the table file and the log records of a table.  Called with its loadLock held.
+static int lazyload_read (struct table* node) {
+	char path[MAX_PATH_LEN + MAX_TABLE_LEN];
+	char buff[MAX_PATH_LEN + MAX_TABLE_LEN + 50];
+	char key[MAX_KEY_LEN];
+	int status;
+
+	snprintf (path, sizeof path, "%s%s", loadDir, node->name);
+	pthread_rwlock_rdlock (&checkpointLock);
+	// Making room for the rows of a table in the buffer pool evicts rows of the
+	// other pooled tables, which commands holding the server lock may be reading.
+	if (node->pool != NULL)
+		pthread_mutex_lock (&lock);
+	status = tablefile_load (node, path);
+	if (status == 0)
+		status = wal_replay_table (node, loadDir);
+	if (status < 0) {
+		// Start over on the next attempt.  Deletes update the watchers, guarded by the server lock.
+		if (node->pool == NULL)
+			pthread_mutex_lock (&lock);
+		while (node->numEntries > 0) {
+			strcpy (key, node->entries[node->headIndex]->key);
+			setEntry (node, node->name, key, "NULL", 0, 0);
+		}
+		pthread_mutex_unlock (&lock);
+	}
+	else if (node->pool != NULL)
+		pthread_mutex_unlock (&lock);
+	pthread_rwlock_unlock (&checkpointLock);
+	if (status < 0) {
+		sprintf (buff, "Error loading table file %s.\n", path);
+		if (LOGGING == 1) logger(stdout, buff);
+		else if (LOGGING == 2) logger(file, buff);
+		return -1;
+	}
+	node->loaded = 1;
+	sprintf (buff, "Loaded %d entries from %s.\n", node->numEntries, path);
+	if (LOGGING == 1) logger(stdout, buff);
+	else if (LOGGING == 2) logger(file, buff);
+	return 0;
+}
+
+/**
+ * @brief Loads a table on first use.
+ * @return Returns 0 if the table is loaded, -1 otherwise.
+ */
+int lazyload_ensure (struct table* node) {
+	int status = 0;
+	pthread_mutex_lock (&node->loadLock);
+	if (!node->loaded)
+		status = lazyload_read (node);
+	pthread_mutex_unlock (&node->loadLock);
+	return status;
+}
+
+/**
+ * @brief Loads the table with the given name on first use.
+ * @return Returns 0 if the table is loaded or unknown, -1 otherwise.
+ */
+int lazyload_ensure_name (struct table* head, const char* name) {
+	struct table* node;
+	for (node = head; node != NULL; node = node->next) {
+		if (strcmp (node->name, name) == 0)
+			return lazyload_ensure (node);
+	}
+	return 0;
+}
+
+/**
+ * @brief Loads every table that is not loaded yet.
+ * @return Returns 0 if all tables are loaded, -1 otherwise.
+ */
+int lazyload_ensure_all (struct table* head) {
+	struct table* node;
+	int status = 0;
+	for (node = head; node != NULL; node = node->next) {
+		if (lazyload_ensure (node) != 0)
+			status = -1;
+	}
+	return status;
+}
+
+// Thread body that loads every table in the background.
+static void* lazyload_prewarm_loop (void* ptr) {
+	lazyload_ensure_all (ptr);
+	return NULL;
+}
+
+/**
+ * @brief Starts the background prewarm thread.
+ * @return Returns 0 on success, -1 otherwise.
+ */
+int lazyload_prewarm (struct table* head) {
+	pthread_t thread;
+	if (pthread_create (&thread, NULL, lazyload_prewarm_loop, head) != 0)
+		return -1;
+	pthread_detach (thread);
+	return 0;
+}
+
+/**
+ * @brief Keeps tables from being loaded during a checkpoint.
+ */
+void lazyload_pause () {
+	pthread_rwlock_wrlock (&checkpointLock);
+}
+
+/**
+ * @brief Lets tables be loaded again.
+ */
+void lazyload_resume () {
+	pthread_rwlock_unlock (&checkpointLock);
+}
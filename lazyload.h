@@ -0,0 +1,73 @@
+/**
+ * @file
+ * @brief This file declares lazy loading of on-disk tables.
+ *
+ * With "table_loading lazy", the server starts listening without reading any
+ * table file: only the sequence number in each file's header is read, so the
+ * write-ahead log can be checked and reopened.  A table is loaded the first
+ * time a command uses it.  Its table file is read and its own records are
+ * replayed from the log, before the server lock is taken, so only the
+ * commands on that table wait (on the table's loadLock).  A table in the
+ * buffer pool is the exception: it is loaded under the server lock, since
+ * making room for its rows evicts rows of the other pooled tables.  With
+ * "table_loading prewarm", a background thread also loads the tables one
+ * after the other.
+ *
+ * A checkpoint rewrites the table files and removes the sealed log, so it
+ * does not run while a table is being loaded, and vice versa.
+ */
+
+#ifndef LAZYLOAD_H
+#define LAZYLOAD_H
+
+#include "utils.h"
+
+/**
+ * @brief Mark a table as not loaded yet.  Call before wal_replay().
+ *
+ * @param node The table, with no entries.
+ * @param dir The data directory (ending with '/').
+ * @return Return 0 on success, -1 if the header of its file cannot be read.
+ */
+int lazyload_attach(struct table* node, const char* dir);
+
+/**
+ * @brief Load a table if it is not loaded yet, waiting if another thread is loading it.
+ *
+ * @return Return 0 if the table is loaded, -1 if loading it failed.  A later
+ * call tries again.
+ */
+int lazyload_ensure(struct table* node);
+
+/**
+ * @brief Load the table with the given name, as lazyload_ensure().
+ *
+ * @return Return 0 if the table is loaded or does not exist, -1 if loading it failed.
+ */
+int lazyload_ensure_name(struct table* head, const char* name);
+
+/**
+ * @brief Load every table, as lazyload_ensure().
+ *
+ * @return Return 0 if all tables are loaded, -1 otherwise.
+ */
+int lazyload_ensure_all(struct table* head);
+
+/**
+ * @brief Start a background thread that loads every table.
+ *
+ * @return Return 0 on success, -1 otherwise.
+ */
+int lazyload_prewarm(struct table* head);
+
+/**
+ * @brief Wait for tables being loaded, and hold off new loads until lazyload_resume().
+ */
+void lazyload_pause();
+
+/**
+ * @brief Allow tables to be loaded again after lazyload_pause().
+ */
+void lazyload_resume();
+
+#endif
@@ -0,0 +1,1080 @@
+/**
+ * @file
+ * @brief This file implements the LSM storage policy declared in lsm.h.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/time.h>
+#include <pthread.h>
+#include "lsm.h"
+#include "tablefile.h"
+#include "wal.h"
+#include "keyindex.h"
+#include "colstats.h"
+#include "file.h"
+
+/// Largest row of any table.
+#define LSM_MAX_ROW (MAX_KEY_LEN + sizeof(uint32_t) + MAX_COLUMNS_PER_TABLE * MAX_STRTYPE_SIZE)
+
+/// Slots of the set of keys deleted since the last flush.
+#define LSM_TOMBSTONE_SLOTS (MAX_RECORDS_PER_TABLE * 2)
+
+/// Rows read at a time when scanning an SST.
+#define LSM_SCAN_ROWS 64
+
+/// Size of the path of an SST or a manifest: the data directory, the table name and "-<id>.sst".
+#define LSM_PATH_LEN (MAX_PATH_LEN + MAX_TABLE_LEN + 16)
+
+/**
+ * @brief An open SST.  Immutable once opened.
+ */
+struct lsm_sstable {
+	int id;
+	int fd;
+	uint32_t numRows;
+	uint32_t rowWidth;
+	unsigned char* bloom;
+	uint32_t bloomBytes;
+	char (*index)[MAX_KEY_LEN];
+	uint32_t numIndex;
+	char minKey[MAX_KEY_LEN];
+	char maxKey[MAX_KEY_LEN];
+};
+
+/**
+ * @brief The SSTs of a level.  Level 0 is ordered from oldest to newest, the
+ * others by key.
+ */
+struct lsm_level {
+	struct lsm_sstable** files;
+	int numFiles;
+	unsigned long numRows;
+	/// Next file of the level to compact.
+	int cursor;
+};
+
+/**
+ * @brief LSM state of a table (node->lsm).
+ */
+struct lsm_tree {
+	char dir[MAX_PATH_LEN];
+	struct lsm_level levels[LSM_MAX_LEVELS];
+	/// Id of the next SST, guarded by idLock.
+	int nextId;
+	pthread_mutex_t idLock;
+	/// Keys deleted since the last flush (open addressing, empty strings are free).
+	char (*tombstones)[MAX_KEY_LEN];
+	int numTombstones;
+};
+
+/**
+ * @brief Reads the rows of a run (a list of SSTs with increasing keys) in order.
+ */
+struct lsm_cursor {
+	struct lsm_sstable** files;
+	int numFiles;
+	int file;
+	uint32_t row;
+	uint32_t blockStart;
+	uint32_t blockRows;
+	char* block;
+};
+
+/**
+ * @brief Merges several runs, newest first, returning the newest row of each key.
+ */
+struct lsm_merge {
+	struct lsm_cursor* cursors;
+	int numCursors;
+};
+
+struct lsm_iter {
+	struct table* node;
+	struct lsm_merge merge;
+};
+
+/**
+ * @brief Writes one SST.
+ */
+struct lsm_writer {
+	struct table* node;
+	int id;
+	char path[LSM_PATH_LEN];
+	char tmp[LSM_PATH_LEN + 4];
+	FILE* out;
+	uint32_t numRows;
+	uint32_t maxRows;
+	unsigned char* bloom;
+	uint32_t bloomBytes;
+	char (*index)[MAX_KEY_LEN];
+	uint32_t numIndex;
+};
+
+/// Server lock taken by the compaction thread, NULL until lsm_start().
+static pthread_mutex_t* lsmServerLock = NULL;
+
+/// Tables compacted by the background thread.
+static struct table* lsmHead = NULL;
+
+/// Signalled after a flush so the compaction thread looks for work.
+static pthread_mutex_t lsmWorkLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t lsmWork = PTHREAD_COND_INITIALIZER;
+
+// Logs a message the way the rest of the server does.
+static void lsm_log (const char* message) {
+	char buff[MAX_PATH_LEN * 2];
+	strncpy (buff, message, sizeof buff - 1);
+	buff[sizeof buff - 1] = '\0';
+	if (LOGGING == 1) logger(stdout, buff);
+	else if (LOGGING == 2) logger(file, buff);
+}
+
+static void lsm_path (char* path, struct lsm_tree* tree, struct table* node, int id) {
+	snprintf (path, LSM_PATH_LEN, "%s%s-%d.sst", tree->dir, node->name, id);
+}
+
+static int lsm_next_id (struct lsm_tree* tree) {
+	int id;
+	pthread_mutex_lock (&tree->idLock);
+	id = tree->nextId++;
+	pthread_mutex_unlock (&tree->idLock);
+	return id;
+}
+
+// Returns the i-th of LSM_BLOOM_HASHES bit positions of a key (double hashing).
+static uint32_t lsm_bloom_bit (const char* key, int i, uint32_t numBits) {
+	uint32_t h1 = 2166136261u;
+	uint32_t h2 = 5381;
+	const unsigned char* c;
+	for (c = (const unsigned char*)key; *c != '\0'; c++) {
+		h1 = (h1 ^ *c) * 16777619u;
+		h2 = h2 * 33 + *c;
+	}
+	return (h1 + i * (h2 | 1)) % numBits;
+}
+
+static void lsm_bloom_add (unsigned char* bloom, uint32_t bytes, const char* key) {
+	int i;
+	uint32_t bit;
+	for (i = 0; i < LSM_BLOOM_HASHES; i++) {
+		bit = lsm_bloom_bit (key, i, bytes * 8);
+		bloom[bit / 8] |= 1 << (bit % 8);
+	}
+}
+
+static int lsm_bloom_test (struct lsm_sstable* sst, const char* key) {
+	int i;
+	uint32_t bit;
+	for (i = 0; i < LSM_BLOOM_HASHES; i++) {
+		bit = lsm_bloom_bit (key, i, sst->bloomBytes * 8);
+		if ((sst->bloom[bit / 8] & (1 << (bit % 8))) == 0)
+			return 0;
+	}
+	return 1;
+}
+
+static void lsm_sstable_free (struct lsm_sstable* sst) {
+	close (sst->fd);
+	free (sst->bloom);
+	free (sst->index);
+	free (sst);
+}
+
+/**
+ * @brief Opens an SST and reads its header, Bloom filter and sparse index.
+ * @return Returns the SST, or NULL if it is missing, corrupt or of another schema.
+ */
+static struct lsm_sstable* lsm_sstable_open (struct table* node, struct lsm_tree* tree, int id) {
+	char path[LSM_PATH_LEN];
+	struct lsm_header header;
+	struct lsm_sstable* sst;
+	off_t offset;
+	int i;
+
+	lsm_path (path, tree, node, id);
+	int fd = open (path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	if (pread (fd, &header, sizeof header, 0) != sizeof header
+			|| memcmp (header.magic, LSM_MAGIC, sizeof header.magic) != 0
+			|| tablefile_crc32 ((const unsigned char*)&header, offsetof(struct lsm_header, headerCrc)) != header.headerCrc
+			|| header.numCol != node->numCol || header.rowWidth != tablefile_row_width (node)
+			|| header.numRows == 0 || header.bloomBytes == 0 || header.numIndex == 0) {
+		close (fd);
+		return NULL;
+	}
+	for (i = 0; i < node->numCol; i++) {
+		if (header.type[i] != node->type[i]) {
+			close (fd);
+			return NULL;
+		}
+	}
+
+	sst = malloc (sizeof(struct lsm_sstable));
+	sst->id = id;
+	sst->fd = fd;
+	sst->numRows = header.numRows;
+	sst->rowWidth = header.rowWidth;
+	sst->bloomBytes = header.bloomBytes;
+	sst->numIndex = header.numIndex;
+	sst->bloom = malloc (header.bloomBytes);
+	sst->index = malloc (header.numIndex * MAX_KEY_LEN);
+	offset = sizeof header + (off_t)header.numRows * header.rowWidth;
+	if (pread (fd, sst->bloom, header.bloomBytes, offset) != header.bloomBytes
+			|| pread (fd, sst->index, header.numIndex * MAX_KEY_LEN, offset + header.bloomBytes) != header.numIndex * MAX_KEY_LEN
+			|| pread (fd, sst->maxKey, MAX_KEY_LEN, offset - header.rowWidth) != MAX_KEY_LEN) {
+		lsm_sstable_free (sst);
+		return NULL;
+	}
+	sst->maxKey[MAX_KEY_LEN - 1] = '\0';
+	for (i = 0; i < sst->numIndex; i++)
+		sst->index[i][MAX_KEY_LEN - 1] = '\0';
+	strcpy (sst->minKey, sst->index[0]);
+	return sst;
+}
+
+/**
+ * @brief Finds a key in an SST.
+ * @return Returns 0 and copies the row if found, -1 otherwise.
+ */
+static int lsm_sstable_find (struct lsm_sstable* sst, const char* key, char* row) {
+	char block[LSM_INDEX_INTERVAL * LSM_MAX_ROW];
+	int lo = 0;
+	int hi = sst->numIndex - 1;
+	int mid, i, numRows;
+	uint32_t start;
+
+	if (strcmp (key, sst->minKey) < 0 || strcmp (key, sst->maxKey) > 0 || !lsm_bloom_test (sst, key))
+		return -1;
+	// Last block whose first key is <= key.
+	while (lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		if (strcmp (sst->index[mid], key) <= 0)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	start = lo * LSM_INDEX_INTERVAL;
+	numRows = sst->numRows - start < LSM_INDEX_INTERVAL ? sst->numRows - start : LSM_INDEX_INTERVAL;
+	if (pread (sst->fd, block, numRows * sst->rowWidth, sizeof(struct lsm_header) + (off_t)start * sst->rowWidth) != numRows * sst->rowWidth)
+		return -1;
+	for (i = 0; i < numRows; i++) {
+		if (strncmp (block + i * sst->rowWidth, key, MAX_KEY_LEN) == 0) {
+			memcpy (row, block + i * sst->rowWidth, sst->rowWidth);
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static void lsm_row_decode (struct table* node, const char* raw, struct lsm_row* row) {
+	row->transac_count = tablefile_decode_row (node, raw, row->key, row->value);
+}
+
+/**
+ * @brief Starts writing an SST of at most maxRows rows.
+ * @return Returns 0 on success, -1 otherwise.
+ */
+static int lsm_writer_open (struct lsm_writer* w, struct table* node, uint32_t maxRows) {
+	struct lsm_tree* tree = node->lsm;
+	struct lsm_header header;
+	memset (w, 0, sizeof *w);
+	w->node = node;
+	w->id = lsm_next_id (tree);
+	w->maxRows = maxRows;
+	lsm_path (w->path, tree, node, w->id);
+	snprintf (w->tmp, sizeof w->tmp, "%s.tmp", w->path);
+	w->out = fopen (w->tmp, "w");
+	if (w->out == NULL)
+		return -1;
+	w->bloomBytes = (maxRows * LSM_BLOOM_BITS_PER_KEY + 7) / 8;
+	if (w->bloomBytes < 64)
+		w->bloomBytes = 64;
+	w->bloom = calloc (w->bloomBytes, 1);
+	w->index = malloc ((maxRows / LSM_INDEX_INTERVAL + 1) * MAX_KEY_LEN);
+	// Room for the header, which is written last.
+	memset (&header, 0, sizeof header);
+	if (fwrite (&header, sizeof header, 1, w->out) != 1)
+		return -1;
+	return 0;
+}
+
+static int lsm_writer_add (struct lsm_writer* w, const char* row) {
+	if (w->numRows % LSM_INDEX_INTERVAL == 0) {
+		memcpy (w->index[w->numIndex], row, MAX_KEY_LEN);
+		w->numIndex += 1;
+	}
+	lsm_bloom_add (w->bloom, w->bloomBytes, row);
+	w->numRows += 1;
+	return fwrite (row, tablefile_row_width (w->node), 1, w->out) == 1 ? 0 : -1;
+}
+
+// Deletes the temporary file of an unfinished SST.
+static void lsm_writer_abort (struct lsm_writer* w) {
+	if (w->out != NULL) {
+		fclose (w->out);
+		unlink (w->tmp);
+	}
+	free (w->bloom);
+	free (w->index);
+}
+
+/**
+ * @brief Finishes an SST and opens it.
+ * @return Returns 0 on success (*sst is NULL if no row was written), -1 otherwise.
+ */
+static int lsm_writer_finish (struct lsm_writer* w, struct lsm_sstable** sst) {
+	struct lsm_header header;
+	int i;
+	*sst = NULL;
+	if (w->numRows == 0) {
+		lsm_writer_abort (w);
+		return 0;
+	}
+	memset (&header, 0, sizeof header);
+	memcpy (header.magic, LSM_MAGIC, sizeof header.magic);
+	header.numCol = w->node->numCol;
+	for (i = 0; i < w->node->numCol; i++)
+		header.type[i] = w->node->type[i];
+	header.rowWidth = tablefile_row_width (w->node);
+	header.numRows = w->numRows;
+	header.bloomBytes = w->bloomBytes;
+	header.numIndex = w->numIndex;
+	header.headerCrc = tablefile_crc32 ((const unsigned char*)&header, offsetof(struct lsm_header, headerCrc));
+	if (fwrite (w->bloom, w->bloomBytes, 1, w->out) != 1
+			|| fwrite (w->index, MAX_KEY_LEN, w->numIndex, w->out) != w->numIndex
+			|| fseek (w->out, 0, SEEK_SET) != 0
+			|| fwrite (&header, sizeof header, 1, w->out) != 1
+			|| fflush (w->out) != 0 || fsync (fileno (w->out)) != 0) {
+		lsm_writer_abort (w);
+		return -1;
+	}
+	fclose (w->out);
+	w->out = NULL;
+	free (w->bloom);
+	free (w->index);
+	if (rename (w->tmp, w->path) != 0) {
+		unlink (w->tmp);
+		return -1;
+	}
+	*sst = lsm_sstable_open (w->node, w->node->lsm, w->id);
+	return *sst == NULL ? -1 : 0;
+}
+
+/**
+ * @brief Atomically replaces the manifest of a table with the given levels.
+ * @return Returns 0 on success, -1 otherwise.
+ */
+static int lsm_manifest_write (struct table* node, struct lsm_level* levels, unsigned long seq) {
+	struct lsm_tree* tree = node->lsm;
+	char path[LSM_PATH_LEN];
+	char tmp[LSM_PATH_LEN + 4];
+	int l, i, status;
+	snprintf (path, sizeof path, "%s%s.lsm", tree->dir, node->name);
+	snprintf (tmp, sizeof tmp, "%s.tmp", path);
+	FILE* out = fopen (tmp, "w");
+	if (out == NULL)
+		return -1;
+	pthread_mutex_lock (&tree->idLock);
+	fprintf (out, "seq %lu\nnext %d\n", seq, tree->nextId);
+	pthread_mutex_unlock (&tree->idLock);
+	for (l = 0; l < LSM_MAX_LEVELS; l++) {
+		for (i = 0; i < levels[l].numFiles; i++)
+			fprintf (out, "%d %d\n", l, levels[l].files[i]->id);
+	}
+	status = fflush (out) == 0 && fsync (fileno (out)) == 0 ? 0 : -1;
+	fclose (out);
+	if (status != 0 || rename (tmp, path) != 0) {
+		unlink (tmp);
+		return -1;
+	}
+	return 0;
+}
+
+static void lsm_level_add (struct lsm_level* level, struct lsm_sstable* sst) {
+	level->files = realloc (level->files, (level->numFiles + 1) * sizeof(struct lsm_sstable*));
+	level->files[level->numFiles] = sst;
+	level->numFiles += 1;
+	level->numRows += sst->numRows;
+}
+
+// Returns 1 if the SST is referenced by the levels.
+static int lsm_level_has (struct lsm_level* levels, int id) {
+	int l, i;
+	for (l = 0; l < LSM_MAX_LEVELS; l++) {
+		for (i = 0; i < levels[l].numFiles; i++) {
+			if (levels[l].files[i]->id == id)
+				return 1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief Opens the SSTs listed in the manifest of a table.
+ * @return Returns 0 on success, -1 otherwise.
+ */
+int lsm_open (struct table* node, const char* dir) {
+	char path[MAX_PATH_LEN];
+	char line[MAX_CONFIG_LINE_LEN];
+	char buff[MAX_PATH_LEN + 50];
+	char prefix[MAX_TABLE_LEN + 2];
+	struct lsm_tree* tree = calloc (1, sizeof(struct lsm_tree));
+	struct lsm_sstable* sst;
+	struct dirent* ent;
+	int level, id, len;
+	char* end;
+
+	strncpy (tree->dir, dir, MAX_PATH_LEN - 1);
+	pthread_mutex_init (&tree->idLock, NULL);
+	tree->nextId = 1;
+	tree->tombstones = calloc (LSM_TOMBSTONE_SLOTS, MAX_KEY_LEN);
+	node->lsm = tree;
+	// The rows in the SSTs are counted when the column statistics are next used.
+	colstats_invalidate (node);
+
+	snprintf (path, sizeof path, "%s%s.lsm", dir, node->name);
+	FILE* in = fopen (path, "r");
+	if (in != NULL) {
+		while (fgets (line, sizeof line, in) != NULL) {
+			if (sscanf (line, "seq %lu", &node->snapSeq) == 1 || sscanf (line, "next %d", &tree->nextId) == 1)
+				continue;
+			if (sscanf (line, "%d %d", &level, &id) != 2 || level < 0 || level >= LSM_MAX_LEVELS) {
+				fclose (in);
+				return -1;
+			}
+			sst = lsm_sstable_open (node, tree, id);
+			if (sst == NULL) {
+				sprintf (buff, "SST %d of table %s is missing or corrupt.\n", id, node->name);
+				lsm_log (buff);
+				fclose (in);
+				return -1;
+			}
+			lsm_level_add (&tree->levels[level], sst);
+		}
+		fclose (in);
+	}
+
+	// Remove SSTs that an interrupted flush or compaction did not get to list.
+	DIR* d = opendir (dir);
+	if (d != NULL) {
+		snprintf (prefix, sizeof prefix, "%s-", node->name);
+		len = strlen (prefix);
+		while ((ent = readdir (d)) != NULL) {
+			if (strncmp (ent->d_name, prefix, len) != 0)
+				continue;
+			id = strtol (ent->d_name + len, &end, 10);
+			if (end == ent->d_name + len || (strcmp (end, ".sst") != 0 && strcmp (end, ".sst.tmp") != 0))
+				continue;
+			if (strcmp (end, ".sst") == 0 && lsm_level_has (tree->levels, id))
+				continue;
+			snprintf (path, sizeof path, "%s%s", dir, ent->d_name);
+			unlink (path);
+		}
+		closedir (d);
+	}
+	return 0;
+}
+
+/**
+ * @brief Closes the SSTs of a table.
+ */
+void lsm_close (struct table* node) {
+	struct lsm_tree* tree = node->lsm;
+	int l, i;
+	if (tree == NULL)
+		return;
+	for (l = 0; l < LSM_MAX_LEVELS; l++) {
+		for (i = 0; i < tree->levels[l].numFiles; i++)
+			lsm_sstable_free (tree->levels[l].files[i]);
+		free (tree->levels[l].files);
+	}
+	free (tree->tombstones);
+	free (tree);
+	node->lsm = NULL;
+}
+
+// Returns the slot of a key in the tombstone set, or the free slot where it would go.
+static int lsm_tombstone_slot (struct lsm_tree* tree, const char* key) {
+	int slot = hash ((char*)key) % LSM_TOMBSTONE_SLOTS;
+	while (tree->tombstones[slot][0] != '\0' && strcmp (tree->tombstones[slot], key) != 0)
+		slot = (slot + 1) % LSM_TOMBSTONE_SLOTS;
+	return slot;
+}
+
+static int lsm_is_deleted (struct lsm_tree* tree, const char* key) {
+	return tree->tombstones[lsm_tombstone_slot (tree, key)][0] != '\0';
+}
+
+/**
+ * @brief Records that a key was deleted since the last flush.
+ */
+void lsm_deleted (struct table* node, const char* key) {
+	struct lsm_tree* tree = node->lsm;
+	int slot = lsm_tombstone_slot (tree, key);
+	if (tree->tombstones[slot][0] != '\0' || tree->numTombstones >= LSM_TOMBSTONE_SLOTS - 1)
+		return;
+	strcpy (tree->tombstones[slot], key);
+	tree->numTombstones += 1;
+}
+
+/**
+ * @brief Looks a key up in the SSTs, newest first.
+ * @return Returns 0 if found, -1 if missing or deleted.
+ */
+int lsm_get (struct table* node, const char* key, struct lsm_row* row) {
+	struct lsm_tree* tree = node->lsm;
+	struct lsm_level* level;
+	char raw[LSM_MAX_ROW];
+	int l, i, lo, hi, mid;
+
+	if (lsm_is_deleted (tree, key))
+		return -1;
+	level = &tree->levels[0];
+	for (i = level->numFiles - 1; i >= 0; i--) {
+		if (lsm_sstable_find (level->files[i], key, raw) == 0) {
+			lsm_row_decode (node, raw, row);
+			return row->transac_count == 0 ? -1 : 0;
+		}
+	}
+	for (l = 1; l < LSM_MAX_LEVELS; l++) {
+		level = &tree->levels[l];
+		// Only one file of the level can hold the key.
+		lo = 0;
+		hi = level->numFiles - 1;
+		while (lo <= hi) {
+			mid = (lo + hi) / 2;
+			if (strcmp (key, level->files[mid]->minKey) < 0)
+				hi = mid - 1;
+			else if (strcmp (key, level->files[mid]->maxKey) > 0)
+				lo = mid + 1;
+			else {
+				if (lsm_sstable_find (level->files[mid], key, raw) == 0) {
+					lsm_row_decode (node, raw, row);
+					return row->transac_count == 0 ? -1 : 0;
+				}
+				break;
+			}
+		}
+	}
+	return -1;
+}
+
+/**
+ * @brief Returns 1 if the key is in the hash table of the table.
+ */
+static int lsm_in_memtable (struct table* node, const char* key) {
+	return findEntry (node, (char*)key) != NULL;
+}
+
+/**
+ * @brief Makes room in the memtable and copies the key into it from the SSTs.
+ * @return Returns 0 on success, -1 if the memtable could not be flushed.
+ */
+int lsm_prepare (struct table* node, const char* key) {
+	struct lsm_tree* tree = node->lsm;
+	struct lsm_row row;
+	char* values[MAX_COLUMNS_PER_TABLE];
+	int i;
+	if (node->numEntries + tree->numTombstones >= LSM_MEMTABLE_LIMIT && lsm_flush (node) != 0)
+		return -1;
+	if (lsm_in_memtable (node, key) || lsm_get (node, key, &row) != 0)
+		return 0;
+	for (i = 0; i < node->numCol; i++)
+		values[i] = row.value[i];
+	putEntry (node, key, values, row.transac_count);
+	return 0;
+}
+
+// Orders raw rows by key.
+static int lsm_row_cmp (const void* a, const void* b) {
+	return strncmp (*(char* const*)a, *(char* const*)b, MAX_KEY_LEN);
+}
+
+/**
+ * @brief Writes the memtable and the tombstones to a new level 0 SST and empties them.
+ * @return Returns 0 on success, -1 otherwise.
+ */
+int lsm_flush (struct table* node) {
+	struct lsm_tree* tree = node->lsm;
+	struct lsm_writer w;
+	struct lsm_sstable* sst;
+	struct lsm_level levels[LSM_MAX_LEVELS];
+	struct hashEntry* entry;
+	char* values[MAX_COLUMNS_PER_TABLE];
+	char empty[MAX_COLUMNS_PER_TABLE][MAX_STRTYPE_SIZE];
+	char buff[MAX_PATH_LEN + 50];
+	int width = tablefile_row_width (node);
+	int numRows = 0;
+	int i, j;
+	unsigned long seq;
+
+	if (node->numEntries + tree->numTombstones == 0)
+		return 0;
+	// Every log record of the table up to here is in the memtable.
+	seq = wal_last_seq ();
+
+	char* raw = calloc (node->numEntries + tree->numTombstones, width);
+	char** rows = malloc ((node->numEntries + tree->numTombstones) * sizeof(char*));
+	if (node->numEntries > 0) {
+		entry = node->entries[node->headIndex];
+		for (i = 0; i < node->numEntries; i++) {
+			for (j = 0; j < node->numCol; j++)
+				values[j] = entry->value[j];
+			rows[numRows] = raw + numRows * width;
+			tablefile_encode_row (node, rows[numRows], entry->key, entry->transac_count, values);
+			numRows += 1;
+			entry = entry->next;
+		}
+	}
+	memset (empty, 0, sizeof empty);
+	for (j = 0; j < node->numCol; j++)
+		values[j] = empty[j];
+	for (i = 0; i < LSM_TOMBSTONE_SLOTS; i++) {
+		if (tree->tombstones[i][0] == '\0' || lsm_in_memtable (node, tree->tombstones[i]))
+			continue;
+		rows[numRows] = raw + numRows * width;
+		tablefile_encode_row (node, rows[numRows], tree->tombstones[i], 0, values);
+		numRows += 1;
+	}
+	qsort (rows, numRows, sizeof(char*), lsm_row_cmp);
+
+	int status = lsm_writer_open (&w, node, numRows);
+	for (i = 0; status == 0 && i < numRows; i++)
+		status = lsm_writer_add (&w, rows[i]);
+	if (status == 0)
+		status = lsm_writer_finish (&w, &sst);
+	else
+		lsm_writer_abort (&w);
+	free (rows);
+	free (raw);
+	if (status != 0) {
+		sprintf (buff, "Flushing the memtable of %s failed.\n", node->name);
+		lsm_log (buff);
+		return -1;
+	}
+
+	// List the new SST before forgetting the memtable.
+	memcpy (levels, tree->levels, sizeof levels);
+	levels[0].files = malloc ((levels[0].numFiles + 1) * sizeof(struct lsm_sstable*));
+	memcpy (levels[0].files, tree->levels[0].files, levels[0].numFiles * sizeof(struct lsm_sstable*));
+	lsm_level_add (&levels[0], sst);
+	if (lsm_manifest_write (node, levels, seq) != 0) {
+		free (levels[0].files);
+		lsm_sstable_free (sst);
+		lsm_path (buff, tree, node, w.id);
+		unlink (buff);
+		return -1;
+	}
+	free (tree->levels[0].files);
+	tree->levels[0] = levels[0];
+	node->snapSeq = seq;
+
+	for (i = 0; i < MAX_RECORDS_PER_TABLE; i++) {
+		entry = node->entries[i];
+		entry->key[0] = '\0';
+		entry->deleted = -1;
+		entry->transac_count = 1;
+		entry->next = NULL;
+		entry->prev = NULL;
+		syncSlot (node, i);
+	}
+	node->numEntries = 0;
+	node->headIndex = -1;
+	keyindex_clear (node->keys);
+	memset (tree->tombstones, 0, LSM_TOMBSTONE_SLOTS * MAX_KEY_LEN);
+	tree->numTombstones = 0;
+
+	pthread_mutex_lock (&lsmWorkLock);
+	pthread_cond_signal (&lsmWork);
+	pthread_mutex_unlock (&lsmWorkLock);
+	return 0;
+}
+
+static void lsm_cursor_init (struct lsm_cursor* c, struct lsm_sstable** files, int numFiles, uint32_t rowWidth) {
+	c->files = malloc ((numFiles > 0 ? numFiles : 1) * sizeof(struct lsm_sstable*));
+	memcpy (c->files, files, numFiles * sizeof(struct lsm_sstable*));
+	c->numFiles = numFiles;
+	c->file = 0;
+	c->row = 0;
+	c->blockStart = 0;
+	c->blockRows = 0;
+	c->block = malloc (LSM_SCAN_ROWS * rowWidth);
+}
+
+// Returns the current row of the cursor, reading the next block if needed, or NULL at the end.
+static char* lsm_cursor_peek (struct lsm_cursor* c) {
+	struct lsm_sstable* sst;
+	uint32_t n;
+	while (c->file < c->numFiles) {
+		sst = c->files[c->file];
+		if (c->row >= sst->numRows) {
+			c->file += 1;
+			c->row = 0;
+			c->blockRows = 0;
+			continue;
+		}
+		if (c->row < c->blockStart || c->row >= c->blockStart + c->blockRows) {
+			n = sst->numRows - c->row < LSM_SCAN_ROWS ? sst->numRows - c->row : LSM_SCAN_ROWS;
+			if (pread (sst->fd, c->block, n * sst->rowWidth, sizeof(struct lsm_header) + (off_t)c->row * sst->rowWidth) != n * sst->rowWidth) {
+				lsm_log ("Reading an SST failed.\n");
+				c->file = c->numFiles;
+				return NULL;
+			}
+			c->blockStart = c->row;
+			c->blockRows = n;
+		}
+		return c->block + (c->row - c->blockStart) * sst->rowWidth;
+	}
+	return NULL;
+}
+
+/**
+ * @brief Returns the next row of the merge (the newest version of the smallest key), or NULL at the end.
+ */
+static char* lsm_merge_next (struct lsm_merge* m, char* row, uint32_t rowWidth) {
+	char* best = NULL;
+	char* cur;
+	int i;
+	for (i = 0; i < m->numCursors; i++) {
+		cur = lsm_cursor_peek (&m->cursors[i]);
+		// On equal keys the earlier (newer) run wins.
+		if (cur != NULL && (best == NULL || strncmp (cur, best, MAX_KEY_LEN) < 0))
+			best = cur;
+	}
+	if (best == NULL)
+		return NULL;
+	memcpy (row, best, rowWidth);
+	for (i = 0; i < m->numCursors; i++) {
+		cur = lsm_cursor_peek (&m->cursors[i]);
+		if (cur != NULL && strncmp (cur, row, MAX_KEY_LEN) == 0)
+			m->cursors[i].row += 1;
+	}
+	return row;
+}
+
+static void lsm_merge_free (struct lsm_merge* m) {
+	int i;
+	for (i = 0; i < m->numCursors; i++) {
+		free (m->cursors[i].files);
+		free (m->cursors[i].block);
+	}
+	free (m->cursors);
+}
+
+/**
+ * @brief Starts iterating over the entries only found in the SSTs.
+ */
+struct lsm_iter* lsm_iter_open (struct table* node) {
+	struct lsm_tree* tree = node->lsm;
+	struct lsm_iter* it = malloc (sizeof(struct lsm_iter));
+	uint32_t width = tablefile_row_width (node);
+	int l, i;
+	it->node = node;
+	it->merge.cursors = malloc ((tree->levels[0].numFiles + LSM_MAX_LEVELS) * sizeof(struct lsm_cursor));
+	it->merge.numCursors = 0;
+	// Newest first: level 0 from its last SST, then the deeper levels.
+	for (i = tree->levels[0].numFiles - 1; i >= 0; i--)
+		lsm_cursor_init (&it->merge.cursors[it->merge.numCursors++], &tree->levels[0].files[i], 1, width);
+	for (l = 1; l < LSM_MAX_LEVELS; l++) {
+		if (tree->levels[l].numFiles > 0)
+			lsm_cursor_init (&it->merge.cursors[it->merge.numCursors++], tree->levels[l].files, tree->levels[l].numFiles, width);
+	}
+	return it;
+}
+
+/**
+ * @brief Reads the next live entry that the hash table does not shadow.
+ * @return Returns 0 on success, -1 at the end.
+ */
+int lsm_iter_next (struct lsm_iter* it, struct lsm_row* row) {
+	char raw[LSM_MAX_ROW];
+	uint32_t width = tablefile_row_width (it->node);
+	while (lsm_merge_next (&it->merge, raw, width) != NULL) {
+		lsm_row_decode (it->node, raw, row);
+		if (row->transac_count == 0 || lsm_is_deleted (it->node->lsm, row->key) || lsm_in_memtable (it->node, row->key))
+			continue;
+		return 0;
+	}
+	return -1;
+}
+
+/**
+ * @brief Frees an iterator.
+ */
+void lsm_iter_close (struct lsm_iter* it) {
+	lsm_merge_free (&it->merge);
+	free (it);
+}
+
+/**
+ * @brief A compaction picked under the server lock and run without it.
+ */
+struct lsm_job {
+	struct table* node;
+	/// Level the inputs come from, and the level they are merged into.
+	int level;
+	int target;
+	/// Inputs from level, newest first.
+	struct lsm_sstable** inputs;
+	int numInputs;
+	/// Overlapping SSTs of target, in key order.
+	struct lsm_sstable** overlaps;
+	int numOverlaps;
+	/// Nothing is stored below target, so tombstones can be dropped.
+	int bottom;
+};
+
+static unsigned long lsm_level_limit (int level) {
+	unsigned long limit = LSM_LEVEL_BASE_ROWS;
+	while (level-- > 1)
+		limit *= 10;
+	return limit;
+}
+
+/**
+ * @brief Picks the next compaction of a table.  Called with the server lock held.
+ * @return Returns 0 if a job was picked, -1 if the table needs none.
+ */
+static int lsm_pick (struct table* node, struct lsm_job* job) {
+	struct lsm_tree* tree = node->lsm;
+	struct lsm_level* level;
+	struct lsm_level* target;
+	char minKey[MAX_KEY_LEN];
+	char maxKey[MAX_KEY_LEN];
+	int l, i;
+
+	memset (job, 0, sizeof *job);
+	job->node = node;
+	if (tree->levels[0].numFiles >= LSM_L0_TRIGGER)
+		job->level = 0;
+	else {
+		for (l = 1; l < LSM_MAX_LEVELS - 1; l++) {
+			if (tree->levels[l].numRows > lsm_level_limit (l))
+				break;
+		}
+		if (l == LSM_MAX_LEVELS - 1)
+			return -1;
+		job->level = l;
+	}
+	job->target = job->level + 1;
+	level = &tree->levels[job->level];
+	target = &tree->levels[job->target];
+
+	if (job->level == 0) {
+		job->numInputs = level->numFiles;
+		job->inputs = malloc (job->numInputs * sizeof(struct lsm_sstable*));
+		for (i = 0; i < level->numFiles; i++)
+			job->inputs[i] = level->files[level->numFiles - 1 - i];
+	}
+	else {
+		// Take the files of the level in turn, so every key range gets compacted.
+		if (level->cursor >= level->numFiles)
+			level->cursor = 0;
+		job->numInputs = 1;
+		job->inputs = malloc (sizeof(struct lsm_sstable*));
+		job->inputs[0] = level->files[level->cursor];
+		level->cursor += 1;
+	}
+	strcpy (minKey, job->inputs[0]->minKey);
+	strcpy (maxKey, job->inputs[0]->maxKey);
+	for (i = 1; i < job->numInputs; i++) {
+		if (strcmp (job->inputs[i]->minKey, minKey) < 0)
+			strcpy (minKey, job->inputs[i]->minKey);
+		if (strcmp (job->inputs[i]->maxKey, maxKey) > 0)
+			strcpy (maxKey, job->inputs[i]->maxKey);
+	}
+	job->overlaps = malloc ((target->numFiles > 0 ? target->numFiles : 1) * sizeof(struct lsm_sstable*));
+	for (i = 0; i < target->numFiles; i++) {
+		if (strcmp (target->files[i]->maxKey, minKey) >= 0 && strcmp (target->files[i]->minKey, maxKey) <= 0)
+			job->overlaps[job->numOverlaps++] = target->files[i];
+	}
+	job->bottom = 1;
+	for (l = job->target + 1; l < LSM_MAX_LEVELS; l++) {
+		if (tree->levels[l].numFiles > 0)
+			job->bottom = 0;
+	}
+	return 0;
+}
+
+// Returns 1 if the SST is one of the n in the list.
+static int lsm_listed (struct lsm_sstable* sst, struct lsm_sstable** list, int n) {
+	int i;
+	for (i = 0; i < n; i++) {
+		if (list[i] == sst)
+			return 1;
+	}
+	return 0;
+}
+
+// Orders SSTs of a level by key.
+static int lsm_sstable_cmp (const void* a, const void* b) {
+	return strcmp ((*(struct lsm_sstable* const*)a)->minKey, (*(struct lsm_sstable* const*)b)->minKey);
+}
+
+/**
+ * @brief Merges the inputs of a job into new SSTs and swaps them in.
+ * @return Returns 0 on success, -1 otherwise.
+ */
+static int lsm_run (struct lsm_job* job) {
+	struct table* node = job->node;
+	struct lsm_tree* tree = node->lsm;
+	struct lsm_merge merge;
+	struct lsm_writer w;
+	struct lsm_sstable* sst;
+	struct lsm_sstable** outputs = NULL;
+	struct lsm_level levels[LSM_MAX_LEVELS];
+	struct lsm_level* level;
+	char row[LSM_MAX_ROW];
+	char path[LSM_PATH_LEN];
+	char buff[MAX_PATH_LEN + 50];
+	uint32_t width = tablefile_row_width (node);
+	uint32_t version;
+	int numOutputs = 0;
+	int writing = 0;
+	int status = 0;
+	int i, l;
+
+	merge.cursors = malloc ((job->numInputs + 1) * sizeof(struct lsm_cursor));
+	merge.numCursors = 0;
+	if (job->level == 0) {
+		for (i = 0; i < job->numInputs; i++)
+			lsm_cursor_init (&merge.cursors[merge.numCursors++], &job->inputs[i], 1, width);
+	}
+	else
+		lsm_cursor_init (&merge.cursors[merge.numCursors++], job->inputs, job->numInputs, width);
+	lsm_cursor_init (&merge.cursors[merge.numCursors++], job->overlaps, job->numOverlaps, width);
+
+	while (status == 0 && lsm_merge_next (&merge, row, width) != NULL) {
+		memcpy (&version, row + MAX_KEY_LEN, sizeof version);
+		if (version == 0 && job->bottom)
+			continue;
+		if (!writing) {
+			status = lsm_writer_open (&w, node, LSM_FILE_ROWS);
+			if (status != 0)
+				break;
+			writing = 1;
+		}
+		status = lsm_writer_add (&w, row);
+		if (status == 0 && w.numRows == LSM_FILE_ROWS) {
+			writing = 0;
+			status = lsm_writer_finish (&w, &sst);
+			if (status == 0) {
+				outputs = realloc (outputs, (numOutputs + 1) * sizeof(struct lsm_sstable*));
+				outputs[numOutputs++] = sst;
+			}
+		}
+	}
+	if (writing && status == 0) {
+		status = lsm_writer_finish (&w, &sst);
+		if (status == 0 && sst != NULL) {
+			outputs = realloc (outputs, (numOutputs + 1) * sizeof(struct lsm_sstable*));
+			outputs[numOutputs++] = sst;
+		}
+	}
+	else if (writing)
+		lsm_writer_abort (&w);
+	lsm_merge_free (&merge);
+
+	pthread_mutex_lock (lsmServerLock);
+	if (status == 0) {
+		// Build the new levels, list them, and only then let go of the inputs.
+		memcpy (levels, tree->levels, sizeof levels);
+		for (l = job->level; l <= job->target; l++) {
+			level = &levels[l];
+			level->files = malloc ((tree->levels[l].numFiles + numOutputs + 1) * sizeof(struct lsm_sstable*));
+			level->numFiles = 0;
+			level->numRows = 0;
+			for (i = 0; i < tree->levels[l].numFiles; i++) {
+				sst = tree->levels[l].files[i];
+				if (!lsm_listed (sst, job->inputs, job->numInputs) && !lsm_listed (sst, job->overlaps, job->numOverlaps))
+					lsm_level_add (level, sst);
+			}
+		}
+		for (i = 0; i < numOutputs; i++)
+			lsm_level_add (&levels[job->target], outputs[i]);
+		qsort (levels[job->target].files, levels[job->target].numFiles, sizeof(struct lsm_sstable*), lsm_sstable_cmp);
+		status = lsm_manifest_write (node, levels, node->snapSeq);
+		if (status == 0) {
+			for (l = job->level; l <= job->target; l++) {
+				free (tree->levels[l].files);
+				tree->levels[l] = levels[l];
+			}
+			for (i = 0; i < job->numInputs + job->numOverlaps; i++) {
+				sst = i < job->numInputs ? job->inputs[i] : job->overlaps[i - job->numInputs];
+				lsm_path (path, tree, node, sst->id);
+				lsm_sstable_free (sst);
+				unlink (path);
+			}
+		}
+		else {
+			for (l = job->level; l <= job->target; l++)
+				free (levels[l].files);
+		}
+	}
+	pthread_mutex_unlock (lsmServerLock);
+
+	if (status != 0) {
+		for (i = 0; i < numOutputs; i++) {
+			lsm_path (path, tree, node, outputs[i]->id);
+			lsm_sstable_free (outputs[i]);
+			unlink (path);
+		}
+		sprintf (buff, "Compaction of level %d of %s failed.\n", job->level, node->name);
+		lsm_log (buff);
+	}
+	free (outputs);
+	free (job->inputs);
+	free (job->overlaps);
+	return status;
+}
+
+// Compacts the tables whenever a flush signals it, and at least every second.
+static void* lsm_compact_loop (void* ptr) {
+	struct table* node;
+	struct lsm_job job;
+	struct timeval now;
+	struct timespec deadline;
+	int worked, picked;
+	while (1) {
+		gettimeofday (&now, NULL);
+		deadline.tv_sec = now.tv_sec + 1;
+		deadline.tv_nsec = now.tv_usec * 1000;
+		pthread_mutex_lock (&lsmWorkLock);
+		pthread_cond_timedwait (&lsmWork, &lsmWorkLock, &deadline);
+		pthread_mutex_unlock (&lsmWorkLock);
+		do {
+			worked = 0;
+			for (node = lsmHead; node != NULL; node = node->next) {
+				if (node->lsm == NULL)
+					continue;
+				pthread_mutex_lock (lsmServerLock);
+				picked = lsm_pick (node, &job);
+				pthread_mutex_unlock (lsmServerLock);
+				if (picked == 0 && lsm_run (&job) == 0)
+					worked = 1;
+			}
+		} while (worked);
+	}
+	return NULL;
+}
+
+/**
+ * @brief Starts the background compaction thread.
+ * @return Returns 0 on success, -1 otherwise.
+ */
+int lsm_start (struct table* head, pthread_mutex_t* serverLock) {
+	pthread_t thread;
+	lsmHead = head;
+	lsmServerLock = serverLock;
+	if (pthread_create (&thread, NULL, lsm_compact_loop, NULL) != 0)
+		return -1;
+	pthread_detach (thread);
+	return 0;
+}
@@ -0,0 +1,188 @@
+/**
+ * @file
+ * @brief This file declares the LSM storage policy, which lets a table hold
+ * more entries than fit in its hash table.
+ *
+ * The table's hash table is the memtable: writes go to it (and to the
+ * write-ahead log, see wal.h) as under the on-disk policy.  When it is three
+ * quarters full it is written out as an immutable sorted string table (SST)
+ * "<table>-<id>.sst" in the data directory and emptied.  Deleting a key that
+ * may exist in an SST leaves a tombstone, a row with transaction count 0.
+ *
+ * SSTs are organised in levels.  Level 0 holds freshly flushed tables whose
+ * key ranges overlap; every deeper level is one sorted run split into files
+ * with disjoint key ranges, ten times larger than the level above it.  A
+ * background thread merges level 0 into level 1, and a file of an oversized
+ * level into the files of the next level it overlaps, keeping the newest
+ * version of each key and dropping tombstones once nothing older is left
+ * below them.
+ *
+ * Each SST keeps a Bloom filter and the first key of every
+ * LSM_INDEX_INTERVAL rows in memory, so a lookup reads at most one block of
+ * rows from each SST whose filter may contain the key.  The list of SSTs of
+ * a table is kept in its manifest "<table>.lsm", which is replaced atomically.
+ *
+ * Apart from the compaction thread, these functions are called with the
+ * server lock held (or before the server starts).
+ */
+
+#ifndef LSM_H
+#define LSM_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "utils.h"
+
+/**
+ * @brief Magic bytes at the start of an SST.
+ */
+#define LSM_MAGIC "SSSTv001"
+
+/**
+ * @brief The memtable is flushed once it holds this many entries and tombstones.
+ */
+#define LSM_MEMTABLE_LIMIT (MAX_RECORDS_PER_TABLE * 3 / 4)
+
+/**
+ * @brief Number of levels.
+ */
+#define LSM_MAX_LEVELS 7
+
+/**
+ * @brief Level 0 is merged into level 1 once it holds this many SSTs.
+ */
+#define LSM_L0_TRIGGER 4
+
+/**
+ * @brief Maximum number of rows of level 1.  Each deeper level holds ten times more.
+ */
+#define LSM_LEVEL_BASE_ROWS 8192
+
+/**
+ * @brief Maximum number of rows of an SST written by a compaction.
+ */
+#define LSM_FILE_ROWS 4096
+
+/**
+ * @brief Number of rows per block of the sparse index.
+ */
+#define LSM_INDEX_INTERVAL 16
+
+/**
+ * @brief Bloom filter bits per row and number of hash functions (about 1% false positives).
+ */
+#define LSM_BLOOM_BITS_PER_KEY 10
+#define LSM_BLOOM_HASHES 7
+
+/**
+ * @brief Header of an SST, followed by the rows sorted by key (in the table
+ * file row format, see tablefile.h), the Bloom filter and the sparse index.
+ */
+struct lsm_header {
+	/// LSM_MAGIC, without the terminating NUL.
+	char magic[8];
+	/// Number of columns.
+	uint32_t numCol;
+	/// Column types, as in struct table.
+	int32_t type[MAX_COLUMNS_PER_TABLE];
+	/// Size in bytes of every row.
+	uint32_t rowWidth;
+	/// Number of rows.
+	uint32_t numRows;
+	/// Size in bytes of the Bloom filter.
+	uint32_t bloomBytes;
+	/// Number of keys in the sparse index.
+	uint32_t numIndex;
+	/// CRC-32 of the header up to (not including) this field.
+	uint32_t headerCrc;
+};
+
+/**
+ * @brief An entry read from an SST.
+ */
+struct lsm_row {
+	char key[MAX_KEY_LEN];
+	int transac_count;
+	char value[MAX_COLUMNS_PER_TABLE][MAX_STRTYPE_SIZE];
+};
+
+/**
+ * @brief Iterator over the entries of a table that are only in its SSTs.
+ */
+struct lsm_iter;
+
+/**
+ * @brief Open the SSTs of a table listed in its manifest.
+ *
+ * @param node The table, with an empty hash table.
+ * @param dir The data directory (ending with '/').
+ * @return Return 0 on success, -1 otherwise.
+ *
+ * node->snapSeq is set to the sequence number of the last write-ahead log
+ * record contained in the SSTs.  SSTs left behind by an interrupted flush or
+ * compaction are removed.
+ */
+int lsm_open(struct table* node, const char* dir);
+
+/**
+ * @brief Close the SSTs of a table.
+ */
+void lsm_close(struct table* node);
+
+/**
+ * @brief Look a key up in the SSTs of a table (not in its hash table).
+ *
+ * @return Return 0 and fill row if the key exists, -1 otherwise.
+ */
+int lsm_get(struct table* node, const char* key, struct lsm_row* row);
+
+/**
+ * @brief Prepare the hash table of a table for a write to a key.
+ *
+ * Flushes the memtable if it is full, then copies the entry from the SSTs
+ * into the hash table if it is only there, so the write finds it.
+ * @return Return 0 on success, -1 if the memtable could not be flushed.
+ */
+int lsm_prepare(struct table* node, const char* key);
+
+/**
+ * @brief Record that a key was deleted from the hash table of a table, so
+ * older versions in the SSTs stay hidden.
+ */
+void lsm_deleted(struct table* node, const char* key);
+
+/**
+ * @brief Write the memtable of a table to a new level 0 SST and empty it.
+ *
+ * @return Return 0 on success, -1 otherwise.
+ */
+int lsm_flush(struct table* node);
+
+/**
+ * @brief Start iterating over the entries of a table that are in its SSTs
+ * but neither in its hash table nor deleted, in key order.
+ */
+struct lsm_iter* lsm_iter_open(struct table* node);
+
+/**
+ * @brief Read the next entry.
+ *
+ * @return Return 0 and fill row, or -1 at the end.
+ */
+int lsm_iter_next(struct lsm_iter* it, struct lsm_row* row);
+
+/**
+ * @brief Free an iterator.
+ */
+void lsm_iter_close(struct lsm_iter* it);
+
+/**
+ * @brief Start the background compaction thread.
+ *
+ * @param head The first table of the server.
+ * @param serverLock The server lock, held while the SSTs of a table are replaced.
+ * @return Return 0 on success, -1 otherwise.
+ */
+int lsm_start(struct table* head, pthread_mutex_t* serverLock);
+
+#endif
@@ -0,0 +1,260 @@
+/**
+ * @file
+ * @brief This file implements the mmap storage policy declared in
+ * mmaptable.h.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "mmaptable.h"
+#include "keyindex.h"
+#include "colstats.h"
+#include "slab.h"
+#include "file.h"
+
+/// Flush policy of all mapped tables.
+static int flushMode = FLUSH_NONE;
+
+/// Milliseconds between flushes for FLUSH_INTERVAL.
+static int flushInterval = 0;
+
+/// Tables flushed by the background thread.
+static struct table* flushHead;
+
+// Returns the entry array of a mapped table.
+static struct hashEntry* mmaptable_slots (struct table* node) {
+	return (struct hashEntry*)((char*)node->map + sizeof(struct mmaptable_header));
+}
+
+// Returns the row array of a mapped table, which follows the entries.
+static char (*mmaptable_rows (struct table* node))[MAX_COLUMNS_PER_TABLE][MAX_STRTYPE_SIZE] {
+	return (void*)(mmaptable_slots (node) + MAX_RECORDS_PER_TABLE);
+}
+
+// Relocates a list pointer written while the entries were mapped at oldBase.
+// Returns NULL if it does not point at an entry.
+static struct hashEntry* mmaptable_relocate (struct table* node, struct hashEntry* ptr, uint64_t oldBase) {
+	uint64_t offset = (uint64_t)(uintptr_t)ptr - oldBase;
+	if ((uint64_t)(uintptr_t)ptr < oldBase || offset % sizeof(struct hashEntry) != 0
+			|| offset / sizeof(struct hashEntry) >= MAX_RECORDS_PER_TABLE)
+		return NULL;
+	return mmaptable_slots (node) + offset / sizeof(struct hashEntry);
+}
+
+// Rebuilds the table's entry list from the mapped entries.  The list is kept in its
+// saved order when it is intact, otherwise it is rebuilt in slot order.
+static void mmaptable_relink (struct table* node) {
+	struct mmaptable_header* header = node->map;
+	struct hashEntry* slots = mmaptable_slots (node);
+	char (*rows)[MAX_COLUMNS_PER_TABLE][MAX_STRTYPE_SIZE] = mmaptable_rows (node);
+	int used = 0;
+	int intact = 1;
+	int i;
+
+	for (i = 0; i < MAX_RECORDS_PER_TABLE; i++) {
+		node->entries[i] = &slots[i];
+		slots[i].value = rows[i];
+		syncSlot (node, i);
+		if (slots[i].deleted != -1) {
+			used += 1;
+			slots[i].next = mmaptable_relocate (node, slots[i].next, header->base);
+			slots[i].prev = mmaptable_relocate (node, slots[i].prev, header->base);
+			if (slots[i].next == NULL || slots[i].prev == NULL)
+				intact = 0;
+		}
+	}
+	// Follow the saved list from its head; it must visit every used entry once.
+	if (intact && used > 0) {
+		if (header->headIndex < 0 || header->headIndex >= MAX_RECORDS_PER_TABLE
+				|| slots[header->headIndex].deleted == -1)
+			intact = 0;
+		else {
+			struct hashEntry* entry = &slots[header->headIndex];
+			for (i = 0; i < used && intact; i++) {
+				if (entry->deleted == -1 || entry->next->prev != entry)
+					intact = 0;
+				entry = entry->next;
+			}
+			if (entry != &slots[header->headIndex])
+				intact = 0;
+		}
+	}
+	node->numEntries = used;
+	node->headIndex = used > 0 ? header->headIndex : -1;
+	if (!intact) {
+		node->headIndex = -1;
+		for (i = 0; i < MAX_RECORDS_PER_TABLE; i++) {
+			if (slots[i].deleted == -1)
+				continue;
+			slots[i].index = i;
+			if (node->headIndex == -1) {
+				insertEntry (&slots[i], NULL);
+				node->headIndex = i;
+			}
+			else
+				insertEntry (&slots[i], &slots[node->headIndex]);
+		}
+	}
+	header->headIndex = node->headIndex;
+	header->base = (uint64_t)(uintptr_t)slots;
+	// The key index points at the slots of the mapping, and the column statistics are rebuilt on next use.
+	colstats_invalidate (node);
+	keyindex_clear (node->keys);
+	for (i = 0; i < MAX_RECORDS_PER_TABLE; i++) {
+		if (slots[i].deleted != -1)
+			keyindex_insert (node->keys, &slots[i]);
+	}
+}
+
+/**
+ * @brief Maps the file of a table and points the table's entries into it.
+ * @return Returns 0 on success, -1 otherwise.
+ */
+int mmaptable_open (struct table* node, const char* dir) {
+	char path[MAX_PATH_LEN];
+	struct stat info;
+	struct mmaptable_header* header;
+	size_t size = sizeof(struct mmaptable_header)
+			+ (size_t)MAX_RECORDS_PER_TABLE * (sizeof(struct hashEntry) + MAX_COLUMNS_PER_TABLE * MAX_STRTYPE_SIZE);
+	int i;
+
+	snprintf (path, sizeof path, "%s%s.map", dir, node->name);
+	int fd = open (path, O_RDWR | O_CREAT, 0666);
+	if (fd < 0 || fstat (fd, &info) != 0)
+		return -1;
+	int created = info.st_size == 0;
+	if ((created && ftruncate (fd, size) != 0) || (!created && info.st_size != size)) {
+		close (fd);
+		return -1;
+	}
+	void* map = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close (fd);
+	if (map == MAP_FAILED)
+		return -1;
+	header = map;
+	if (created) {
+		struct hashEntry* slots = (struct hashEntry*)((char*)map + sizeof(struct mmaptable_header));
+		memcpy (header->magic, MMAPTABLE_MAGIC, 8);
+		header->entrySize = sizeof(struct hashEntry);
+		header->numSlots = MAX_RECORDS_PER_TABLE;
+		header->numCol = node->numCol;
+		for (i = 0; i < node->numCol; i++)
+			header->type[i] = node->type[i];
+		header->headIndex = -1;
+		for (i = 0; i < MAX_RECORDS_PER_TABLE; i++) {
+			slots[i].key[0] = '\0';
+			slots[i].transac_count = 1;
+			slots[i].deleted = -1;
+			slots[i].next = NULL;
+			slots[i].prev = NULL;
+		}
+	}
+	// The file must have been written by this build with the same schema.
+	int valid = memcmp (header->magic, MMAPTABLE_MAGIC, 8) == 0 && header->entrySize == sizeof(struct hashEntry)
+			&& header->numSlots == MAX_RECORDS_PER_TABLE && header->numCol == node->numCol;
+	for (i = 0; valid && i < node->numCol; i++) {
+		if (header->type[i] != node->type[i])
+			valid = 0;
+	}
+	if (!valid) {
+		munmap (map, size);
+		return -1;
+	}
+
+	slab_clear (node->entrySlab);
+	slab_clear (node->rowSlab);
+	node->map = map;
+	node->mapSize = size;
+	mmaptable_relink (node);
+	return 0;
+}
+
+/**
+ * @brief Records that an entry of a mapped table was changed.
+ */
+void mmaptable_written (struct table* node, struct hashEntry* entry) {
+	struct mmaptable_header* header = node->map;
+	if (header == NULL)
+		return;
+	header->headIndex = node->headIndex;
+	if (flushMode == FLUSH_SYNC) {
+		long page = sysconf (_SC_PAGESIZE);
+		// Sync the pages holding the header, the entry and its row.
+		msync (node->map, page, MS_SYNC);
+		uintptr_t start = (uintptr_t)entry & ~(uintptr_t)(page - 1);
+		uintptr_t end = (uintptr_t)entry + sizeof(struct hashEntry);
+		msync ((void*)start, end - start, MS_SYNC);
+		start = (uintptr_t)entry->value & ~(uintptr_t)(page - 1);
+		end = (uintptr_t)entry->value + MAX_COLUMNS_PER_TABLE * MAX_STRTYPE_SIZE;
+		msync ((void*)start, end - start, MS_SYNC);
+	}
+}
+
+// Flushes every mapped table each flushInterval milliseconds.
+static void* mmaptable_flush_loop (void* ptr) {
+	struct table* node;
+	while (1) {
+		usleep (flushInterval * 1000);
+		for (node = flushHead; node != NULL; node = node->next) {
+			if (node->map != NULL)
+				msync (node->map, node->mapSize, MS_SYNC);
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief Sets the flush policy of all mapped tables.
+ * @return Returns 0 on success, -1 otherwise.
+ */
+int mmaptable_set_flush (int mode, int interval, struct table* head) {
+	pthread_t thread;
+	flushMode = mode;
+	flushInterval = interval;
+	flushHead = head;
+	if (mode != FLUSH_INTERVAL)
+		return 0;
+	if (pthread_create (&thread, NULL, mmaptable_flush_loop, NULL) != 0)
+		return -1;
+	pthread_detach (thread);
+	return 0;
+}
+
+/**
+ * @brief Copies the mapping of a table into private memory.
+ * @return Returns the copy, or NULL if the table is not mapped or memory runs out.
+ */
+void* mmaptable_copy (struct table* node) {
+	void* copy;
+	if (node->map == NULL)
+		return NULL;
+	copy = malloc (node->mapSize);
+	if (copy != NULL)
+		memcpy (copy, node->map, node->mapSize);
+	return copy;
+}
+
+/**
+ * @brief Points the entries of a table at a copy made by mmaptable_copy(), in place of its mapping.
+ */
+void mmaptable_use_copy (struct table* node, void* copy) {
+	node->map = copy;
+	mmaptable_relink (node);
+}
+
+/**
+ * @brief Writes a mapped table to disk and unmaps it.
+ */
+void mmaptable_close (struct table* node) {
+	if (node->map == NULL)
+		return;
+	msync (node->map, node->mapSize, MS_SYNC);
+	munmap (node->map, node->mapSize);
+	node->map = NULL;
+}
@@ -0,0 +1,98 @@
+/**
+ * @file
+ * @brief This file declares the mmap storage policy.
+ *
+ * Each table's hash table (the array of MAX_RECORDS_PER_TABLE entries followed
+ * by their rows) lives in a file "<table>.map" in the data directory that is
+ * mapped into memory with MAP_SHARED.  Reads and writes go straight to the
+ * mapping and the kernel page cache acts as the buffer pool.  On restart the
+ * file is mapped again and only the entry list pointers are relocated, so
+ * no row is parsed or copied; the row pointers of the entries are set from
+ * their slot.
+ *
+ * When the mapping reaches the disk is set by the flush policy (see
+ * parse_flush_policy() in utils.h).
+ */
+
+#ifndef MMAPTABLE_H
+#define MMAPTABLE_H
+
+#include <stdint.h>
+#include "utils.h"
+
+/**
+ * @brief Magic bytes at the start of a mapped table file.
+ */
+#define MMAPTABLE_MAGIC "SMAPv002"
+
+/**
+ * @brief Header at the start of a mapped table file, followed by the entries
+ * and then by one row of MAX_COLUMNS_PER_TABLE strings per entry.
+ */
+struct mmaptable_header {
+	/// MMAPTABLE_MAGIC, without the terminating NUL.
+	char magic[8];
+	/// Size of struct hashEntry when the file was created.
+	uint32_t entrySize;
+	/// Number of entries in the file.
+	uint32_t numSlots;
+	/// Number of columns.
+	uint32_t numCol;
+	/// Column types, as in struct table.
+	int32_t type[MAX_COLUMNS_PER_TABLE];
+	/// Index of the head of the entry list, or -1.
+	int32_t headIndex;
+	/// Address the entries were mapped at when the list pointers were written.
+	uint64_t base;
+};
+
+/**
+ * @brief Map (creating it if needed) the file of a table and point the
+ * table's entries into it.
+ *
+ * @param node A table created by newTable().  Its heap entries are freed.
+ * @param dir The data directory (ending with '/').
+ * @return Return 0 on success, -1 otherwise.
+ */
+int mmaptable_open(struct table* node, const char* dir);
+
+/**
+ * @brief Record that an entry of a mapped table was changed.
+ *
+ * Updates the file header and, with the "sync" flush policy, writes the
+ * entry's pages to disk before returning.
+ */
+void mmaptable_written(struct table* node, struct hashEntry* entry);
+
+/**
+ * @brief Set the flush policy of all mapped tables.
+ *
+ * @param mode One of FLUSH_NONE, FLUSH_INTERVAL or FLUSH_SYNC.
+ * @param interval Milliseconds between flushes for FLUSH_INTERVAL.
+ * @param head The first table, flushed by a background thread for FLUSH_INTERVAL.
+ * @return Return 0 on success, -1 otherwise.
+ */
+int mmaptable_set_flush(int mode, int interval, struct table* head);
+
+/**
+ * @brief Copy the mapping of a table into private memory.
+ *
+ * Mapped pages are shared with a forked child rather than copied on write,
+ * so a child that must see the table as it was at fork time reads this copy
+ * (see mmaptable_use_copy()).
+ * @return Return the copy (to be freed with free()), or NULL on error.
+ */
+void* mmaptable_copy(struct table* node);
+
+/**
+ * @brief Point the entries of a table at a copy made by mmaptable_copy()
+ * instead of its mapping.  The file is no longer written.
+ */
+void mmaptable_use_copy(struct table* node, void* copy);
+
+/**
+ * @brief Write a mapped table to disk and unmap it.
+ */
+void mmaptable_close(struct table* node);
+
+#endif
@@ -0,0 +1,530 @@
+/**
+ * @file
+ * @brief This file implements the compiled predicates and prepared query
+ * cache declared in pred.h.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "pred.h"
+#include "colstats.h"
+#include "dict.h"
+
+// Returns 1 if a string is empty or only holds spaces (which trim() cannot handle).
+static int pred_blank (const char* str) {
+	return str[strspn (str, " ")] == '\0';
+}
+
+// Finds word in text as a whole word (between spaces or at the ends), or returns NULL.
+static char* pred_find_word (char* text, const char* word) {
+	size_t len = strlen (word);
+	char* found = strstr (text, word);
+	while (found != NULL) {
+		if ((found == text || found[-1] == ' ') && (found[len] == ' ' || found[len] == '\0'))
+			return found;
+		found = strstr (found + 1, word);
+	}
+	return NULL;
+}
+
+// Parses "ORDER BY col [ASC|DESC]" and "LIMIT k" at the end of the predicates, and cuts
+// them off.  Sets *orderName (or leaves it empty).  Returns 0, or -2 if they are invalid.
+static int pred_parse_order (char* text, char* orderName, struct pred_plan* plan) {
+	char* order = pred_find_word (text, "ORDER");
+	char* limit = pred_find_word (order != NULL ? order : text, "LIMIT");
+	char dir[10];
+	int offset = 0;
+	int end = 0;
+
+	orderName[0] = '\0';
+	plan->orderCol = -1;
+	plan->orderDesc = 0;
+	plan->limit = 0;
+	if (limit != NULL) {
+		if (sscanf (limit, "LIMIT %d %n", &plan->limit, &offset) != 1 || limit[offset] != '\0' || plan->limit <= 0)
+			return -2;
+		limit[0] = '\0';
+	}
+	if (order != NULL) {
+		if (sscanf (order, "ORDER BY %19s %n", orderName, &offset) != 1)
+			return -2;
+		if (order[offset] != '\0') {
+			if (sscanf (order + offset, "%9s %n", dir, &end) != 1 || order[offset + end] != '\0')
+				return -2;
+			if (strcmp (dir, "DESC") == 0)
+				plan->orderDesc = 1;
+			else if (strcmp (dir, "ASC") != 0)
+				return -2;
+		}
+		order[0] = '\0';
+	}
+	return 0;
+}
+
+// Adds a constant to a predicate, converted to the type of its column.  Returns 0, -3 if
+// an int column is compared with a word that is not a number, or -2 if it is invalid.
+static int pred_add_value (struct pred_plan* plan, struct pred_term* term, char* value) {
+	if (pred_blank (value))
+		return -2;
+	value = trim (value);
+	if (strlen (value) > MAX_STRTYPE_SIZE - 1 || plan->numValues == PRED_MAX_VALUES)
+		return -2;
+	if (term->isInt && my_strvalidate (value, 2) == 1)
+		return my_strvalidate (value, 4) == 1 ? -2 : -3;
+	if (!term->isInt && my_strvalidate (value, 4) == 1)
+		return -2;
+	plan->ivalues[plan->numValues] = term->isInt ? atol (value) : 0;
+	strcpy (plan->svalues[plan->numValues], value);
+	plan->numValues += 1;
+	term->numValues += 1;
+	return 0;
+}
+
+// Has an equality predicate on a dictionary encoded column compare codes.
+static void pred_encode (struct pred_plan* plan, struct pred_term* term) {
+	int k;
+	term->encoded = 0;
+	if (term->isInt || (term->op != PRED_EQ && term->op != PRED_NE && term->op != PRED_IN))
+		return;
+	term->encoded = dict_encoded (plan->node, term->col);
+	if (!term->encoded)
+		return;
+	for (k = term->first; k < term->first + term->numValues; k++)
+		plan->codes[k] = dict_code (plan->node, term->col, plan->svalues[k]);
+}
+
+// Compiles one predicate ("column op value", "column BETWEEN low AND high" or
+// "column IN (value, ...)") against the plan's table.  Returns 0 or -2.
+static int pred_compile_term (struct pred_plan* plan, char* arg, struct pred_term* term) {
+	static const char* symbols[] = { "<=", ">=", "!=", "<", ">", "=" };
+	static const int ops[] = { PRED_LE, PRED_GE, PRED_NE, PRED_LT, PRED_GT, PRED_EQ };
+	struct table* node = plan->node;
+	char name[MAX_COLNAME_LEN];
+	char* rest;
+	char* high;
+	int len = 0;
+	int status, i;
+
+	arg += strspn (arg, " ");
+	if (sscanf (arg, "%19[^ <=>!]%n", name, &len) != 1)
+		return -2;
+	for (term->col = 0; term->col < node->numCol; term->col++) {
+		if (strcmp (name, node->col[term->col]) == 0)
+			break;
+	}
+	if (term->col == node->numCol)
+		return -2;	// Wrong column format.
+	term->encoded = 0;
+	term->isInt = node->type[term->col] == -1;
+	term->first = plan->numValues;
+	term->numValues = 0;
+	rest = arg + len;
+	rest += strspn (rest, " ");
+
+	if (strncmp (rest, "BETWEEN ", 8) == 0) {
+		term->op = PRED_BETWEEN;
+		high = pred_find_word (rest + 8, "AND");
+		if (high == NULL)
+			return -2;
+		high[0] = '\0';
+		if (pred_add_value (plan, term, rest + 8) != 0 || pred_add_value (plan, term, high + 3) != 0)
+			return -2;
+		return 0;
+	}
+	if (strncmp (rest, "IN", 2) == 0 && (rest[2] == ' ' || rest[2] == '(')) {
+		term->op = PRED_IN;
+		if (pred_blank (rest + 2))
+			return -2;
+		rest = trim (rest + 2);
+		len = strlen (rest);
+		if (rest[0] != '(' || rest[len - 1] != ')')
+			return -2;
+		rest[len - 1] = '\0';
+		for (arg = strtok_r (rest + 1, ",", &high); arg != NULL; arg = strtok_r (NULL, ",", &high)) {
+			if (pred_add_value (plan, term, arg) != 0)
+				return -2;
+		}
+		return term->numValues > 0 ? 0 : -2;
+	}
+	for (i = 0; i < 6; i++) {
+		if (strncmp (rest, symbols[i], strlen (symbols[i])) == 0)
+			break;
+	}
+	if (i == 6)
+		return -2;	// Not an acceptable operator.
+	term->op = ops[i];
+	status = pred_add_value (plan, term, rest + strlen (symbols[i]));
+	// An int column never equals a word.
+	if (status == -3 && term->op == PRED_EQ) {
+		term->op = PRED_NEVER;
+		return 0;
+	}
+	return status == 0 ? 0 : -2;
+}
+
+// Returns the cost of testing a row against a predicate, in string compares.
+static int pred_term_cost (const struct pred_term* term) {
+	int cost = term->isInt || term->encoded ? 1 : 2;
+	return cost * (term->numValues > 0 ? term->numValues : 1);
+}
+
+// Sorts the groups by cost divided by the share of the rows they reject.  Groups that
+// were rarely tested count as rejecting about half the rows.
+static void pred_reorder (const struct pred_plan* plan, struct pred_stats* stats) {
+	double rank[PRED_MAX_GROUPS];
+	int i, j, g;
+	for (g = 0; g < plan->numGroups; g++) {
+		rank[g] = plan->groups[g].cost * (stats->tested[g] + 2.0) / (stats->rejected[g] + 1.0);
+		// Halve old counts so the order follows changes in the data.
+		if (stats->tested[g] > 64 * PRED_REORDER_ROWS) {
+			stats->tested[g] /= 2;
+			stats->rejected[g] /= 2;
+		}
+	}
+	for (i = 1; i < plan->numGroups; i++) {
+		g = stats->order[i];
+		for (j = i; j > 0 && rank[stats->order[j - 1]] > rank[g]; j--)
+			stats->order[j] = stats->order[j - 1];
+		stats->order[j] = g;
+	}
+}
+
+// Returns 1 if constant k of a predicate is within the smallest and largest value of its column.
+static int pred_in_range (const struct pred_plan* plan, const struct colstats* stats, const struct pred_term* term, int k) {
+	const struct colstats_column* col = &stats->cols[term->col];
+	if (!col->hasRange)
+		return 0;
+	if (term->isInt)
+		return plan->ivalues[k] >= col->min && plan->ivalues[k] <= col->max;
+	return strcmp (plan->svalues[k], col->smin) >= 0 && strcmp (plan->svalues[k], col->smax) <= 0;
+}
+
+// Estimates the share of rows that meet a predicate from the column statistics.
+static double pred_term_pass (const struct pred_plan* plan, const struct colstats* stats, const struct pred_term* term) {
+	double distinct = colstats_distinct (stats, term->col);
+	double equal = distinct >= 1 ? 1 / distinct : 1;
+	double below, above;
+	long low = plan->ivalues[term->first];
+	long high = plan->ivalues[term->first + (term->numValues > 1)];
+	int inRange = 0;
+	int k;
+
+	switch (term->op) {
+	case PRED_NEVER:
+		return 0;
+	case PRED_EQ:
+		return pred_in_range (plan, stats, term, term->first) ? equal : 0;
+	case PRED_NE:
+		return pred_in_range (plan, stats, term, term->first) ? 1 - equal : 1;
+	case PRED_IN:
+		for (k = term->first; k < term->first + term->numValues; k++)
+			inRange += pred_in_range (plan, stats, term, k);
+		return inRange * equal < 1 ? inRange * equal : 1;
+	}
+	// Ranges of int columns are read from the histogram; other ranges keep a third of the rows.
+	below = term->isInt ? colstats_below (stats, term->col, term->op == PRED_LE || term->op == PRED_GT ? low + 1 : low) : -1;
+	if (below < 0)
+		return term->op == PRED_BETWEEN ? 0.25 : 1.0 / 3;
+	switch (term->op) {
+	case PRED_LT:
+	case PRED_LE:
+		return below;
+	case PRED_BETWEEN:
+		above = colstats_below (stats, term->col, high + 1);
+		return above > below ? above - below : 0;
+	}
+	return 1 - below;
+}
+
+/**
+ * @brief Estimates the share of rows that meet a group of a plan from the column statistics.
+ * @return Returns the share, from 0 to 1.
+ */
+double pred_group_pass (const struct pred_plan* plan, const struct colstats* stats, int g) {
+	const struct pred_group* group = &plan->groups[g];
+	double pass = 0;
+	int t;
+	// A row meets the group unless it fails each of its predicates.
+	for (t = group->first; t < group->first + group->numTerms; t++)
+		pass += (1 - pass) * pred_term_pass (plan, stats, &plan->terms[t]);
+	return pass;
+}
+
+// Splits text at the commas that are not within parentheses.  Returns the number of
+// parts, or -1 if one is blank or there are more than max.
+static int pred_split_list (char* text, char** parts, int max) {
+	int depth = 0;
+	int num = 0;
+	int last = 0;
+	char* start = text;
+	for (; !last; text++) {
+		if (*text == '(')
+			depth += 1;
+		else if (*text == ')')
+			depth -= 1;
+		else if ((*text == ',' && depth == 0) || *text == '\0') {
+			last = *text == '\0';
+			*text = '\0';
+			if (num == max || pred_blank (start))
+				return -1;
+			parts[num] = start;
+			num += 1;
+			start = text + 1;
+		}
+	}
+	return num;
+}
+
+/**
+ * @brief Parses predicates into a plan with resolved columns and typed constants.
+ * @return Returns 0 on success, -1 if the table does not exist, -2 if the predicates are invalid.
+ */
+int pred_compile (struct table* head, const char* tableName, const char* predicates, struct pred_plan* plan) {
+	char text[MAX_CMD_LEN];
+	char orderName[MAX_COLNAME_LEN];
+	char* groups[PRED_MAX_GROUPS];
+	struct pred_group* group;
+	struct colstats* stats;
+	double pass;
+	char* arg;
+	char* next;
+	int numGroups = 0;
+	int i;
+
+	if (strlen (predicates) > MAX_CMD_LEN - 1 || pred_blank (predicates))
+		return -2;
+	strcpy (text, predicates);
+	if (pred_parse_order (text, orderName, plan) != 0)
+		return -2;
+	// Only ORDER BY or LIMIT: every row.
+	if (pred_blank (text))
+		strcpy (text, "LOAD_ALL");
+	arg = trim (text);
+	if (strcmp (arg, "LOAD_ALL") != 0) {
+		numGroups = pred_split_list (arg, groups, PRED_MAX_GROUPS);
+		if (numGroups < 0)
+			return -2;
+	}
+
+	plan->node = head;
+	while (plan->node != NULL && strcmp (plan->node->name, tableName) != 0)
+		plan->node = plan->node->next;
+	if (plan->node == NULL)
+		return -1;	// Table not found.
+	plan->numGroups = numGroups;
+	plan->numTerms = 0;
+	plan->numValues = 0;
+	for (i = 0; i < numGroups; i++) {
+		group = &plan->groups[i];
+		group->first = plan->numTerms;
+		group->numTerms = 0;
+		group->cost = 0;
+		// Predicates joined by OR.
+		for (arg = groups[i]; arg != NULL; arg = next) {
+			next = pred_find_word (arg, "OR");
+			if (next != NULL) {
+				next[0] = '\0';
+				next += 2;
+			}
+			if (plan->numTerms == PRED_MAX_TERMS || pred_compile_term (plan, arg, &plan->terms[plan->numTerms]) != 0)
+				return -2;
+			pred_encode (plan, &plan->terms[plan->numTerms]);
+			group->cost += pred_term_cost (&plan->terms[plan->numTerms]);
+			group->numTerms += 1;
+			plan->numTerms += 1;
+		}
+	}
+	// Cheap groups that the column statistics expect to reject many rows go first, until
+	// the rows tell which ones really do.
+	memset (&plan->stats, 0, sizeof plan->stats);
+	stats = numGroups > 1 ? colstats_get (plan->node) : NULL;
+	for (i = 0; i < numGroups; i++) {
+		plan->stats.order[i] = i;
+		if (stats == NULL || stats->numRows == 0)
+			continue;
+		pass = pred_group_pass (plan, stats, i);
+		plan->stats.tested[i] = PRED_REORDER_ROWS;
+		plan->stats.rejected[i] = (1 - pass) * PRED_REORDER_ROWS + 0.5;
+	}
+	pred_reorder (plan, &plan->stats);
+	if (orderName[0] != '\0') {
+		for (plan->orderCol = 0; plan->orderCol < plan->node->numCol; plan->orderCol++) {
+			if (strcmp (orderName, plan->node->col[plan->orderCol]) == 0)
+				break;
+		}
+		if (plan->orderCol == plan->node->numCol)
+			return -2;	// Wrong column format.
+	}
+	return 0;
+}
+
+// Compares a value with constant k of a predicate.
+static int pred_compare (const struct pred_plan* plan, const struct pred_term* term, const char* value, int k) {
+	long v;
+	if (!term->isInt)
+		return strcmp (value, plan->svalues[k]);
+	v = atol (value);
+	return v < plan->ivalues[k] ? -1 : v > plan->ivalues[k];
+}
+
+// Returns 1 if a value equals constant k of a predicate, comparing codes when the value
+// and the constant both have one.  Only the rows in slots keep a code.
+static int pred_equal (const struct pred_plan* plan, const struct pred_term* term, const char* value, int slot, int k) {
+	int code;
+	if (term->encoded && slot >= 0 && plan->codes[k] >= 0 && (code = DICT_CODE (value)) != DICT_NONE)
+		return code == plan->codes[k];
+	return pred_compare (plan, term, value, k) == 0;
+}
+
+// Returns 1 if a value meets a predicate, 0 otherwise.
+static int pred_test (const struct pred_plan* plan, const struct pred_term* term, const char* value, int slot) {
+	int c, k;
+	if (term->op == PRED_NEVER)
+		return 0;
+	if (term->op == PRED_IN) {
+		for (k = term->first; k < term->first + term->numValues; k++) {
+			if (pred_equal (plan, term, value, slot, k))
+				return 1;
+		}
+		return 0;
+	}
+	if (term->op == PRED_EQ)
+		return pred_equal (plan, term, value, slot, term->first);
+	if (term->op == PRED_NE)
+		return !pred_equal (plan, term, value, slot, term->first);
+	c = pred_compare (plan, term, value, term->first);
+	switch (term->op) {
+	case PRED_LT:
+		return c < 0;
+	case PRED_LE:
+		return c <= 0;
+	case PRED_GE:
+		return c >= 0;
+	case PRED_GT:
+		return c > 0;
+	case PRED_BETWEEN:
+		return c >= 0 && pred_compare (plan, term, value, term->first + 1) <= 0;
+	}
+	return 0;
+}
+
+/**
+ * @brief Checks a value against one predicate of a plan.
+ * @return Returns 1 if the value meets it, 0 otherwise.
+ */
+int pred_term_match (const struct pred_plan* plan, int term, const char* value) {
+	return pred_test (plan, &plan->terms[term], value, -1);
+}
+
+/**
+ * @brief Checks a row against every group of a plan, in the order kept by stats.
+ * @return Returns 1 if the row matches, 0 otherwise.
+ */
+int pred_match (const struct pred_plan* plan, struct pred_stats* stats, char (*values)[MAX_STRTYPE_SIZE], int slot) {
+	const struct pred_group* group;
+	const struct pred_term* term;
+	int pass = 1;
+	int i, g, t;
+	for (i = 0; i < plan->numGroups && pass; i++) {
+		g = stats != NULL ? stats->order[i] : i;
+		group = &plan->groups[g];
+		pass = 0;
+		for (t = group->first; t < group->first + group->numTerms && !pass; t++) {
+			term = &plan->terms[t];
+			pass = pred_test (plan, term, values[term->col], slot);
+		}
+		if (stats != NULL) {
+			stats->tested[g] += 1;
+			stats->rejected[g] += !pass;
+		}
+	}
+	if (stats != NULL && plan->numGroups > 1) {
+		stats->numRows += 1;
+		if (stats->numRows % PRED_REORDER_ROWS == 0)
+			pred_reorder (plan, stats);
+	}
+	return pass;
+}
+
+/**
+ * @brief Creates an empty prepared query cache.
+ */
+struct pred_cache* pred_cache_new () {
+	struct pred_cache* cache = calloc (1, sizeof(struct pred_cache));
+	if (cache != NULL)
+		cache->nextHandle = 1;
+	return cache;
+}
+
+/**
+ * @brief Frees a prepared query cache.
+ */
+void pred_cache_free (struct pred_cache* cache) {
+	int i;
+	if (cache == NULL)
+		return;
+	for (i = 0; i < PRED_CACHE_SIZE; i++)
+		free (cache->slots[i].predicates);
+	free (cache);
+}
+
+/**
+ * @brief Compiles a query into the cache, or finds it there.
+ * @return Returns the handle of the query, or the error of pred_compile().
+ */
+int pred_prepare (struct pred_cache* cache, struct table* head, const char* tableName, const char* predicates) {
+	struct pred_plan plan;
+	struct pred_slot* slot;
+	int status, i;
+
+	cache->clock += 1;
+	for (i = 0; i < PRED_CACHE_SIZE; i++) {
+		slot = &cache->slots[i];
+		if (slot->handle != 0 && strcmp (slot->table, tableName) == 0 && strcmp (slot->predicates, predicates) == 0) {
+			slot->lastUse = cache->clock;
+			return slot->handle;
+		}
+	}
+	status = pred_compile (head, tableName, predicates, &plan);
+	if (status != 0)
+		return status;
+
+	// Take a free slot, or drop the least recently used query.
+	slot = &cache->slots[0];
+	for (i = 1; i < PRED_CACHE_SIZE && slot->handle != 0; i++) {
+		if (cache->slots[i].handle == 0 || cache->slots[i].lastUse < slot->lastUse)
+			slot = &cache->slots[i];
+	}
+	free (slot->predicates);
+	slot->predicates = strdup (predicates);
+	if (slot->predicates == NULL) {
+		slot->handle = 0;
+		return -2;
+	}
+	strncpy (slot->table, tableName, MAX_TABLE_LEN - 1);
+	slot->table[MAX_TABLE_LEN - 1] = '\0';
+	slot->plan = plan;
+	slot->handle = cache->nextHandle;
+	slot->lastUse = cache->clock;
+	cache->nextHandle += 1;
+	return slot->handle;
+}
+
+/**
+ * @brief Finds a prepared query by its handle.
+ * @return Returns its plan, or NULL if the handle is unknown.
+ */
+struct pred_plan* pred_lookup (struct pred_cache* cache, int handle) {
+	int i;
+	if (handle <= 0)
+		return NULL;
+	for (i = 0; i < PRED_CACHE_SIZE; i++) {
+		if (cache->slots[i].handle == handle) {
+			cache->clock += 1;
+			cache->slots[i].lastUse = cache->clock;
+			return &cache->slots[i].plan;
+		}
+	}
+	return NULL;
+}
@@ -0,0 +1,243 @@
+/**
+ * @file
+ * @brief This file declares compiled query predicates and the per-connection
+ * cache of prepared queries.
+ *
+ * A predicate string such as "name = bob, mark > 90" is parsed once into a
+ * plan: the table is looked up, every column name is resolved to its index,
+ * and every constant is converted to the type of its column.  Matching a row
+ * against a plan then only compares values, so the string is not tokenized
+ * and the constants are not validated again for every row.  The plan also
+ * learns which predicates reject the most rows for their cost, and tests
+ * those first (see struct pred_stats).
+ *
+ * A plan may also carry an ORDER BY column and a LIMIT, applied by the
+ * commands that return rows (see topk.h).
+ *
+ * QUERY compiles its predicates for the one call.  PREPARE keeps the plan in
+ * the connection's cache and answers a handle that EXECUTE runs.
+ */
+
+#ifndef PRED_H
+#define PRED_H
+
+#include "utils.h"
+
+struct colstats;
+
+/**
+ * @brief Operators of a compiled predicate.
+ *
+ * PRED_NEVER is an equality on an int column with a constant that is not a
+ * number, which no row matches.  PRED_BETWEEN matches values from its first
+ * constant to its second (both included), PRED_IN any of its constants.
+ */
+#define PRED_LT -1
+#define PRED_EQ 0
+#define PRED_GT 1
+#define PRED_NEVER 2
+#define PRED_NE 3
+#define PRED_LE 4
+#define PRED_GE 5
+#define PRED_BETWEEN 6
+#define PRED_IN 7
+
+/**
+ * @brief Limits of a compiled query: predicates, groups of predicates
+ * joined by OR, and constants (the values of IN lists included).
+ */
+#define PRED_MAX_TERMS 32
+#define PRED_MAX_GROUPS 16
+#define PRED_MAX_VALUES 64
+
+/**
+ * @brief Rows matched between two reorderings of the groups.
+ */
+#define PRED_REORDER_ROWS 64
+
+/**
+ * @brief Number of prepared queries kept per connection.
+ */
+#define PRED_CACHE_SIZE 16
+
+/**
+ * @brief One compiled predicate.
+ */
+struct pred_term {
+	/// Index of the column in the table.
+	int col;
+	/// One of the PRED_ operators.
+	int op;
+	/// 1 if the column is an int, 0 if it is a string.
+	int isInt;
+	/// The constants of the predicate, from the plan's values.
+	int first;
+	int numValues;
+	/// 1 if the column is dictionary encoded and the predicate only tests
+	/// equality, so the rows in slots are compared by code (see dict.h).
+	int encoded;
+};
+
+/**
+ * @brief Predicates joined by OR; a row must meet one of them.
+ */
+struct pred_group {
+	/// The predicates, from the plan's terms.
+	int first;
+	int numTerms;
+	/// Estimated cost of testing a row against the group.
+	int cost;
+};
+
+/**
+ * @brief Order in which the groups are tested, learned from the rows.
+ *
+ * A row is rejected by the first group it fails, so groups that are cheap
+ * and reject many rows go first.  Every PRED_REORDER_ROWS rows the groups
+ * are sorted by cost divided by the share of rows they rejected so far.
+ * Until then, the shares the column statistics predict (see colstats.h)
+ * stand in for them.
+ */
+struct pred_stats {
+	/// Rows matched so far.
+	unsigned long numRows;
+	/// Indexes of the groups, in test order.
+	int order[PRED_MAX_GROUPS];
+	/// Rows each group was tested against, and rows it rejected.
+	unsigned long tested[PRED_MAX_GROUPS];
+	unsigned long rejected[PRED_MAX_GROUPS];
+};
+
+/**
+ * @brief A compiled query: the table and the groups its rows must all meet.
+ */
+struct pred_plan {
+	/// The table queried.
+	struct table* node;
+	/// Number of groups; 0 matches every row.
+	int numGroups;
+	struct pred_group groups[PRED_MAX_GROUPS];
+	int numTerms;
+	struct pred_term terms[PRED_MAX_TERMS];
+	/// Constants, as ints (int columns) or strings (string columns).
+	int numValues;
+	long ivalues[PRED_MAX_VALUES];
+	char svalues[PRED_MAX_VALUES][MAX_STRTYPE_SIZE];
+	/// Codes of the string constants of encoded columns, or -1 if the column
+	/// did not hold the value when the plan was compiled.
+	int codes[PRED_MAX_VALUES];
+	/// Test order of the groups, kept by queries that use the plan.
+	struct pred_stats stats;
+	/// Column of the ORDER BY clause (-1 if none), and 1 if it is DESC.
+	int orderCol;
+	int orderDesc;
+	/// Number of rows of the LIMIT clause, or 0 if none.
+	int limit;
+};
+
+/**
+ * @brief A prepared query in a connection's cache.
+ */
+struct pred_slot {
+	/// Handle answered by PREPARE, or 0 if the slot is free.
+	int handle;
+	/// Value of the cache's clock when the slot was last used.
+	unsigned long lastUse;
+	/// Table name and predicates the plan was compiled from.
+	char table[MAX_TABLE_LEN];
+	char* predicates;
+	struct pred_plan plan;
+};
+
+/**
+ * @brief The prepared queries of one connection.
+ */
+struct pred_cache {
+	struct pred_slot slots[PRED_CACHE_SIZE];
+	/// Handle of the next prepared query.
+	int nextHandle;
+	/// Counts uses, to find the least recently used slot.
+	unsigned long clock;
+};
+
+/**
+ * @brief Compile predicates against a table.
+ *
+ * @param head The first table of the server.
+ * @param tableName The table to query.
+ * @param predicates A comma separated list of predicates that must all be
+ * met, or "LOAD_ALL" for every row, optionally followed by "ORDER BY col
+ * [ASC|DESC]" and then "LIMIT k" (either may be used alone).  Each item of
+ * the list is one predicate or several joined by OR.  A predicate is
+ * "col op value" with op one of =, !=, <, <=, > or >=, "col BETWEEN low AND
+ * high", or "col IN (value, value, ...)".  Strings compare in byte order,
+ * and =, != and IN on dictionary encoded columns compare codes.
+ * The string is not modified.
+ * @param plan Filled with the compiled query.
+ * @return Return 0 on success, -1 if the table does not exist, and -2 if the
+ * predicates are invalid (bad syntax, unknown column, or a constant of the
+ * wrong type).
+ */
+int pred_compile(struct table* head, const char* tableName, const char* predicates, struct pred_plan* plan);
+
+/**
+ * @brief Check a row against a plan.
+ *
+ * @param plan The compiled query.
+ * @param stats The test order of the groups, updated with the outcome, or
+ * NULL to test them in written order.  Usually &plan->stats; threads
+ * matching rows of the same plan at once each use their own copy.
+ * @param values The column values of the row.
+ * @param slot The slot of the row in its table, or -1 if the row is not in
+ * one (then encoded columns are compared as strings).
+ * @return Return 1 if the row meets every group, 0 otherwise.
+ */
+int pred_match(const struct pred_plan* plan, struct pred_stats* stats, char (*values)[MAX_STRTYPE_SIZE], int slot);
+
+/**
+ * @brief Check a value against one predicate of a plan.
+ *
+ * @param term The index of the predicate in the plan's terms.
+ * @param value A value of the predicate's column.
+ * @return Return 1 if the value meets the predicate, 0 otherwise.
+ */
+int pred_term_match(const struct pred_plan* plan, int term, const char* value);
+
+/**
+ * @brief Estimate the share of rows that meet a group of a plan.
+ *
+ * @param stats The statistics of the plan's table (see colstats.h).
+ * @param g The index of the group in the plan's groups.
+ * @return Return the share, from 0 to 1.
+ */
+double pred_group_pass(const struct pred_plan* plan, const struct colstats* stats, int g);
+
+/**
+ * @brief Create the (empty) prepared query cache of a connection.
+ */
+struct pred_cache* pred_cache_new();
+
+/**
+ * @brief Free the prepared query cache of a connection.
+ */
+void pred_cache_free(struct pred_cache* cache);
+
+/**
+ * @brief Compile a query and keep it in the cache.
+ *
+ * The same table and predicates prepared again get the same handle back.
+ * When the cache is full, the least recently used query is dropped and its
+ * handle becomes unknown.
+ *
+ * @return Return the handle (above 0), or the error of pred_compile().
+ */
+int pred_prepare(struct pred_cache* cache, struct table* head, const char* tableName, const char* predicates);
+
+/**
+ * @brief Find a prepared query.
+ *
+ * @return Return its plan, or NULL if the handle is unknown.
+ */
+struct pred_plan* pred_lookup(struct pred_cache* cache, int handle);
+
+#endif
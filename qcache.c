@@ -0,0 +1,168 @@
+/**
+ * @file
+ * @brief This file implements the query result cache declared in qcache.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "qcache.h"
+
+/**
+ * @brief A cached result.
+ */
+struct qcache_entry {
+	/// The table, or NULL if the entry is free, and its version when the result was computed.
+	struct table* node;
+	unsigned long version;
+	/// Key of the compiled predicates (see qcache_key()), and maxKeys.
+	char* predicates;
+	int maxKeys;
+	char* result;
+	/// Value of the clock when the entry was last used.
+	unsigned long lastUse;
+};
+
+static struct qcache_entry* entries = NULL;
+static int numSets = 0;
+static unsigned long useClock = 0;
+
+// Frees the strings of an entry.
+static void qcache_clear (struct qcache_entry* entry) {
+	free (entry->predicates);
+	free (entry->result);
+	memset (entry, 0, sizeof *entry);
+}
+
+/**
+ * @brief Sets the size of the cache and empties it.
+ * @return Returns 0 on success, -1 otherwise.
+ */
+int qcache_init (int size) {
+	int i;
+	for (i = 0; i < numSets * QCACHE_WAYS; i++)
+		qcache_clear (&entries[i]);
+	free (entries);
+	entries = NULL;
+	numSets = (size + QCACHE_WAYS - 1) / QCACHE_WAYS;
+	if (numSets == 0)
+		return 0;
+	entries = calloc (numSets * QCACHE_WAYS, sizeof(struct qcache_entry));
+	if (entries == NULL) {
+		numSets = 0;
+		return -1;
+	}
+	return 0;
+}
+
+// Writes the key of a compiled query: its groups, the column, operator and typed constants
+// of each predicate, and its ORDER BY and LIMIT.  Queries with the same key always match the
+// same rows, however they were written.  Returns 0, or -1 if the key does not fit.
+static int qcache_key (const struct pred_plan* plan, char* out, size_t size) {
+	const struct pred_group* group;
+	const struct pred_term* term;
+	size_t len = 0;
+	int n, g, t, k;
+	for (g = 0; g < plan->numGroups; g++) {
+		group = &plan->groups[g];
+		for (t = group->first; t < group->first + group->numTerms; t++) {
+			term = &plan->terms[t];
+			n = snprintf (out + len, size - len, "%c%d %d", t == group->first ? '&' : '|', term->col, term->op);
+			for (k = term->first; n >= 0 && (size_t)n < size - len && k < term->first + term->numValues; k++) {
+				len += n;
+				// Strings are prefixed with their length, so no value can pass for a delimiter.
+				if (term->isInt)
+					n = snprintf (out + len, size - len, " %ld", plan->ivalues[k]);
+				else
+					n = snprintf (out + len, size - len, " %zu:%s", strlen (plan->svalues[k]), plan->svalues[k]);
+			}
+			if (n < 0 || (size_t)n >= size - len)
+				return -1;
+			len += n;
+		}
+	}
+	n = snprintf (out + len, size - len, "/%d %d %d", plan->orderCol, plan->orderDesc, plan->limit);
+	return n < 0 || (size_t)n >= size - len ? -1 : 0;
+}
+
+// Returns 0 for a free or stale entry, else the time of its last use.
+static unsigned long qcache_age (const struct qcache_entry* entry) {
+	if (entry->node == NULL || entry->version != entry->node->version)
+		return 0;
+	return entry->lastUse;
+}
+
+// Returns the first entry of the set of a key.
+static struct qcache_entry* qcache_set (struct table* node, const char* predicates, int maxKeys) {
+	unsigned long h = 5381;
+	const char* p;
+	for (p = node->name; *p != '\0'; p++)
+		h = h * 33 + (unsigned char)*p;
+	for (p = predicates; *p != '\0'; p++)
+		h = h * 33 + (unsigned char)*p;
+	h = h * 33 + (unsigned long)maxKeys;
+	return &entries[(h % numSets) * QCACHE_WAYS];
+}
+
+/**
+ * @brief Finds the result of a query if it is cached for the current version of its table.
+ * @return Returns the result, or NULL.
+ */
+const char* qcache_get (const struct pred_plan* plan, int maxKeys) {
+	struct table* node = plan->node;
+	char key[MAX_CMD_LEN];
+	struct qcache_entry* set;
+	int i;
+	if (numSets == 0 || qcache_key (plan, key, sizeof key) != 0)
+		return NULL;
+	set = qcache_set (node, key, maxKeys);
+	for (i = 0; i < QCACHE_WAYS; i++) {
+		if (set[i].node == node && set[i].maxKeys == maxKeys && strcmp (set[i].predicates, key) == 0) {
+			if (set[i].version != node->version)
+				return NULL;	// The table was written since.
+			useClock += 1;
+			set[i].lastUse = useClock;
+			return set[i].result;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief Caches the result of a query.
+ */
+void qcache_put (const struct pred_plan* plan, int maxKeys, const char* result) {
+	struct table* node = plan->node;
+	char key[MAX_CMD_LEN];
+	struct qcache_entry* set;
+	struct qcache_entry* entry;
+	int i;
+	if (numSets == 0 || qcache_key (plan, key, sizeof key) != 0)
+		return;
+	set = qcache_set (node, key, maxKeys);
+	// Reuse the entry of the same query, else a free or stale one, else the least recently used.
+	entry = NULL;
+	for (i = 0; i < QCACHE_WAYS && entry == NULL; i++) {
+		if (set[i].node == node && set[i].maxKeys == maxKeys && strcmp (set[i].predicates, key) == 0)
+			entry = &set[i];
+	}
+	if (entry == NULL) {
+		entry = &set[0];
+		for (i = 1; i < QCACHE_WAYS; i++) {
+			if (qcache_age (&set[i]) < qcache_age (entry))
+				entry = &set[i];
+		}
+	}
+	qcache_clear (entry);
+	entry->predicates = strdup (key);
+	entry->result = strdup (result);
+	if (entry->predicates == NULL || entry->result == NULL) {
+		qcache_clear (entry);
+		return;
+	}
+	entry->node = node;
+	entry->version = node->version;
+	entry->maxKeys = maxKeys;
+	useClock += 1;
+	entry->lastUse = useClock;
+}
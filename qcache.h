@@ -0,0 +1,61 @@
+/**
+ * @file
+ * @brief This file declares the server's cache of QUERY results.
+ *
+ * A result is kept under its table, its predicates and its maxKeys.  The
+ * key is built from the compiled predicates (see pred.h), not from their
+ * text: columns by index and constants by type, so queries written
+ * differently but matching the same rows share a result, and queries that
+ * differ in any value never do.  Every entry also records the version of its table,
+ * which setEntry() and putEntry() increment on every write: an entry whose
+ * table has moved on is stale and is never answered, so a write
+ * invalidates all cached results of its table at once, without visiting
+ * them.
+ *
+ * The cache is 4-way set associative: a key can only live in the 4 entries
+ * of the set its hash selects, so a lookup compares at most 4 entries, and
+ * a new result replaces a stale entry of its set or else the least recently
+ * used one.  It is only used with the server lock held.
+ */
+
+#ifndef QCACHE_H
+#define QCACHE_H
+
+#include "utils.h"
+#include "pred.h"
+
+/**
+ * @brief Default number of cached results.
+ */
+#define QCACHE_DEFAULT_SIZE 64
+
+/**
+ * @brief Entries per set.
+ */
+#define QCACHE_WAYS 4
+
+/**
+ * @brief Set the number of cached results (rounded up to a multiple of
+ * QCACHE_WAYS), and drop all of them.
+ *
+ * @param size The number of results; 0 disables the cache.
+ * @return Return 0 on success, -1 if out of memory.
+ */
+int qcache_init(int size);
+
+/**
+ * @brief Find the cached result of a query.
+ *
+ * @param plan The query, compiled with pred_compile().
+ * @param maxKeys The maximum number of keys returned.
+ * @return Return the result, valid until the next call to qcache_put(), or
+ * NULL if it is not cached or the table was written since.
+ */
+const char* qcache_get(const struct pred_plan* plan, int maxKeys);
+
+/**
+ * @brief Cache the result of a query, for the current version of its table.
+ */
+void qcache_put(const struct pred_plan* plan, int maxKeys, const char* result);
+
+#endif
@@ -21,6 +21,20 @@
 #include <signal.h>
 #include "utils.h"
 #include "storage.h"
+#include "wal.h"
+#include "tablefile.h"
+#include "checkpoint.h"
+#include "mmaptable.h"
+#include "lsm.h"
+#include "bufpool.h"
+#include "snapshot.h"
+#include "lazyload.h"
+#include "pred.h"
+#include "workpool.h"
+#include "qcache.h"
+#include "watch.h"
+#include "dict.h"
+#include "bitmap.h"
 #include <time.h>
 #include <sys/time.h>
 #include <sys/stat.h>
@@ -46,9 +60,11 @@ struct config_params params;
  * @param cmdtable The table received from the client.
  * @param cmdkey The key received from the client.
  * @param cmdvalue The value received from the client.
+ * @param plans The queries prepared on this connection.
+ * @param watcher The subscriptions of this connection.
  * @return Returns 0 on success, -1 otherwise.
  */
-int handle_command(int sock, char *cmd, struct config_params *params, struct table* head)
+int handle_command(int sock, char *cmd, struct config_params *params, struct table* head, struct pred_cache* plans, struct watcher* watcher)
 {
 
 	char cmdidentify[20];
@@ -61,11 +77,61 @@ int handle_command(int sock, char *cmd, struct config_params *params, struct tab
 	int success = 0;
 	int maxKeys = 0;
 	char* arg;
+	// Log record this command must wait for before answering (0 if none).
+	unsigned long commitSeq = 0;
+	// Multi-line answer sent instead of cmd, once the lock is released (NULL if none).
+	char* reply = NULL;
+
+	// Load a table the first time it is used, before taking the lock, so that
+	// commands on other tables do not wait for it.
+	sscanf(cmd,"%s",cmdidentify);
+	if (strcmp (cmd, "SNAPSHOT") == 0)
+		success = lazyload_ensure_all(head);
+	else if (strcmp (cmdidentify, "SET") == 0) {
+		// "SET transac_id table key value" names its table third.
+		if (sscanf(cmd,"%*s %*s %s",cmdtable) == 1)
+			success = lazyload_ensure_name(head, cmdtable);
+	}
+	else if (strcmp (cmdidentify, "EXECUTE") == 0) {
+		// A prepared query runs on the table it was compiled against.
+		struct pred_plan* plan = NULL;
+		int handle = 0;
+		if (sscanf(cmd,"%*s %d", &handle) == 1 && plans != NULL)
+			plan = pred_lookup(plans, handle);
+		if (plan != NULL)
+			success = lazyload_ensure(plan->node);
+	}
+	// The other commands name their table second, except those without one.
+	else if (strcmp (cmdidentify, "AUTH") != 0 && strcmp (cmdidentify, "WAIT") != 0 && sscanf(cmd,"%*s %s",cmdtable) == 1)
+		success = lazyload_ensure_name(head, cmdtable);
+	if (success != 0) {
+		// The table cannot be read: answer as if it did not exist.
+		sprintf (cmd, "-1\n");
+		sendall(sock, cmd, strlen(cmd));
+		return -1;
+	}
+
+	// "WAIT timeout maxChanges" blocks for up to timeout ms until a watched table changes, so it
+	// runs without the lock.  It answers the changes one per line and "END <changes>".
+	if (strcmp (cmdidentify, "WAIT") == 0) {
+		int timeout = 0;
+		int numChanges = -2;
+		if (sscanf(cmd,"%*s %d %d", &timeout, &maxKeys) == 2 && timeout >= 0 && maxKeys > 0 && watcher != NULL)
+			numChanges = watch_wait(watcher, timeout, maxKeys, &reply);
+		if (numChanges < 0) {
+			sprintf (cmd, "%d\n", numChanges);
+			sendall(sock, cmd, strlen(cmd));
+		}
+		else {
+			sendall(sock, reply, strlen(reply));
+			free(reply);
+		}
+		return 0;
+	}
 
 	// Lock thread
 	pthread_mutex_lock (&lock);
-	sscanf(cmd,"%s",cmdidentify);
-	char buff[50];
+	char buff[MAX_CMD_LEN + 50];
 	sprintf(buff,"Processing command '%s'\n", cmd);
 	if (LOGGING == 1) logger(stdout, buff);
 	else if (LOGGING == 2) logger(file, buff);
@@ -116,6 +182,21 @@ int handle_command(int sock, char *cmd, struct config_params *params, struct tab
 
 		success = 0;
 	}
+	else if (strcmp (cmdidentify, "VERSION") == 0) {
+		// Revalidates a client-cached row.  Sends "0" if the client's version is still current, otherwise the full row as for GET.
+		unsigned long version = 0;
+		sscanf(cmd,"%*s %s %s %lu",cmdtable,cmdkey,&version);
+		success = getVersion(head, cmdtable, cmdkey);
+		if (success < 0)
+			sprintf (cmd, "%d", success);
+		else if (success == version)
+			sprintf (cmd, "0");
+		else {
+			strcpy (result, getEntry(head, cmdtable, cmdkey));
+			sprintf (cmd, "%s", result);
+		}
+		success = 0;
+	}
 	else if (strcmp (cmdidentify, "SET") == 0) {
 
 		struct timeval start_time, end_time;
@@ -136,10 +217,10 @@ int handle_command(int sock, char *cmd, struct config_params *params, struct tab
 			arg[strlen(arg)] = ' ';
 		strcpy (cmdvalue, arg);
 
-		char datapath[MAX_PATH_LEN];
-		strcpy (datapath, params->data_directory);
-		strcat (datapath, cmdtable);
-		success = setEntry(head, cmdtable, cmdkey, cmdvalue, datapath, params->policy, transac_id);
+		unsigned long lastSeq = wal_last_seq();
+		success = setEntry(head, cmdtable, cmdkey, cmdvalue, params->policy, transac_id);
+		if (wal_last_seq() != lastSeq)
+			commitSeq = wal_last_seq();
 		//Error -1 = Table not found, -2 = Wrong column format/Invalid param, -3 = Key not found, -4 = Transaction aborted
 		if(success < 0){
 			sprintf (cmd, "%d", success);
@@ -201,10 +282,7 @@ int handle_command(int sock, char *cmd, struct config_params *params, struct tab
 
 				char *buff2;
 				strcpy(buff2,value);
-				char datapath[MAX_PATH_LEN];
-				strcpy (datapath, params->data_directory);
-				strcat (datapath, TABLE);
-				success = setEntry(head, TABLE, KEY, buff2, datapath, params->policy, 0);
+				success = setEntry(head, TABLE, KEY, buff2, params->policy, 0);
 
 
 				if (LOGGING != 0)
@@ -263,7 +341,24 @@ int handle_command(int sock, char *cmd, struct config_params *params, struct tab
 			strcpy (cmdvalue, arg);
 		}
 
-		strcpy (cmd, query(head, cmdtable, cmdvalue, maxKeys));
+		// Answer from the cache while the table is unchanged.  The cache is keyed by the
+		// compiled query, so the predicates are compiled first, as query() would.
+		struct pred_plan plan;
+		const char* cached;
+		if (strlen(cmdtable) > MAX_TABLE_LEN)
+			cmdtable[MAX_TABLE_LEN - 1] = '\0';
+		int status = pred_compile (head, cmdtable, cmdvalue, &plan);
+		if (status == -1)
+			strcpy (cmd, "-1");	// Table not found.
+		else if (status != 0)
+			strcpy (cmd, "-2");
+		else if ((cached = qcache_get (&plan, maxKeys)) != NULL)
+			strcpy (cmd, cached);
+		else {
+			strcpy (cmd, query_plan(&plan, maxKeys));
+			if (atoi(cmd) >= 0)
+				qcache_put (&plan, maxKeys, cmd);
+		}
 
 		if (atoi(cmd) >= 0)
 			sprintf (buff, "Keys found: %s\n", cmd);
@@ -285,8 +380,144 @@ int handle_command(int sock, char *cmd, struct config_params *params, struct tab
 		else if (LOGGING == 2) logger(file, buff);
 	}
 
+	else if (strcmp (cmdidentify, "AGG") == 0) {
+		// "AGG table FUNC(column) predicates" answers "<rows> <value>" in one pass over the table.
+		char expr[MAX_COLNAME_LEN + 20];
+		int offset = 0;
+		if (sscanf(cmd,"%*s %s %39s %n", cmdtable, expr, &offset) < 2)
+			sprintf (cmd, "-2");
+		else
+			strcpy (cmd, aggregate(head, cmdtable, expr, cmd[offset] == '\0' ? "LOAD_ALL" : cmd + offset));
+		sprintf (buff, "Aggregate: %s\n", cmd);
+		if (LOGGING == 1) logger(stdout, buff);
+		else if (LOGGING == 2) logger(file, buff);
+	}
+	else if (strcmp (cmdidentify, "SELECT") == 0) {
+		// "SELECT table col1,col2 predicates" (or "*" for all columns) answers a header line
+		// "key<TAB>col1<TAB>col2", one line per matching row, and "END <rows>".
+		char columns[MAX_COLUMNS_PER_TABLE * MAX_COLNAME_LEN];
+		int offset = 0;
+		int numRows = -2;
+		if (sscanf(cmd,"%*s %s %199s %n", cmdtable, columns, &offset) == 2)
+			numRows = select_rows(head, cmdtable, columns, cmd[offset] == '\0' ? "LOAD_ALL" : cmd + offset, &reply);
+		if (numRows < 0)
+			sprintf (cmd, "%d", numRows);
+		sprintf (buff, "Selected rows: %d\n", numRows);
+		if (LOGGING == 1) logger(stdout, buff);
+		else if (LOGGING == 2) logger(file, buff);
+	}
+	else if (strcmp (cmdidentify, "SCAN") == 0) {
+		// "SCAN table start end limit" answers the keys from start to end ("*" for an open
+		// side) in key order, one per line, and "END <keys>".
+		char start[MAX_KEY_LEN];
+		char end[MAX_KEY_LEN];
+		int limit = 0;
+		int numKeys = -2;
+		if (sscanf(cmd,"%*s %s %19s %19s %d", cmdtable, start, end, &limit) == 4)
+			numKeys = scan_keys(head, cmdtable, start, end, limit, &reply);
+		if (numKeys < 0)
+			sprintf (cmd, "%d", numKeys);
+		sprintf (buff, "Scanned keys: %d\n", numKeys);
+		if (LOGGING == 1) logger(stdout, buff);
+		else if (LOGGING == 2) logger(file, buff);
+	}
+	else if (strcmp (cmdidentify, "STATS") == 0) {
+		// "STATS table" answers "rows <n>", one line of statistics per column, and "END <columns>".
+		int numCols = -2;
+		if (sscanf(cmd,"%*s %s", cmdtable) == 1)
+			numCols = column_stats(head, cmdtable, &reply);
+		if (numCols < 0)
+			sprintf (cmd, "%d", numCols);
+		sprintf (buff, "Column statistics: %d\n", numCols);
+		if (LOGGING == 1) logger(stdout, buff);
+		else if (LOGGING == 2) logger(file, buff);
+	}
+	else if (strcmp (cmdidentify, "WATCH") == 0) {
+		// "WATCH table predicates" subscribes this connection to the changes of the matching rows
+		// (all rows without predicates), collected with WAIT.
+		int offset = 0;
+		int status = -2;
+		if (sscanf(cmd,"%*s %s %n", cmdtable, &offset) >= 1 && watcher != NULL)
+			status = watch_add(watcher, head, cmdtable, cmd[offset] == '\0' ? "LOAD_ALL" : cmd + offset);
+		sprintf (cmd, "%d", status);
+		sprintf (buff, "Watch: %d\n", status);
+		if (LOGGING == 1) logger(stdout, buff);
+		else if (LOGGING == 2) logger(file, buff);
+	}
+	else if (strcmp (cmdidentify, "UNWATCH") == 0) {
+		// "UNWATCH table" ends a subscription.
+		int status = -2;
+		if (sscanf(cmd,"%*s %s", cmdtable) == 1 && watcher != NULL)
+			status = watch_remove(watcher, cmdtable);
+		sprintf (cmd, "%d", status);
+	}
+	else if (strcmp (cmdidentify, "PREPARE") == 0) {
+		// "PREPARE table predicates" compiles the predicates once and answers a handle for EXECUTE.
+		int offset = 0;
+		if (sscanf(cmd,"%*s %s %n", cmdtable, &offset) < 1 || plans == NULL)
+			sprintf (cmd, "-2");
+		else {
+			int handle = pred_prepare(plans, head, cmdtable, cmd[offset] == '\0' ? "LOAD_ALL" : cmd + offset);
+			sprintf (cmd, "%d", handle);
+		}
+		sprintf (buff, "Prepared query: %s\n", cmd);
+		if (LOGGING == 1) logger(stdout, buff);
+		else if (LOGGING == 2) logger(file, buff);
+	}
+	else if (strcmp (cmdidentify, "EXECUTE") == 0) {
+		// "EXECUTE handle maxKeys" runs a prepared query and answers as QUERY does, or -3 if the handle is unknown.
+		struct pred_plan* plan = NULL;
+		int handle = 0;
+		if (sscanf(cmd,"%*s %d %d", &handle, &maxKeys) == 2 && plans != NULL)
+			plan = pred_lookup(plans, handle);
+		if (plan == NULL)
+			strcpy (cmd, "-3");
+		else
+			strcpy (cmd, query_plan(plan, maxKeys));
+
+		if (atoi(cmd) >= 0)
+			sprintf (buff, "Keys found: %s\n", cmd);
+		else
+			sprintf (buff, "Sending Error Message: %d\n", atoi(cmd));
+		if (LOGGING == 1) logger(stdout, buff);
+		else if (LOGGING == 2) logger(file, buff);
+	}
+	else if (strcmp (cmdidentify, "SNAPSHOT") == 0) {
+		// "SNAPSHOT" starts writing all tables in the background and answers the
+		// sequence number of the snapshot; "SNAPSHOT STATUS" answers its progress.
+		char arg1[20] = "";
+		sscanf(cmd,"%*s %19s", arg1);
+		if (strcmp (arg1, "STATUS") == 0) {
+			struct snapshot_progress progress;
+			snapshot_status(&progress);
+			sprintf (cmd, "%s %lu %d %d %lu", snapshot_state_name(progress.state), progress.seq,
+					progress.tablesDone, progress.tablesTotal, progress.rowsDone);
+		}
+		else if (params->policy == 0) {
+			// In-memory tables have no data directory to write to.
+			sprintf (cmd, "-2");
+		}
+		else {
+			unsigned long seq;
+			if (snapshot_start(head, params->data_directory, &seq) < 0)
+				sprintf (cmd, "-1");
+			else
+				sprintf (cmd, "%lu", seq);
+		}
+		sprintf (buff, "Snapshot: %s\n", cmd);
+		if (LOGGING == 1) logger(stdout, buff);
+		else if (LOGGING == 2) logger(file, buff);
+	}
+
 	// Unlock thread
 	pthread_mutex_unlock(&lock);
+	// Wait for the write to be durable; concurrent writers share one fsync.
+	wal_commit(commitSeq);
+	if (reply != NULL) {
+		sendall(sock, reply, strlen(reply));
+		free(reply);
+		return success;
+	}
 	// For now, just send back the command to the client.
 	strcat (cmd, "\n");
 	sendall(sock, cmd, strlen(cmd));
@@ -298,6 +529,10 @@ int handle_command(int sock, char *cmd, struct config_params *params, struct tab
 // Function for handling commands from a single client.  To be used for multi-threading.
 void* handle_client(void* ptr) {
 	int num = *((int* )ptr);
+	// Queries prepared on this connection.
+	struct pred_cache* plans = pred_cache_new();
+	// Tables watched by this connection.
+	struct watcher* watcher = watch_new();
 	// Get commands from client.
 	int wait_for_commands = 1;
 	do {
@@ -310,7 +545,7 @@ void* handle_client(void* ptr) {
 		} else {
 			if (!(cmd == NULL || strlen(cmd) < 2)) {
 				// Handle the command from the client.
-				int status = handle_command(socks[num], cmd, &params, head);
+				int status = handle_command(socks[num], cmd, &params, head, plans, watcher);
 			}
 			if (status != 0)
 				wait_for_commands = 0; // Oops.  An error occured.
@@ -318,6 +553,11 @@ void* handle_client(void* ptr) {
 	} while (wait_for_commands);
 
 	// Close the connection with the client.
+	pred_cache_free(plans);
+	// Publishers walk the subscriptions with the lock held.
+	pthread_mutex_lock (&lock);
+	watch_free(watcher);
+	pthread_mutex_unlock (&lock);
 	close(socks[num]);
 	socks[num] = -1;
 	char buff[50];
@@ -327,6 +567,25 @@ void* handle_client(void* ptr) {
 	return;
 }
 
+/**
+ * @brief Finds a column named in the config file.
+ * @return Returns the index of the column and sets *node to its table, or returns -1.
+ */
+static int find_column(struct table* head, const char* tableName, const char* colName, struct table** node)
+{
+	int i;
+	for (*node = head; *node != NULL; *node = (*node)->next) {
+		if (strcmp((*node)->name, tableName) != 0)
+			continue;
+		for (i = 0; i < (*node)->numCol; i++) {
+			if (strcmp((*node)->col[i], colName) == 0)
+				return i;
+		}
+		return -1;
+	}
+	return -1;
+}
+
 /**
  * @brief Start the storage server.39
  *
@@ -369,6 +628,17 @@ int main(int argc, char *argv[])
 	params.policy = 0;
 	strcpy (params.data_directory, "");
 	params.concurrency = -1;
+	params.checkpoint_interval = DEFAULT_CHECKPOINT_INTERVAL;
+	params.durability = FLUSH_NONE;
+	params.durability_interval = 0;
+	params.mmap_flush = FLUSH_INTERVAL;
+	params.mmap_flush_interval = 1000;
+	params.memory_limit = 0;
+	params.table_loading = LOAD_EAGER;
+	params.query_threads = DEFAULT_QUERY_THREADS;
+	params.query_cache = QCACHE_DEFAULT_SIZE;
+	params.numDict = 0;
+	params.numBitmap = 0;
 	strcpy(params.table_name[0],"");
 	int status = read_config(config_file, &params);
 	if (status != 0 || strcmp(params.table_name[0],"") == 0 || params.concurrency == -1 || params.concurrency_exist == 0) {
@@ -377,10 +647,9 @@ int main(int argc, char *argv[])
 		else if (LOGGING == 2) logger(file, buff);
 		exit(EXIT_FAILURE);
 	}
-	// If storage policy is set to on-disk then load all files from directory.
-	FILE* diskTables[MAX_TABLES];
+	// If storage policy is set to on-disk or mmap then load all files from directory.
 	char datapath[MAX_PATH_LEN];
-	if (params.policy == 1) {
+	if (params.policy != 0) {
 		if (params.data_directory == NULL || strcmp (params.data_directory, "") == 0) {
 			sprintf(buff,"Error processing config file.\n");
 			if (LOGGING == 1) logger(stdout, buff);
@@ -406,16 +675,8 @@ int main(int argc, char *argv[])
 	}
 	// Initialize the tables in database
 	//struct table *head;
-	struct table *curr;
+	struct table *curr = NULL;
 	int i, j;
-	
-	char TABLE[MAX_TABLE_LEN];
-	char KEY[MAX_KEY_LEN];
-	char TEMP[100];
-	char values[MAX_COLUMNS_PER_TABLE][MAX_VALUE_LEN];
-	char value[MAX_VALUE_LEN];
-	char* buff2;
-	int success = 0;
 
 	if (params.tableIndex > MAX_TABLES) {
 		sprintf(buff,"Error processing config file.\n");
@@ -423,182 +684,170 @@ int main(int argc, char *argv[])
 		else if (LOGGING == 2) logger(file, buff);
 		exit(EXIT_FAILURE);
 	}
-	head=malloc(sizeof(struct table));
-	// Needs proper implementation from config parsing.
-	if (params.numCol[0] > MAX_COLUMNS_PER_TABLE) {
-		sprintf(buff,"Error processing config file.\n");
+	head = NULL;
+	if (snapshot_init() != 0) {
+		sprintf(buff,"Error setting up snapshots.\n");
 		if (LOGGING == 1) logger(stdout, buff);
 		else if (LOGGING == 2) logger(file, buff);
 		exit(EXIT_FAILURE);
 	}
-	head->numCol = params.numCol[0];
-	head-> headIndex = -1;
-	head->numEntries = 0;
-	head->next=NULL;
-	strcpy(head->name,params.table_name[0]);
-	for (i = 0; i < head->numCol; i++) {
-		strcpy(head->col[i], params.col[0][i]);
-		if (params.type[0][i] > MAX_STRTYPE_SIZE) {
-			sprintf(buff,"Error processing config file.\n");
-			if (LOGGING == 1) logger(stdout, buff);
-			else if (LOGGING == 2) logger(file, buff);
-			exit(EXIT_FAILURE);
-		}
-		head->type[i] = params.type[0][i];
-	}
-	for (j = 0; j < MAX_RECORDS_PER_TABLE;j++) {
-		head->entries[j] = malloc(sizeof(struct hashEntry));
-		head->entries[j]->transac_count = 1;
-		head->entries[j]->next = NULL;
-		head->entries[j]->prev = NULL;
-		head->entries[j]->deleted = -1;
-	}
-	// Load table for head.
-	if (params.policy == 1) {
-		// Open/Create file.
-		strcat (datapath, head->name);
-		diskTables[0] = fopen (datapath, "a+");
-		if (diskTables[0] == NULL) {
-			sprintf(buff,"Error opening file: %s.\n", datapath);
-			if (LOGGING == 1) logger(stdout, buff);
-			else if (LOGGING == 2) logger(file, buff);
-			exit(EXIT_FAILURE);
-		}
-		sprintf(buff,"Created/Opened file %s.\n", datapath);
-		if (LOGGING == 1) logger(stdout, buff);
-		else if (LOGGING == 2) logger(file, buff);
-		// Reopen file to start reading input from inside.
-		freopen (datapath, "r", diskTables[0]);
-		strcpy (TABLE, head->name);
-		while(fscanf(diskTables[0],"%s",&TEMP)!=EOF) {
-			if (strlen(TEMP)>19) {
-				memcpy( KEY, &TEMP, MAX_KEY_LEN - 1);
-				KEY[MAX_KEY_LEN - 1] = '\0';
-			}
-			else {
-				strcpy(KEY,TEMP);
-			}
-
-			strcpy (value, "");
-			strcat (value, head->col[0]);
-			strcat (value, " ");
-			fscanf(diskTables[0],"\t%s",&values[0]);
-			strcat (value, trim(values[0]));
-			for (j = 1; j < head->numCol - 1; j++) {
-				strcat (value, ", ");
-				strcat (value, head->col[j]);
-				strcat (value, " ");
-				fscanf(diskTables[0],"\t%s",&values[j]);
-				strcat (value, trim(values[j]));
-			}
-			strcat (value, ", ");
-			strcat (value, head->col[head->numCol - 1]);
-			strcat (value, " ");
-			fscanf(diskTables[0],"\t%s\n",&values[head->numCol - 1]);
-			strcat (value, trim(values[head->numCol - 1]));
-
-			success = setEntry(head, TABLE, KEY, value, NULL, 0, 0);
-		}
-		// Close File.
-		fclose (diskTables[0]);
-		if (LOGGING != 0)
-			sprintf(buff, "File %s loaded and closed.\n",datapath);
-		if (LOGGING == 1) logger(stdout, buff);
-		else if (LOGGING == 2) logger(file, buff);
-		strcpy (datapath, params.data_directory);
-	}
-	curr=head;
-	for (i=1;i<params.tableIndex;i++){
-		curr->next=malloc(sizeof(struct table));
-		curr=curr->next;
-		curr-> headIndex = -1;
-		curr->numEntries = 0;
-		strcpy(curr->name,params.table_name[i]);
+	if (params.policy == 1)
+		bufpool_init(params.memory_limit);
+	for (i = 0; i < params.tableIndex; i++) {
 		if (params.numCol[i] > MAX_COLUMNS_PER_TABLE) {
 			sprintf(buff,"Error processing config file.\n");
 			if (LOGGING == 1) logger(stdout, buff);
 			else if (LOGGING == 2) logger(file, buff);
 			exit(EXIT_FAILURE);
 		}
-		curr->numCol = params.numCol[i];
-		for (j = 0; j < curr->numCol; j++) {
-			strcpy(curr->col[j], params.col[i][j]);
+		for (j = 0; j < params.numCol[i]; j++) {
 			if (params.type[i][j] > MAX_STRTYPE_SIZE) {
 				sprintf(buff,"Error processing config file.\n");
 				if (LOGGING == 1) logger(stdout, buff);
 				else if (LOGGING == 2) logger(file, buff);
 				exit(EXIT_FAILURE);
 			}
-			curr->type[j] = params.type[i][j];
-		}
-		for (j = 0; j < MAX_RECORDS_PER_TABLE;j++) {
-			curr->entries[j] = malloc(sizeof(struct hashEntry));
-			curr->entries[j]->transac_count = 1;
-			curr->entries[j]->next = NULL;
-			curr->entries[j]->prev = NULL;
-			curr->entries[j]->deleted = -1;
-		}
-		// Load files for all tables.
-		if (params.policy == 1) {
-			// Open/Create Files.
-			strcat (datapath, curr->name);
-			diskTables[i] = fopen (datapath, "a+");
-			if (diskTables[i] == NULL) {
-				sprintf(buff,"Error opening file: %s.\n", datapath);
+		}
+		struct table* node = newTable(params.table_name[i], params.numCol[i], params.col[i], params.type[i]);
+		if (head == NULL)
+			head = node;
+		else
+			curr->next = node;
+		curr = node;
+		// Map the file of the table.
+		if (params.policy == 2) {
+			if (mmaptable_open(curr, params.data_directory) != 0) {
+				sprintf(buff,"Error mapping the file of table %s.\n", curr->name);
 				if (LOGGING == 1) logger(stdout, buff);
 				else if (LOGGING == 2) logger(file, buff);
 				exit(EXIT_FAILURE);
 			}
-			sprintf(buff,"Created/Opened file %s.\n", datapath);
+			sprintf(buff,"Mapped table %s with %d entries.\n", curr->name, curr->numEntries);
 			if (LOGGING == 1) logger(stdout, buff);
 			else if (LOGGING == 2) logger(file, buff);
-			// Reopen Files to start reading data from inside.
-			freopen (datapath, "r", diskTables[i]);
-			strcpy (TABLE, curr->name);
-			while(fscanf(diskTables[i],"%s",&TEMP)!=EOF) {
-				if (strlen(TEMP)>19) {
-					memcpy( KEY, &TEMP, MAX_KEY_LEN - 1);
-					KEY[MAX_KEY_LEN - 1] = '\0';
-				}
-				else {
-					strcpy(KEY,TEMP);
-				}
-
-				strcpy (value, "");
-				strcat (value, curr->col[0]);
-				strcat (value, " ");
-				fscanf(diskTables[i],"\t%s",&values[0]);
-				strcat (value, trim(values[0]));
-				for (j = 1; j < curr->numCol - 1; j++) {
-					strcat (value, ", ");
-					strcat (value, curr->col[j]);
-					strcat (value, " ");
-					fscanf(diskTables[i],"\t%s",&values[j]);
-					strcat (value, trim(values[j]));
-				}
-				strcat (value, ", ");
-				strcat (value, curr->col[curr->numCol - 1]);
-				strcat (value, " ");
-				fscanf(diskTables[i],"\t%s\n",&values[curr->numCol - 1]);
-				strcat (value, trim(values[curr->numCol - 1]));
-
-				success = setEntry(curr, TABLE, KEY, value, NULL, 0, 0);
-			}
-			// Close Files.
-			fclose (diskTables[i]);
-			if (LOGGING != 0)
-				sprintf(buff, "File %s loaded and closed.\n",datapath);
+		}
+		// Keep only the hot rows of on-disk tables in memory.
+		if (params.policy == 1 && bufpool_attach(curr, params.data_directory) != 0) {
+			sprintf(buff,"Error creating the spill file of table %s.\n", curr->name);
 			if (LOGGING == 1) logger(stdout, buff);
 			else if (LOGGING == 2) logger(file, buff);
-			strcpy (datapath, params.data_directory);
+			exit(EXIT_FAILURE);
+		}
+		// Open the SSTs of the table.
+		if (params.policy == 3 && lsm_open(curr, params.data_directory) != 0) {
+			sprintf(buff,"Error opening the SSTs of table %s.\n", curr->name);
+			if (LOGGING == 1) logger(stdout, buff);
+			else if (LOGGING == 2) logger(file, buff);
+			exit(EXIT_FAILURE);
+		}
+	}
+	// Encode and index the columns listed in the config file, with the rows already mapped.
+	for (i = 0; i < params.numDict; i++) {
+		struct table* node;
+		j = find_column(head, params.dict_table[i], params.dict_col[i], &node);
+		status = j < 0 ? -1 : dict_enable(node, j);
+		if (status == -2) {
+			sprintf(buff,"Error processing config file: column %s of table %s cannot be dictionary encoded, only char[%d] or narrower columns can.\n", params.dict_col[i], params.dict_table[i], DICT_CODE_OFFSET);
+			if (LOGGING == 1) logger(stdout, buff);
+			else if (LOGGING == 2) logger(file, buff);
+			exit(EXIT_FAILURE);
+		}
+		if (status != 0) {
+			sprintf(buff,"Error encoding column %s of table %s.\n", params.dict_col[i], params.dict_table[i]);
+			if (LOGGING == 1) logger(stdout, buff);
+			else if (LOGGING == 2) logger(file, buff);
+			exit(EXIT_FAILURE);
+		}
+	}
+	for (i = 0; i < params.numBitmap; i++) {
+		struct table* node;
+		j = find_column(head, params.bitmap_table[i], params.bitmap_col[i], &node);
+		if (j < 0 || bitmap_enable(node, j) != 0) {
+			sprintf(buff,"Error indexing column %s of table %s.\n", params.bitmap_col[i], params.bitmap_table[i]);
+			if (LOGGING == 1) logger(stdout, buff);
+			else if (LOGGING == 2) logger(file, buff);
+			exit(EXIT_FAILURE);
 		}
-
+	}
+	if (params.policy == 2 && mmaptable_set_flush(params.mmap_flush, params.mmap_flush_interval, head) != 0) {
+		sprintf(buff,"Error starting the mmap flush thread.\n");
+		if (LOGGING == 1) logger(stdout, buff);
+		else if (LOGGING == 2) logger(file, buff);
+		exit(EXIT_FAILURE);
+	}
+	// Load the files of all tables in parallel, or only mark them to be loaded on first use.
+	if (params.policy == 1 && params.table_loading != LOAD_EAGER) {
+		struct table* node;
+		for (node = head; node != NULL; node = node->next) {
+			if (lazyload_attach(node, params.data_directory) != 0) {
+				sprintf(buff,"Error reading the table file of %s.\n", node->name);
+				if (LOGGING == 1) logger(stdout, buff);
+				else if (LOGGING == 2) logger(file, buff);
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+	else if (params.policy == 1 && tablefile_load_all(head, params.data_directory) != 0) {
+		sprintf(buff,"Error loading the tables in %s.\n", params.data_directory);
+		if (LOGGING == 1) logger(stdout, buff);
+		else if (LOGGING == 2) logger(file, buff);
+		exit(EXIT_FAILURE);
 	}
 	//make the last node point to NULL
 	curr->next=NULL;
 	//move curr to head again
 	curr=head;
 
+	// Replay the write-ahead log on top of the table files (or SSTs), then keep it open for new writes.
+	if (params.policy == 1 || params.policy == 3) {
+		status = wal_replay(head, params.data_directory);
+		if (status < 0 || wal_open(params.data_directory) != 0
+				|| wal_set_durability(params.durability, params.durability_interval) != 0) {
+			sprintf(buff,"Error opening the write-ahead log in %s.\n", params.data_directory);
+			if (LOGGING == 1) logger(stdout, buff);
+			else if (LOGGING == 2) logger(file, buff);
+			exit(EXIT_FAILURE);
+		}
+		sprintf(buff,"Replayed %d log records.\n", status);
+		if (LOGGING == 1) logger(stdout, buff);
+		else if (LOGGING == 2) logger(file, buff);
+		// Periodically fold the log back into the table files.
+		if (params.checkpoint_interval > 0 && checkpoint_start(head, params.data_directory, params.checkpoint_interval) != 0) {
+			sprintf(buff,"Error starting the checkpoint thread.\n");
+			if (LOGGING == 1) logger(stdout, buff);
+			else if (LOGGING == 2) logger(file, buff);
+			exit(EXIT_FAILURE);
+		}
+	}
+	// Load the lazily loaded tables in the background.
+	if (params.policy == 1 && params.table_loading == LOAD_PREWARM && lazyload_prewarm(head) != 0) {
+		sprintf(buff,"Error starting the prewarm thread.\n");
+		if (LOGGING == 1) logger(stdout, buff);
+		else if (LOGGING == 2) logger(file, buff);
+		exit(EXIT_FAILURE);
+	}
+	// Scan large tables in parallel.
+	if (workpool_start(params.query_threads) != 0) {
+		sprintf(buff,"Error starting the query threads.\n");
+		if (LOGGING == 1) logger(stdout, buff);
+		else if (LOGGING == 2) logger(file, buff);
+		exit(EXIT_FAILURE);
+	}
+	// Keep the results of repeated queries.
+	if (qcache_init(params.query_cache) != 0) {
+		sprintf(buff,"Error allocating the query cache.\n");
+		if (LOGGING == 1) logger(stdout, buff);
+		else if (LOGGING == 2) logger(file, buff);
+		exit(EXIT_FAILURE);
+	}
+	// Merge the SSTs in the background.
+	if (params.policy == 3 && lsm_start(head, &lock) != 0) {
+		sprintf(buff,"Error starting the compaction thread.\n");
+		if (LOGGING == 1) logger(stdout, buff);
+		else if (LOGGING == 2) logger(file, buff);
+		exit(EXIT_FAILURE);
+	}
+
 	sprintf(buff,"Server on %s:%d\n", params.server_host, params.server_port);
 	if (LOGGING == 1) logger(stdout, buff);
 	else if (LOGGING == 2) logger(file, buff);
@@ -708,6 +957,7 @@ int main(int argc, char *argv[])
 
 	// Stop listening for connections.
 	close(listensock);
+	wal_close();
 	fclose(file);
 	
 	// Free memory
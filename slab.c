@@ -0,0 +1,102 @@
+/**
+ * @file
+ * @brief This file implements the slab allocator declared in slab.h.
+ */
+
+// For posix_memalign().
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <string.h>
+#include "slab.h"
+
+/**
+ * @brief Creates a slab.
+ */
+struct slab* slab_new (size_t objSize) {
+	struct slab* slab = malloc (sizeof(struct slab));
+	size_t size = sizeof(void*);
+	if (slab == NULL)
+		return NULL;
+	// Small objects take a power of two, so none crosses a line; larger ones whole lines.
+	if (objSize >= SLAB_ALIGN)
+		size = (objSize + SLAB_ALIGN - 1) / SLAB_ALIGN * SLAB_ALIGN;
+	else {
+		while (size < objSize)
+			size *= 2;
+	}
+	slab->objSize = size;
+	slab->perPage = (SLAB_PAGE_SIZE - SLAB_ALIGN) / size;
+	if (slab->perPage == 0)
+		slab->perPage = 1;
+	slab->pages = NULL;
+	slab->numFresh = 0;
+	slab->freeList = NULL;
+	slab->numUsed = 0;
+	return slab;
+}
+
+/**
+ * @brief Allocates a zeroed object, from the free list first.
+ * @return Returns the object, or NULL if out of memory.
+ */
+void* slab_alloc (struct slab* slab) {
+	struct slab_page* page;
+	void* obj;
+	if (slab->freeList != NULL) {
+		obj = slab->freeList;
+		slab->freeList = *(void**)obj;
+	}
+	else {
+		if (slab->numFresh == 0) {
+			// The first line of a page holds its header, the objects follow.
+			if (posix_memalign ((void**)&page, SLAB_ALIGN, SLAB_ALIGN + slab->perPage * slab->objSize) != 0)
+				return NULL;
+			page->next = slab->pages;
+			slab->pages = page;
+			slab->numFresh = slab->perPage;
+		}
+		// Fresh objects are handed out in address order.
+		obj = (char*)slab->pages + SLAB_ALIGN + (slab->perPage - slab->numFresh) * slab->objSize;
+		slab->numFresh -= 1;
+	}
+	memset (obj, 0, slab->objSize);
+	slab->numUsed += 1;
+	return obj;
+}
+
+/**
+ * @brief Puts an object on the free list.
+ */
+void slab_free (struct slab* slab, void* obj) {
+	if (obj == NULL)
+		return;
+	*(void**)obj = slab->freeList;
+	slab->freeList = obj;
+	slab->numUsed -= 1;
+}
+
+/**
+ * @brief Frees all the pages of a slab.
+ */
+void slab_clear (struct slab* slab) {
+	struct slab_page* page;
+	while (slab->pages != NULL) {
+		page = slab->pages;
+		slab->pages = page->next;
+		free (page);
+	}
+	slab->numFresh = 0;
+	slab->freeList = NULL;
+	slab->numUsed = 0;
+}
+
+/**
+ * @brief Frees a slab and its pages.
+ */
+void slab_destroy (struct slab* slab) {
+	if (slab == NULL)
+		return;
+	slab_clear (slab);
+	free (slab);
+}
@@ -0,0 +1,91 @@
+/**
+ * @file
+ * @brief This file declares the slab allocator that hands out the entries
+ * and rows of a table.
+ *
+ * A slab hands out objects of one size, cut from large pages, instead of
+ * calling malloc() once per object.  Objects are aligned on cache lines:
+ * their size is rounded up to a multiple of SLAB_ALIGN (or, below it, to a
+ * power of two), so that an object never shares a line with its neighbour
+ * and small objects never straddle one.  Freed objects go on a free list and
+ * are handed out again first, and all the objects of a slab are released at
+ * once, page by page, when the table is dropped.
+ *
+ * A slab is not locked: the rows of a table under the buffer pool are only
+ * allocated with the pool's lock held, and the other slabs only when a table
+ * is created or dropped.
+ */
+
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stddef.h>
+
+/**
+ * @brief Size of a cache line.
+ */
+#define SLAB_ALIGN 64
+
+/**
+ * @brief Bytes of a page (a page holds at least one object).
+ */
+#define SLAB_PAGE_SIZE (64 * 1024)
+
+/**
+ * @brief A page of objects, followed by the objects from the next cache line on.
+ */
+struct slab_page {
+	struct slab_page* next;
+};
+
+/**
+ * @brief An allocator of objects of one size.
+ */
+struct slab {
+	/// Size of an object, rounded up.
+	size_t objSize;
+	/// Objects per page.
+	size_t perPage;
+	/// Pages, newest first.
+	struct slab_page* pages;
+	/// Objects of the newest page never handed out.
+	size_t numFresh;
+	/// Freed objects, each holding a pointer to the next one.
+	void* freeList;
+	/// Objects handed out and not freed.
+	size_t numUsed;
+};
+
+/**
+ * @brief Create a slab.
+ *
+ * @param objSize The size of the objects.
+ * @return Return the slab, or NULL if out of memory.
+ */
+struct slab* slab_new(size_t objSize);
+
+/**
+ * @brief Allocate an object, filled with zeros.
+ *
+ * @return Return the object, aligned on a cache line if it is SLAB_ALIGN
+ * bytes or more, or NULL if out of memory.
+ */
+void* slab_alloc(struct slab* slab);
+
+/**
+ * @brief Give an object back for slab_alloc() to hand out again.
+ */
+void slab_free(struct slab* slab, void* obj);
+
+/**
+ * @brief Free every object of a slab at once, and its pages.  The slab can
+ * still be used.
+ */
+void slab_clear(struct slab* slab);
+
+/**
+ * @brief Free a slab and all of its objects.
+ */
+void slab_destroy(struct slab* slab);
+
+#endif
@@ -0,0 +1,259 @@
+/**
+ * @file
+ * @brief This file implements the online snapshots declared in snapshot.h.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "snapshot.h"
+#include "tablefile.h"
+#include "mmaptable.h"
+#include "bufpool.h"
+#include "lsm.h"
+#include "wal.h"
+#include "file.h"
+
+/// Size of the path of a snapshot directory: the data directory and "snapshot-<seq>".
+#define SNAPSHOT_DIR_LEN (MAX_PATH_LEN + 30)
+
+/// Progress of the last snapshot, in memory shared with the child.
+static struct snapshot_progress* progress = NULL;
+
+/**
+ * @brief Maps the shared progress.
+ * @return Returns 0 on success, -1 otherwise.
+ */
+int snapshot_init () {
+	void* shared = mmap (NULL, sizeof(struct snapshot_progress), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (shared == MAP_FAILED)
+		return -1;
+	progress = shared;
+	memset (progress, 0, sizeof *progress);
+	progress->state = SNAPSHOT_IDLE;
+	return 0;
+}
+
+// Closes the sockets inherited from the server, so clients that disconnect are
+// not kept open by the child.
+static void snapshot_close_sockets () {
+	struct dirent* ent;
+	struct stat info;
+	int fd;
+	DIR* d = opendir ("/proc/self/fd");
+	if (d == NULL)
+		return;
+	while ((ent = readdir (d)) != NULL) {
+		fd = atoi (ent->d_name);
+		if (ent->d_name[0] == '.' || fd == dirfd (d))
+			continue;
+		if (fstat (fd, &info) == 0 && S_ISSOCK(info.st_mode))
+			close (fd);
+	}
+	closedir (d);
+}
+
+/**
+ * @brief Writes the table file of one table, SSTs included.
+ * @return Returns 0 on success, -1 otherwise.
+ */
+static int snapshot_write_table (struct table* node, const char* dir, unsigned long seq) {
+	char path[SNAPSHOT_DIR_LEN + 5 + MAX_TABLE_LEN];
+	struct hashEntry* entry;
+	struct lsm_iter* it;
+	struct lsm_row row;
+	char* values[MAX_COLUMNS_PER_TABLE];
+	int width = tablefile_row_width (node);
+	uint32_t numRows = 0;
+	uint32_t capacity;
+	int status, i, j;
+
+	snprintf (path, sizeof path, "%s%s", dir, node->name);
+	if (node->lsm == NULL) {
+		status = tablefile_write (node, path, seq);
+		if (status == 0)
+			progress->rowsDone += node->numEntries;
+		return status;
+	}
+
+	// The memtable first, then the entries only found in SSTs.
+	capacity = node->numEntries + MAX_RECORDS_PER_TABLE;
+	char* rows = calloc (capacity, width);
+	if (node->numEntries > 0)
+		entry = node->entries[node->headIndex];
+	for (i = 0; i < node->numEntries; i++) {
+		for (j = 0; j < node->numCol; j++)
+			values[j] = entry->value[j];
+		tablefile_encode_row (node, rows + (size_t)numRows * width, entry->key, entry->transac_count, values);
+		numRows += 1;
+		entry = entry->next;
+	}
+	it = lsm_iter_open (node);
+	while (lsm_iter_next (it, &row) == 0) {
+		if (numRows == capacity) {
+			capacity *= 2;
+			rows = realloc (rows, (size_t)capacity * width);
+			memset (rows + (size_t)numRows * width, 0, (size_t)(capacity - numRows) * width);
+		}
+		for (j = 0; j < node->numCol; j++)
+			values[j] = row.value[j];
+		tablefile_encode_row (node, rows + (size_t)numRows * width, row.key, row.transac_count, values);
+		numRows += 1;
+	}
+	lsm_iter_close (it);
+	status = tablefile_write_rows (node, path, seq, rows, numRows);
+	free (rows);
+	if (status == 0)
+		progress->rowsDone += numRows;
+	return status;
+}
+
+// Body of the forked child: writes every table into a temporary directory and renames it.
+static void snapshot_child (struct table* head, void** copies, const char* dir, unsigned long seq) {
+	char tmp[SNAPSHOT_DIR_LEN + 5];
+	char final[SNAPSHOT_DIR_LEN];
+	struct table* node;
+	int status = 0;
+	int i;
+
+	snapshot_close_sockets ();
+	bufpool_freeze ();
+	for (node = head, i = 0; node != NULL; node = node->next, i++) {
+		if (copies[i] != NULL)
+			mmaptable_use_copy (node, copies[i]);
+	}
+	snprintf (final, sizeof final, "%ssnapshot-%lu", dir, seq);
+	snprintf (tmp, sizeof tmp, "%s.tmp/", final);
+	if (mkdir (tmp, 0777) != 0 && access (tmp, W_OK) != 0)
+		status = -1;
+	for (node = head; status == 0 && node != NULL; node = node->next) {
+		status = snapshot_write_table (node, tmp, seq);
+		progress->tablesDone += 1;
+	}
+	if (status == 0) {
+		tmp[strlen (tmp) - 1] = '\0';
+		status = rename (tmp, final);
+	}
+	progress->state = status == 0 ? SNAPSHOT_DONE : SNAPSHOT_FAILED;
+	_exit (status == 0 ? 0 : 1);
+}
+
+// Reaps the child, and records a snapshot whose child died as failed.
+static void* snapshot_reap (void* ptr) {
+	pid_t pid = (pid_t)(intptr_t)ptr;
+	int status;
+	waitpid (pid, &status, 0);
+	if (progress->state == SNAPSHOT_RUNNING)
+		progress->state = SNAPSHOT_FAILED;
+	return NULL;
+}
+
+/**
+ * @brief Forks a child that writes the snapshot.
+ * @return Returns 0 if the snapshot was started or already exists, 1 if one is running, -1 on error.
+ */
+int snapshot_start (struct table* head, const char* dir, unsigned long* seq) {
+	char final[SNAPSHOT_DIR_LEN];
+	char buff[MAX_PATH_LEN + 50];
+	void* copies[MAX_TABLES];
+	struct table* node;
+	struct stat info;
+	pthread_t thread;
+	int numTables = 0;
+	int i;
+
+	if (progress == NULL)
+		return -1;
+	if (progress->state == SNAPSHOT_RUNNING) {
+		*seq = progress->seq;
+		return 1;
+	}
+	*seq = wal_last_seq ();
+	snprintf (final, sizeof final, "%ssnapshot-%lu", dir, *seq);
+	if (*seq == 0) {
+		// Without a log (mmap tables), snapshots are numbered in order instead.
+		*seq = progress->seq;
+		do {
+			*seq += 1;
+			snprintf (final, sizeof final, "%ssnapshot-%lu", dir, *seq);
+		} while (stat (final, &info) == 0);
+	}
+	else if (stat (final, &info) == 0) {
+		// Nothing was written since that snapshot.
+		progress->state = SNAPSHOT_DONE;
+		progress->seq = *seq;
+		return 0;
+	}
+
+	for (node = head; node != NULL && numTables < MAX_TABLES; node = node->next) {
+		copies[numTables] = NULL;
+		if (node->map != NULL && (copies[numTables] = mmaptable_copy (node)) == NULL) {
+			for (i = 0; i < numTables; i++)
+				free (copies[i]);
+			return -1;
+		}
+		numTables += 1;
+	}
+	// The rows evicted from now on must not reach the child.
+	if (bufpool_fork_begin (dir) != 0) {
+		for (i = 0; i < numTables; i++)
+			free (copies[i]);
+		return -1;
+	}
+	progress->state = SNAPSHOT_RUNNING;
+	progress->seq = *seq;
+	progress->tablesDone = 0;
+	progress->tablesTotal = numTables;
+	progress->rowsDone = 0;
+
+	pid_t pid = fork ();
+	if (pid == 0)
+		snapshot_child (head, copies, dir, *seq);
+	bufpool_fork_end ();
+	for (i = 0; i < numTables; i++)
+		free (copies[i]);
+	if (pid < 0) {
+		progress->state = SNAPSHOT_FAILED;
+		return -1;
+	}
+	progress->pid = pid;
+	if (pthread_create (&thread, NULL, snapshot_reap, (void*)(intptr_t)pid) == 0)
+		pthread_detach (thread);
+	sprintf (buff, "Writing snapshot %lu in process %d.\n", *seq, (int)pid);
+	if (LOGGING == 1) logger(stdout, buff);
+	else if (LOGGING == 2) logger(file, buff);
+	return 0;
+}
+
+/**
+ * @brief Copies the progress of the last snapshot.
+ */
+void snapshot_status (struct snapshot_progress* out) {
+	if (progress == NULL) {
+		memset (out, 0, sizeof *out);
+		out->state = SNAPSHOT_IDLE;
+		return;
+	}
+	memcpy (out, progress, sizeof *out);
+}
+
+/**
+ * @brief Returns the name of a snapshot state.
+ */
+const char* snapshot_state_name (int state) {
+	if (state == SNAPSHOT_RUNNING)
+		return "running";
+	if (state == SNAPSHOT_DONE)
+		return "done";
+	if (state == SNAPSHOT_FAILED)
+		return "failed";
+	return "idle";
+}
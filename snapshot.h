@@ -0,0 +1,82 @@
+/**
+ * @file
+ * @brief This file declares online snapshots of all tables.
+ *
+ * A snapshot is taken by forking the server while it holds the server lock:
+ * the child sees every table exactly as it was at that moment through
+ * copy-on-write pages, and writes one binary table file per table (see
+ * tablefile.h) into "snapshot-<seq>" in the data directory, where seq is
+ * the sequence number of the last write-ahead log record it contains (mmap
+ * tables have no log, so their snapshots are just numbered from 1).  The
+ * parent releases the lock as soon as fork() returns and keeps serving.
+ *
+ * Tables under the LSM storage policy are written out whole (their SSTs are
+ * read through the file descriptors the child inherits), so their table file
+ * may hold more than MAX_RECORDS_PER_TABLE rows.  Mapped pages are shared
+ * with the child, so mapped tables are copied before forking.
+ *
+ * The child reports its progress in a shared anonymous mapping, read with
+ * snapshot_status().
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <sys/types.h>
+#include "utils.h"
+
+/**
+ * @brief States of the last snapshot.
+ */
+#define SNAPSHOT_IDLE 0
+#define SNAPSHOT_RUNNING 1
+#define SNAPSHOT_DONE 2
+#define SNAPSHOT_FAILED 3
+
+/**
+ * @brief Progress of the last snapshot, shared with the child writing it.
+ */
+struct snapshot_progress {
+	/// One of SNAPSHOT_IDLE, SNAPSHOT_RUNNING, SNAPSHOT_DONE or SNAPSHOT_FAILED.
+	int state;
+	/// Process writing the snapshot.
+	pid_t pid;
+	/// Sequence number of the last log record in the snapshot.
+	unsigned long seq;
+	/// Tables written so far, and in total.
+	int tablesDone;
+	int tablesTotal;
+	/// Rows written so far.
+	unsigned long rowsDone;
+};
+
+/**
+ * @brief Set up the shared progress of snapshots.  Call once at startup.
+ *
+ * @return Return 0 on success, -1 otherwise.
+ */
+int snapshot_init();
+
+/**
+ * @brief Start a snapshot.  Called with the server lock held.
+ *
+ * @param head The first table of the server.
+ * @param dir The data directory (ending with '/').
+ * @param seq Set to the sequence number of the snapshot.
+ * @return Return 0 if the snapshot was started (or one with the same
+ * sequence number already exists), 1 if a snapshot is still running (seq is
+ * set to its sequence number), and -1 on error.
+ */
+int snapshot_start(struct table* head, const char* dir, unsigned long* seq);
+
+/**
+ * @brief Read the progress of the last snapshot.
+ */
+void snapshot_status(struct snapshot_progress* progress);
+
+/**
+ * @brief Return the name of a snapshot state ("idle", "running", "done" or "failed").
+ */
+const char* snapshot_state_name(int state);
+
+#endif
@@ -25,6 +25,181 @@ int errno;
  */
 int auth;
 
+/**
+ * @brief One cached row in the client-side read cache.
+ */
+struct cache_entry {
+	/// Table the row belongs to.
+	char table[MAX_TABLE_LEN];
+	/// Key of the row.
+	char key[MAX_KEY_LEN];
+	/// Last record returned by the server.  metadata[0] holds the version.
+	struct storage_record record;
+	/// Time (in ms) when the row was last confirmed by the server.
+	double validated;
+	/// Next entry in the same hash bucket.
+	struct cache_entry* chain;
+	/// Neighbours in the LRU list.
+	struct cache_entry* newer;
+	struct cache_entry* older;
+};
+
+/**
+ * @brief The client-side read cache.  Disabled while capacity is 0.
+ */
+struct read_cache {
+	/// Max number of rows kept.
+	int capacity;
+	/// Rows currently cached.
+	int size;
+	/// Rows younger than this (in ms) are served without asking the server.
+	int max_age;
+	/// Hash buckets (capacity of them).
+	struct cache_entry** buckets;
+	/// Most and least recently used rows.
+	struct cache_entry* newest;
+	struct cache_entry* oldest;
+};
+
+static struct read_cache cache;
+
+// Returns the current time in milliseconds.
+static double cache_now () {
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return now.tv_sec * 1000.0 + now.tv_usec / 1000.0;
+}
+
+// Returns the bucket of the (table, key) pair.
+static int cache_bucket (const char* table, const char* key) {
+	unsigned long h = 5381;
+	int c;
+	while ((c = *table++))
+		h = ((h << 5) + h) + c;
+	h = ((h << 5) + h) + ' ';
+	while ((c = *key++))
+		h = ((h << 5) + h) + c;
+	return h % cache.capacity;
+}
+
+// Unlinks the entry from the LRU list.
+static void cache_unlink (struct cache_entry* entry) {
+	if (entry->newer != NULL)
+		entry->newer->older = entry->older;
+	else
+		cache.newest = entry->older;
+	if (entry->older != NULL)
+		entry->older->newer = entry->newer;
+	else
+		cache.oldest = entry->newer;
+	entry->newer = NULL;
+	entry->older = NULL;
+}
+
+// Puts the entry at the front of the LRU list.
+static void cache_touch (struct cache_entry* entry) {
+	if (cache.newest == entry)
+		return;
+	if (entry->newer != NULL || entry->older != NULL || cache.oldest == entry)
+		cache_unlink (entry);
+	entry->older = cache.newest;
+	if (cache.newest != NULL)
+		cache.newest->newer = entry;
+	cache.newest = entry;
+	if (cache.oldest == NULL)
+		cache.oldest = entry;
+}
+
+// Returns the cached entry for (table, key) or NULL.
+static struct cache_entry* cache_find (const char* table, const char* key) {
+	if (cache.capacity == 0)
+		return NULL;
+	struct cache_entry* entry = cache.buckets[cache_bucket (table, key)];
+	while (entry != NULL) {
+		if (strcmp (entry->key, key) == 0 && strcmp (entry->table, table) == 0)
+			return entry;
+		entry = entry->chain;
+	}
+	return NULL;
+}
+
+// Drops the entry for (table, key) if it is cached.
+static void cache_remove (const char* table, const char* key) {
+	if (cache.capacity == 0)
+		return;
+	struct cache_entry** link = &cache.buckets[cache_bucket (table, key)];
+	while (*link != NULL) {
+		struct cache_entry* entry = *link;
+		if (strcmp (entry->key, key) == 0 && strcmp (entry->table, table) == 0) {
+			*link = entry->chain;
+			cache_unlink (entry);
+			free (entry);
+			cache.size -= 1;
+			return;
+		}
+		link = &entry->chain;
+	}
+}
+
+// Stores a copy of the record, evicting the least recently used row if full.
+static void cache_store (const char* table, const char* key, struct storage_record* record) {
+	if (cache.capacity == 0)
+		return;
+	struct cache_entry* entry = cache_find (table, key);
+	if (entry == NULL) {
+		if (cache.size >= cache.capacity)
+			cache_remove (cache.oldest->table, cache.oldest->key);
+		entry = malloc (sizeof(struct cache_entry));
+		if (entry == NULL)
+			return;
+		memset (entry, 0, sizeof(struct cache_entry));
+		strncpy (entry->table, table, MAX_TABLE_LEN - 1);
+		strncpy (entry->key, key, MAX_KEY_LEN - 1);
+		int b = cache_bucket (table, key);
+		entry->chain = cache.buckets[b];
+		cache.buckets[b] = entry;
+		cache.size += 1;
+	}
+	memcpy (&entry->record, record, sizeof(struct storage_record));
+	entry->validated = cache_now ();
+	cache_touch (entry);
+}
+
+/**
+ * @brief Drops every cached row.
+ */
+void storage_cache_clear()
+{
+	while (cache.oldest != NULL)
+		cache_remove (cache.oldest->table, cache.oldest->key);
+}
+
+/**
+ * @brief Enables (or resizes) the client-side read cache.
+ */
+int storage_cache_enable(const int max_entries, const int max_age_ms)
+{
+	if (max_entries < 0 || max_age_ms < 0) {
+		errno = ERR_INVALID_PARAM;
+		return -1;
+	}
+	storage_cache_clear();
+	free (cache.buckets);
+	cache.buckets = NULL;
+	cache.capacity = 0;
+	cache.size = 0;
+	cache.max_age = max_age_ms;
+	if (max_entries == 0)
+		return 0;
+	cache.buckets = calloc (max_entries, sizeof(struct cache_entry*));
+	if (cache.buckets == NULL) {
+		errno = ERR_UNKNOWN;
+		return -1;
+	}
+	cache.capacity = max_entries;
+	return 0;
+}
+
 
 /**
  * @brief This is used to establish a connection with server.
@@ -174,20 +349,40 @@ int storage_get(const char *table, const char *key, struct storage_record *recor
 	int sock = (int)conn;
 
 
+	// Serve fresh cached rows locally, and revalidate older ones by version.
+	struct cache_entry* cached = cache_find (table, key);
+	if (auth == 1 && cached != NULL && cache_now () - cached->validated < cache.max_age) {
+		memcpy (record, &cached->record, sizeof(struct storage_record));
+		cache_touch (cached);
+		return 0;
+	}
+
 	// Send some data.
 	char buf[MAX_CMD_LEN];
 	memset(buf, 0, sizeof buf);
-	snprintf(buf, sizeof buf, "GET %s %s\n", table, key);
+	if (cached != NULL)
+		snprintf(buf, sizeof buf, "VERSION %s %s %lu\n", table, key, (unsigned long)cached->record.metadata[0]);
+	else
+		snprintf(buf, sizeof buf, "GET %s %s\n", table, key);
 	if(auth==1){
 		if (sendall(sock, buf, strlen(buf)) == 0 && recvline(sock, buf, sizeof buf) == 0) {
 			if (strcmp (buf, "-1") == 0) {
+				cache_remove (table, key);
 				errno = ERR_TABLE_NOT_FOUND;
 				return -1;
 			}
 			if (strcmp (buf, "-2") == 0) {
+				cache_remove (table, key);
 				errno = ERR_KEY_NOT_FOUND;
 				return -1;
 			}
+			// The cached version is still current.
+			if (cached != NULL && strcmp (buf, "0") == 0) {
+				cached->validated = cache_now ();
+				memcpy (record, &cached->record, sizeof(struct storage_record));
+				cache_touch (cached);
+				return 0;
+			}
 
 			int j = 0;
 			j = strcspn (buf, " ");
@@ -196,6 +391,7 @@ int storage_get(const char *table, const char *key, struct storage_record *recor
 			
 				buf[j] = ' ';;				
 			strncpy(record->value, buf+j+1, sizeof record->value);
+			cache_store (table, key, record);
 
 			// Get the time at the end of the experiment.
 			gettimeofday(&end_time,NULL);
@@ -302,6 +498,8 @@ int storage_set(const char *table, const char *key, struct storage_record *recor
 
 
 	if(auth==1){
+		// Any write makes the cached copy stale.
+		cache_remove (table, TEMP);
 //	    printf(" sending data \n");
 		if (buf != NULL && sendall(sock, buf, strlen(buf)) == 0 && recvline(sock, buf, sizeof buf) == 0) {
 			if (strcmp (buf, "-1") == 0) {
@@ -463,6 +661,455 @@ int storage_query(const char *table, const char *predicates, char **keys, const
 	return -1;
 }
 
+/**
+ * @brief This is used to compute an aggregate on the server
+ */
+int storage_aggregate(const char *table, const char *expr, const char *predicates, double *result, void *conn) {
+	if (!conn || !table || !expr || !predicates || !result) {
+		errno = ERR_INVALID_PARAM;
+		return -1;
+	}
+	if (auth != 1) {
+		errno = ERR_NOT_AUTHENTICATED;
+		return -1;
+	}
+	int sock = (int)conn;
+	char buf[MAX_CMD_LEN];
+	snprintf(buf, sizeof buf, "AGG %s %s %s\n", table, expr, predicates);
+	if (sendall(sock, buf, strlen(buf)) != 0 || recvline(sock, buf, sizeof buf) != 0) {
+		errno = ERR_CONNECTION_FAIL;
+		return -1;
+	}
+	if (strcmp (buf, "-1") == 0) {
+		errno = ERR_TABLE_NOT_FOUND;
+		return -1;
+	}
+	if (strcmp (buf, "-2") == 0) {
+		errno = ERR_INVALID_PARAM;
+		return -1;
+	}
+	int count;
+	if (sscanf (buf, "%d %lf", &count, result) != 2) {
+		errno = ERR_UNKNOWN;
+		return -1;
+	}
+	return count;
+}
+
+// Splits a line of a SELECT answer at its tabs.  Returns the number of fields.
+static int storage_split_fields(char *line, char **fields) {
+	int num = 0;
+	char *tab;
+	fields[num++] = line;
+	while (num < MAX_COLUMNS_PER_TABLE + 1 && (tab = strchr(line, '\t')) != NULL) {
+		*tab = '\0';
+		line = tab + 1;
+		fields[num++] = line;
+	}
+	return num;
+}
+
+/**
+ * @brief This is used to fetch chosen columns of matching records from the server
+ */
+int storage_select(const char *table, const char *columns, const char *predicates,
+		void (*row)(int num_columns, char **names, const char *key, char **values, void *arg),
+		void *arg, void *conn) {
+	if (!conn || !table || !columns || !predicates) {
+		errno = ERR_INVALID_PARAM;
+		return -1;
+	}
+	if (auth != 1) {
+		errno = ERR_NOT_AUTHENTICATED;
+		return -1;
+	}
+	int sock = (int)conn;
+	char buf[MAX_CMD_LEN];
+	char header[MAX_CMD_LEN];
+	char *names[MAX_COLUMNS_PER_TABLE + 1];
+	char *fields[MAX_COLUMNS_PER_TABLE + 1];
+	int numCols, numRows = 0;
+	snprintf(buf, sizeof buf, "SELECT %s %s %s\n", table, columns, predicates);
+	if (sendall(sock, buf, strlen(buf)) != 0 || recvline(sock, header, sizeof header) != 0) {
+		errno = ERR_CONNECTION_FAIL;
+		return -1;
+	}
+	if (strcmp (header, "-1") == 0) {
+		errno = ERR_TABLE_NOT_FOUND;
+		return -1;
+	}
+	if (header[0] == '-') {
+		errno = strcmp (header, "-2") == 0 ? ERR_INVALID_PARAM : ERR_UNKNOWN;
+		return -1;
+	}
+	// "key<TAB>col1<TAB>col2...", then one line per record, then "END <rows>".
+	numCols = storage_split_fields(header, names) - 1;
+	while (recvline(sock, buf, sizeof buf) == 0) {
+		if (strncmp (buf, "END ", 4) == 0)
+			return numRows;
+		if (storage_split_fields(buf, fields) != numCols + 1) {
+			errno = ERR_UNKNOWN;
+			return -1;
+		}
+		if (row != NULL)
+			row(numCols, names + 1, fields[0], fields + 1, arg);
+		numRows += 1;
+	}
+	errno = ERR_CONNECTION_FAIL;
+	return -1;
+}
+
+/**
+ * @brief This is used to prepare a query on the server
+ */
+int storage_prepare(const char *table, const char *predicates, void *conn) {
+	if (!conn || !table || !predicates) {
+		errno = ERR_INVALID_PARAM;
+		return -1;
+	}
+	if (auth != 1) {
+		errno = ERR_NOT_AUTHENTICATED;
+		return -1;
+	}
+	int sock = (int)conn;
+	char buf[MAX_CMD_LEN];
+	snprintf(buf, sizeof buf, "PREPARE %s %s\n", table, predicates);
+	if (sendall(sock, buf, strlen(buf)) != 0 || recvline(sock, buf, sizeof buf) != 0) {
+		errno = ERR_CONNECTION_FAIL;
+		return -1;
+	}
+	int handle = atoi (buf);
+	if (handle == -1)
+		errno = ERR_TABLE_NOT_FOUND;
+	else if (handle == -2)
+		errno = ERR_INVALID_PARAM;
+	else if (handle <= 0)
+		errno = ERR_UNKNOWN;
+	return handle > 0 ? handle : -1;
+}
+
+/**
+ * @brief This is used to run a query prepared on the server
+ */
+int storage_execute(int handle, char **keys, const int max_keys, void *conn) {
+	if (!conn || handle <= 0 || (max_keys > 0 && !keys)) {
+		errno = ERR_INVALID_PARAM;
+		return -1;
+	}
+	if (auth != 1) {
+		errno = ERR_NOT_AUTHENTICATED;
+		return -1;
+	}
+	int sock = (int)conn;
+	char buf[MAX_CMD_LEN];
+	snprintf(buf, sizeof buf, "EXECUTE %d %d\n", handle, max_keys);
+	if (sendall(sock, buf, strlen(buf)) != 0 || recvline(sock, buf, sizeof buf) != 0) {
+		errno = ERR_CONNECTION_FAIL;
+		return -1;
+	}
+	if (strcmp (buf, "-3") == 0 || strcmp (buf, "-2") == 0) {
+		errno = ERR_INVALID_PARAM;
+		return -1;
+	}
+	if (buf[0] == '-') {
+		errno = ERR_UNKNOWN;
+		return -1;
+	}
+	// "numKeys key1 key2 ..."
+	int i = 0;
+	char* save;
+	char* arg = strtok_r (buf, " ", &save);
+	int numKeys = atoi (arg);
+	arg = strtok_r (NULL, " ", &save);
+	while (arg != NULL && i < max_keys) {
+		strcpy (keys[i], arg);
+		i += 1;
+		arg = strtok_r (NULL, " ", &save);
+	}
+	return numKeys;
+}
+
+/**
+ * @brief This is used to list the keys of a table within a range, in key order
+ */
+int storage_scan(const char *table, const char *start, const char *end, char **keys, const int max_keys, void *conn) {
+	if (!conn || !table || !keys || max_keys <= 0) {
+		errno = ERR_INVALID_PARAM;
+		return -1;
+	}
+	if (auth != 1) {
+		errno = ERR_NOT_AUTHENTICATED;
+		return -1;
+	}
+	int sock = (int)conn;
+	char buf[MAX_CMD_LEN];
+	int numKeys = 0;
+	// "*" leaves a side of the range open.
+	snprintf(buf, sizeof buf, "SCAN %s %s %s %d\n", table, start ? start : "*", end ? end : "*", max_keys);
+	if (sendall(sock, buf, strlen(buf)) != 0 || recvline(sock, buf, sizeof buf) != 0) {
+		errno = ERR_CONNECTION_FAIL;
+		return -1;
+	}
+	if (strcmp (buf, "-1") == 0) {
+		errno = ERR_TABLE_NOT_FOUND;
+		return -1;
+	}
+	if (buf[0] == '-') {
+		errno = strcmp (buf, "-2") == 0 ? ERR_INVALID_PARAM : ERR_UNKNOWN;
+		return -1;
+	}
+	// One key per line, then "END <keys>".
+	while (strncmp (buf, "END ", 4) != 0) {
+		if (numKeys < max_keys) {
+			strncpy (keys[numKeys], buf, MAX_KEY_LEN - 1);
+			keys[numKeys][MAX_KEY_LEN - 1] = '\0';
+		}
+		numKeys += 1;
+		if (recvline(sock, buf, sizeof buf) != 0) {
+			errno = ERR_CONNECTION_FAIL;
+			return -1;
+		}
+	}
+	return numKeys < max_keys ? numKeys : max_keys;
+}
+
+/**
+ * @brief This is used to read the statistics of the columns of a table
+ */
+int storage_stats(const char *table, unsigned long *rows, struct storage_column_stats *columns, const int max_columns, void *conn) {
+	if (!conn || !table || !rows || !columns || max_columns <= 0) {
+		errno = ERR_INVALID_PARAM;
+		return -1;
+	}
+	if (auth != 1) {
+		errno = ERR_NOT_AUTHENTICATED;
+		return -1;
+	}
+	int sock = (int)conn;
+	char buf[MAX_CMD_LEN];
+	char *fields[MAX_COLUMNS_PER_TABLE + 1];
+	char *save;
+	char *bucket;
+	struct storage_column_stats *col;
+	int numCols = 0;
+	snprintf(buf, sizeof buf, "STATS %s\n", table);
+	if (sendall(sock, buf, strlen(buf)) != 0 || recvline(sock, buf, sizeof buf) != 0) {
+		errno = ERR_CONNECTION_FAIL;
+		return -1;
+	}
+	if (strcmp (buf, "-1") == 0) {
+		errno = ERR_TABLE_NOT_FOUND;
+		return -1;
+	}
+	if (sscanf (buf, "rows %lu", rows) != 1) {
+		errno = strcmp (buf, "-2") == 0 ? ERR_INVALID_PARAM : ERR_UNKNOWN;
+		return -1;
+	}
+	// "col<TAB>type<TAB>distinct<TAB>min<TAB>max<TAB>bound:count,...", then "END <columns>".
+	while (recvline(sock, buf, sizeof buf) == 0) {
+		if (strncmp (buf, "END ", 4) == 0)
+			return numCols;
+		if (storage_split_fields(buf, fields) != 6) {
+			errno = ERR_UNKNOWN;
+			return -1;
+		}
+		if (numCols == max_columns)
+			continue;
+		col = &columns[numCols];
+		strncpy(col->name, fields[0], MAX_COLNAME_LEN - 1);
+		col->name[MAX_COLNAME_LEN - 1] = '\0';
+		col->is_int = strcmp (fields[1], "int") == 0;
+		col->distinct = strtoul (fields[2], NULL, 10);
+		strncpy(col->min, fields[3], MAX_STRTYPE_SIZE - 1);
+		col->min[MAX_STRTYPE_SIZE - 1] = '\0';
+		strncpy(col->max, fields[4], MAX_STRTYPE_SIZE - 1);
+		col->max[MAX_STRTYPE_SIZE - 1] = '\0';
+		col->num_buckets = 0;
+		for (bucket = strtok_r (fields[5], ",", &save); bucket != NULL && col->num_buckets < 16; bucket = strtok_r (NULL, ",", &save)) {
+			if (sscanf (bucket, "%ld:%lu", &col->bounds[col->num_buckets], &col->counts[col->num_buckets]) == 2)
+				col->num_buckets += 1;
+		}
+		numCols += 1;
+	}
+	errno = ERR_CONNECTION_FAIL;
+	return -1;
+}
+
+/**
+ * @brief This is used to subscribe the connection to the changes of a table
+ */
+int storage_watch(const char *table, const char *predicates, void *conn) {
+	if (!conn || !table || my_strvalidate(table, 1)) {
+		errno = ERR_INVALID_PARAM;
+		return -1;
+	}
+	if (auth != 1) {
+		errno = ERR_NOT_AUTHENTICATED;
+		return -1;
+	}
+	int sock = (int)conn;
+	char buf[MAX_CMD_LEN];
+	snprintf(buf, sizeof buf, "WATCH %s %s\n", table, predicates ? predicates : "");
+	if (sendall(sock, buf, strlen(buf)) != 0 || recvline(sock, buf, sizeof buf) != 0) {
+		errno = ERR_CONNECTION_FAIL;
+		return -1;
+	}
+	if (strcmp (buf, "0") == 0)
+		return 0;
+	if (strcmp (buf, "-1") == 0)
+		errno = ERR_TABLE_NOT_FOUND;
+	else if (strcmp (buf, "-2") == 0 || strcmp (buf, "-3") == 0)
+		errno = ERR_INVALID_PARAM;
+	else
+		errno = ERR_UNKNOWN;
+	return -1;
+}
+
+/**
+ * @brief This is used to stop watching a table
+ */
+int storage_unwatch(const char *table, void *conn) {
+	if (!conn || !table) {
+		errno = ERR_INVALID_PARAM;
+		return -1;
+	}
+	if (auth != 1) {
+		errno = ERR_NOT_AUTHENTICATED;
+		return -1;
+	}
+	int sock = (int)conn;
+	char buf[MAX_CMD_LEN];
+	snprintf(buf, sizeof buf, "UNWATCH %s\n", table);
+	if (sendall(sock, buf, strlen(buf)) != 0 || recvline(sock, buf, sizeof buf) != 0) {
+		errno = ERR_CONNECTION_FAIL;
+		return -1;
+	}
+	if (strcmp (buf, "0") == 0)
+		return 0;
+	errno = buf[0] == '-' ? ERR_INVALID_PARAM : ERR_UNKNOWN;
+	return -1;
+}
+
+/**
+ * @brief This is used to wait for changes to the watched tables
+ */
+int storage_wait(int timeout_ms, struct storage_change *changes, const int max_changes, void *conn) {
+	if (!conn || !changes || max_changes <= 0 || timeout_ms < 0) {
+		errno = ERR_INVALID_PARAM;
+		return -1;
+	}
+	if (auth != 1) {
+		errno = ERR_NOT_AUTHENTICATED;
+		return -1;
+	}
+	int sock = (int)conn;
+	char buf[MAX_CMD_LEN];
+	struct storage_change *change;
+	int numChanges = 0;
+	int offset = 0;
+	// A resync takes a slot of the array too.
+	snprintf(buf, sizeof buf, "WAIT %d %d\n", timeout_ms, max_changes);
+	if (sendall(sock, buf, strlen(buf)) != 0 || recvline(sock, buf, sizeof buf) != 0) {
+		errno = ERR_CONNECTION_FAIL;
+		return -1;
+	}
+	if (buf[0] == '-') {
+		errno = strcmp (buf, "-2") == 0 || strcmp (buf, "-3") == 0 ? ERR_INVALID_PARAM : ERR_UNKNOWN;
+		return -1;
+	}
+	// "RESYNC", "SET table key version value" or "DEL table key", then "END <changes>".
+	while (strncmp (buf, "END ", 4) != 0) {
+		if (numChanges < max_changes) {
+			change = &changes[numChanges];
+			memset (change, 0, sizeof *change);
+			if (strcmp (buf, "RESYNC") == 0) {
+				change->type = STORAGE_CHANGE_RESYNC;
+				storage_cache_clear();
+			}
+			else if (sscanf (buf, "SET %19s %19s %n", change->table, change->key, &offset) == 2 && offset > 0) {
+				change->type = STORAGE_CHANGE_SET;
+				change->record.metadata[0] = atoi (buf + offset);
+				offset += strcspn (buf + offset, " ");
+				if (buf[offset] == ' ')
+					offset += 1;
+				strncpy (change->record.value, buf + offset, MAX_VALUE_LEN - 1);
+				cache_remove (change->table, change->key);
+			}
+			else if (sscanf (buf, "DEL %19s %19s", change->table, change->key) == 2) {
+				change->type = STORAGE_CHANGE_DELETE;
+				cache_remove (change->table, change->key);
+			}
+			else {
+				errno = ERR_UNKNOWN;
+				return -1;
+			}
+			offset = 0;
+			numChanges += 1;
+		}
+		if (recvline(sock, buf, sizeof buf) != 0) {
+			errno = ERR_CONNECTION_FAIL;
+			return -1;
+		}
+	}
+	return numChanges;
+}
+
+/**
+ * @brief This is used to start a snapshot of all tables on the server
+ */
+int storage_snapshot(unsigned long *seq, void *conn) {
+	if (!conn || !seq) {
+		errno = ERR_INVALID_PARAM;
+		return -1;
+	}
+	if (auth != 1) {
+		errno = ERR_NOT_AUTHENTICATED;
+		return -1;
+	}
+	int sock = (int)conn;
+	char buf[MAX_CMD_LEN];
+	snprintf(buf, sizeof buf, "SNAPSHOT\n");
+	if (sendall(sock, buf, strlen(buf)) != 0 || recvline(sock, buf, sizeof buf) != 0) {
+		errno = ERR_CONNECTION_FAIL;
+		return -1;
+	}
+	if (strcmp (buf, "-2") == 0) {
+		errno = ERR_INVALID_PARAM;
+		return -1;
+	}
+	if (buf[0] == '-' || sscanf (buf, "%lu", seq) != 1) {
+		errno = ERR_UNKNOWN;
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * @brief This is used to read the progress of the last snapshot
+ */
+int storage_snapshot_status(struct storage_snapshot_status *status, void *conn) {
+	if (!conn || !status) {
+		errno = ERR_INVALID_PARAM;
+		return -1;
+	}
+	if (auth != 1) {
+		errno = ERR_NOT_AUTHENTICATED;
+		return -1;
+	}
+	int sock = (int)conn;
+	char buf[MAX_CMD_LEN];
+	snprintf(buf, sizeof buf, "SNAPSHOT STATUS\n");
+	if (sendall(sock, buf, strlen(buf)) != 0 || recvline(sock, buf, sizeof buf) != 0) {
+		errno = ERR_CONNECTION_FAIL;
+		return -1;
+	}
+	if (sscanf (buf, "%19s %lu %d %d %lu", status->state, &status->seq, &status->tables_done,
+			&status->tables_total, &status->rows_done) != 5) {
+		errno = ERR_UNKNOWN;
+		return -1;
+	}
+	return 0;
+}
 
 /**
  * @brief This is used to disconnect the connection
@@ -480,6 +1127,7 @@ int storage_disconnect(void *conn)
 		return -1;
 	}
 	auth = 0;
+	storage_cache_clear();
 	int status = close(sock);
 	if (status == -1) {
 		errno = ERR_UNKNOWN;
@@ -145,13 +145,275 @@ int storage_set(const char *table, const char *key, struct storage_record
  * ERR_KEY_NOT_FOUND, ERR_NOT_AUTHENTICATED, or ERR_UNKNOWN.
  *
  * Each predicate consists of a column name, an operator, and a value, each
- * separated by optional whitespace. The operator may be a "=" for string
- * types, or one of "<, >, =" for int and float types. An example of query
- * predicates is "name = bob, mark > 90".
+ * separated by optional whitespace. The operator may be one of "=, !=, <,
+ * <=, >, >=" (strings compare in byte order). "col BETWEEN low AND high"
+ * matches values from low to high, and "col IN (a, b, c)" any of the listed
+ * values. Predicates joined by OR match if any of them does; the comma
+ * separated items must all match. An example of query predicates is
+ * "name = bob, mark > 90 OR grade IN (A, B)".
  */
 int storage_query(const char *table, const char *predicates, char **keys, 
 		const int max_keys, void *conn);
 
+/**
+ * @brief Compute an aggregate over the records that meet the predicates.
+ *
+ * The server computes it in a single pass over the table, so no keys or
+ * records are transferred.
+ *
+ * @param table A table in the database.
+ * @param expr "COUNT(*)", or "SUM(col)", "MIN(col)", "MAX(col)" or
+ * "AVG(col)" for an int column col.
+ * @param predicates A comma separated list of predicates, as for
+ * storage_query().  An empty string aggregates every record.
+ * @param result Set to the value of the aggregate (0 if no record matches).
+ * @param conn A connection to the server.
+ * @return Return the number of records aggregated if successful, and -1
+ * otherwise.
+ *
+ * On error, errno will be set to one of the following, as appropriate:
+ * ERR_INVALID_PARAM, ERR_CONNECTION_FAIL, ERR_TABLE_NOT_FOUND,
+ * ERR_NOT_AUTHENTICATED, or ERR_UNKNOWN.
+ */
+int storage_aggregate(const char *table, const char *expr, const char *predicates,
+		double *result, void *conn);
+
+/**
+ * @brief Fetch chosen columns of every record that meets the predicates.
+ *
+ * The server answers all rows in one response, naming the columns once, so
+ * fetching n records takes one round trip instead of n + 1.
+ *
+ * @param table A table in the database.
+ * @param columns A comma separated list of column names (without spaces),
+ * or "*" for all columns.
+ * @param predicates A comma separated list of predicates, as for
+ * storage_query().  An empty string selects every record.
+ * @param row Called for every record with the number of columns, their
+ * names, the key, the values of the columns, and arg.  The strings are only
+ * valid during the call.
+ * @param arg Passed to row.
+ * @param conn A connection to the server.
+ * @return Return the number of records if successful, and -1 otherwise.
+ *
+ * On error, errno will be set to one of the following, as appropriate:
+ * ERR_INVALID_PARAM, ERR_CONNECTION_FAIL, ERR_TABLE_NOT_FOUND,
+ * ERR_NOT_AUTHENTICATED, or ERR_UNKNOWN.
+ */
+int storage_select(const char *table, const char *columns, const char *predicates,
+		void (*row)(int num_columns, char **names, const char *key, char **values, void *arg),
+		void *arg, void *conn);
+
+/**
+ * @brief Prepare a query that will be run several times.
+ *
+ * The server parses the predicates once and keeps the compiled query for
+ * this connection, so storage_execute() skips all parsing.
+ *
+ * @param table A table in the database.
+ * @param predicates A comma separated list of predicates, as for
+ * storage_query().  An empty string matches every record.
+ * @param conn A connection to the server.
+ * @return Return a handle for storage_execute() (above 0) if successful,
+ * and -1 otherwise.
+ *
+ * On error, errno will be set to one of the following, as appropriate:
+ * ERR_INVALID_PARAM, ERR_CONNECTION_FAIL, ERR_TABLE_NOT_FOUND,
+ * ERR_NOT_AUTHENTICATED, or ERR_UNKNOWN.
+ */
+int storage_prepare(const char *table, const char *predicates, void *conn);
+
+/**
+ * @brief Run a query prepared with storage_prepare().
+ *
+ * @param handle The handle returned by storage_prepare().
+ * @param keys An array of strings for the matching keys, as for
+ * storage_query().
+ * @param max_keys The size of the keys array.
+ * @param conn The connection the query was prepared on.
+ * @return Return the number of matching keys (which may be more than
+ * max_keys) if successful, and -1 otherwise.
+ *
+ * On error, errno will be set to one of the following, as appropriate:
+ * ERR_INVALID_PARAM (also when the server dropped the query from its cache;
+ * prepare it again), ERR_CONNECTION_FAIL, ERR_NOT_AUTHENTICATED, or
+ * ERR_UNKNOWN.
+ */
+int storage_execute(int handle, char **keys, const int max_keys, void *conn);
+
+/**
+ * @brief List the keys of a table within a range, in key order.
+ *
+ * The server finds the first key of the range in its ordered key index and
+ * reads the following keys in order, so the cost grows with the log of the
+ * table size plus the number of keys returned.
+ *
+ * @param table A table in the database.
+ * @param start The lowest key of the range, or NULL for no lower bound.
+ * @param end The highest key of the range (included), or NULL for no upper
+ * bound.
+ * @param keys An array of strings for the keys, as for storage_query().
+ * @param max_keys The size of the keys array; at most this many keys are
+ * returned.
+ * @param conn A connection to the server.
+ * @return Return the number of keys returned if successful, and -1
+ * otherwise.
+ *
+ * On error, errno will be set to one of the following, as appropriate:
+ * ERR_INVALID_PARAM, ERR_CONNECTION_FAIL, ERR_TABLE_NOT_FOUND,
+ * ERR_NOT_AUTHENTICATED, or ERR_UNKNOWN.
+ */
+int storage_scan(const char *table, const char *start, const char *end, char **keys, const int max_keys, void *conn);
+
+/**
+ * @brief Statistics of a column, as returned by storage_stats().
+ */
+struct storage_column_stats {
+	char name[MAX_COLNAME_LEN];	///< Column name.
+	int is_int;	///< 1 for an int column, 0 for a string column.
+	unsigned long distinct;	///< Estimated number of distinct values.
+	char min[MAX_STRTYPE_SIZE];	///< Smallest value ("" if the table is empty).
+	char max[MAX_STRTYPE_SIZE];	///< Largest value ("" if the table is empty).
+	int num_buckets;	///< Buckets of the histogram (int columns only).
+	long bounds[16];	///< Largest value of every bucket.
+	unsigned long counts[16];	///< Rows in every bucket.
+};
+
+/**
+ * @brief Read the statistics the server keeps on the columns of a table.
+ *
+ * Int columns come with an equi-depth histogram: buckets holding about the
+ * same number of rows, each ending at its bound.
+ *
+ * @param table A table in the database.
+ * @param rows Set to the number of records of the table.
+ * @param columns An array filled with the statistics of the columns.
+ * @param max_columns The size of the columns array.
+ * @param conn A connection to the server.
+ * @return Return the number of columns filled if successful, and -1
+ * otherwise.
+ *
+ * On error, errno will be set to one of the following, as appropriate:
+ * ERR_INVALID_PARAM, ERR_CONNECTION_FAIL, ERR_TABLE_NOT_FOUND,
+ * ERR_NOT_AUTHENTICATED, or ERR_UNKNOWN.
+ */
+int storage_stats(const char *table, unsigned long *rows, struct storage_column_stats *columns, const int max_columns, void *conn);
+
+/**
+ * @brief Kinds of changes returned by storage_wait().
+ */
+#define STORAGE_CHANGE_SET 0	///< A watched record was inserted or edited.
+#define STORAGE_CHANGE_DELETE 1	///< A record was deleted, or no longer matches the predicates.
+#define STORAGE_CHANGE_RESYNC 2	///< Changes were dropped; read the watched records again.
+
+/**
+ * @brief A change to a watched table, as returned by storage_wait().
+ */
+struct storage_change {
+	int type;	///< One of the STORAGE_CHANGE_* kinds.
+	char table[MAX_TABLE_LEN];	///< The table changed ("" for a resync).
+	char key[MAX_KEY_LEN];	///< The key changed ("" for a resync).
+	struct storage_record record;	///< The new record, for STORAGE_CHANGE_SET.
+};
+
+/**
+ * @brief Subscribe the connection to the changes of a table.
+ *
+ * After every write to the table, the server queues the change for the
+ * connection if the record matches the predicates, to be collected with
+ * storage_wait().  Watching a table again replaces its predicates.
+ *
+ * @param table A table in the database.
+ * @param predicates The records to watch, as for storage_query(), or NULL
+ * for all of them.
+ * @param conn A connection to the server.
+ * @return Return 0 if successful, and -1 otherwise.
+ *
+ * On error, errno will be set to one of the following, as appropriate:
+ * ERR_INVALID_PARAM (also when the connection already watches 8 tables),
+ * ERR_CONNECTION_FAIL, ERR_TABLE_NOT_FOUND, ERR_NOT_AUTHENTICATED, or
+ * ERR_UNKNOWN.
+ */
+int storage_watch(const char *table, const char *predicates, void *conn);
+
+/**
+ * @brief Stop watching a table, and drop its changes not collected yet.
+ *
+ * @param table A table watched by the connection.
+ * @param conn A connection to the server.
+ * @return Return 0 if successful, and -1 otherwise.
+ *
+ * On error, errno will be set to one of the following, as appropriate:
+ * ERR_INVALID_PARAM (also when the table is not watched),
+ * ERR_CONNECTION_FAIL, ERR_NOT_AUTHENTICATED, or ERR_UNKNOWN.
+ */
+int storage_unwatch(const char *table, void *conn);
+
+/**
+ * @brief Wait for changes to the watched tables.
+ *
+ * Returns as soon as changes are queued, or after the timeout.  The server
+ * keeps only the latest change of every key, so records that change often
+ * between two calls are returned once.  If a client falls so far behind
+ * that its queue fills up, the queue is dropped and the first change
+ * returned is a STORAGE_CHANGE_RESYNC: the client should then read the
+ * records it watches again.  The records changed are also dropped from the
+ * local cache of storage_get().
+ *
+ * @param timeout_ms Milliseconds to wait for a change.
+ * @param changes An array filled with the changes, oldest key first.
+ * @param max_changes The size of the changes array; further changes stay
+ * queued on the server.
+ * @param conn A connection to the server.
+ * @return Return the number of changes filled (0 after a timeout) if
+ * successful, and -1 otherwise.
+ *
+ * On error, errno will be set to one of the following, as appropriate:
+ * ERR_INVALID_PARAM (also when the connection watches no table),
+ * ERR_CONNECTION_FAIL, ERR_NOT_AUTHENTICATED, or ERR_UNKNOWN.
+ */
+int storage_wait(int timeout_ms, struct storage_change *changes, const int max_changes, void *conn);
+
+/**
+ * @brief Progress of the last snapshot, as returned by storage_snapshot_status().
+ */
+struct storage_snapshot_status {
+	char state[20];	///< "idle", "running", "done" or "failed".
+	unsigned long seq;	///< Sequence number of the snapshot.
+	int tables_done;	///< Tables written so far.
+	int tables_total;	///< Tables in the snapshot.
+	unsigned long rows_done;	///< Rows written so far.
+};
+
+/**
+ * @brief Ask the server to write a snapshot of all tables.
+ *
+ * The snapshot is written in the background into "snapshot-<seq>" in the
+ * server's data directory while the server keeps serving requests.
+ *
+ * @param seq Set to the sequence number of the snapshot (or of the snapshot
+ * that is already being written).
+ * @param conn A connection to the server.
+ * @return Return 0 if successful, and -1 otherwise.
+ *
+ * On error, errno will be set to one of the following, as appropriate:
+ * ERR_INVALID_PARAM (the server keeps its tables in memory only),
+ * ERR_CONNECTION_FAIL, ERR_NOT_AUTHENTICATED, or ERR_UNKNOWN.
+ */
+int storage_snapshot(unsigned long *seq, void *conn);
+
+/**
+ * @brief Read the progress of the last snapshot.
+ *
+ * @param status Filled with the progress.
+ * @param conn A connection to the server.
+ * @return Return 0 if successful, and -1 otherwise.
+ *
+ * On error, errno will be set to one of the following, as appropriate:
+ * ERR_INVALID_PARAM, ERR_CONNECTION_FAIL, ERR_NOT_AUTHENTICATED, or ERR_UNKNOWN.
+ */
+int storage_snapshot_status(struct storage_snapshot_status *status, void *conn);
+
 /**
  * @brief Close the connection to the server.
  *
@@ -164,4 +426,29 @@ int storage_query(const char *table, const char *predicates, char **keys,
  */
 int storage_disconnect(void *conn);
 
+/**
+ * @brief Enable the client-side read cache used by storage_get().
+ *
+ * @param max_entries The max number of rows kept in the cache.  The least
+ * recently used row is evicted when the cache is full.  Pass 0 to disable
+ * the cache (the default).
+ * @param max_age_ms Cached rows younger than this many milliseconds are
+ * returned without contacting the server.  Older rows are revalidated with
+ * a version check, which only transfers the value if it has changed.  Pass 0
+ * to revalidate on every read.
+ * @return Return 0 if successful, and -1 otherwise.
+ *
+ * On error, errno will be set to one of the following, as appropriate:
+ * ERR_INVALID_PARAM or ERR_UNKNOWN.
+ *
+ * Rows written with storage_set() on this client are dropped from the cache.
+ * The cache is cleared by storage_disconnect().
+ */
+int storage_cache_enable(const int max_entries, const int max_age_ms);
+
+/**
+ * @brief Drop every row from the client-side read cache.
+ */
+void storage_cache_clear();
+
 #endif
@@ -0,0 +1,441 @@
+/**
+ * @file
+ * @brief This file implements reading and writing of table files as declared
+ * in tablefile.h.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "tablefile.h"
+#include "bufpool.h"
+#include "colstats.h"
+#include "file.h"
+
+/// Lookup table for crc32(), filled on first use.
+static uint32_t crcTable[256];
+static pthread_once_t crcOnce = PTHREAD_ONCE_INIT;
+
+// Fills crcTable for the reflected CRC-32 polynomial.
+static void crc_init () {
+	uint32_t c;
+	int n, k;
+	for (n = 0; n < 256; n++) {
+		c = (uint32_t) n;
+		for (k = 0; k < 8; k++)
+			c = (c & 1) ? 0xEDB88320U ^ (c >> 1) : c >> 1;
+		crcTable[n] = c;
+	}
+}
+
+// Extends a CRC-32 that is not yet finalized (start with 0xFFFFFFFF) over a buffer.
+static uint32_t crc_update (uint32_t c, const unsigned char* buf, size_t len) {
+	size_t i;
+	pthread_once (&crcOnce, crc_init);
+	for (i = 0; i < len; i++)
+		c = crcTable[(c ^ buf[i]) & 0xFF] ^ (c >> 8);
+	return c;
+}
+
+/**
+ * @brief Computes the CRC-32 of a buffer.
+ * @return Returns the checksum.
+ */
+uint32_t tablefile_crc32 (const unsigned char* buf, size_t len) {
+	return crc_update (0xFFFFFFFFU, buf, len) ^ 0xFFFFFFFFU;
+}
+
+// Returns the size of a column's field in a row.
+static int tablefile_width (int type) {
+	return type == -1 ? MAX_STRTYPE_SIZE : type;
+}
+
+/**
+ * @brief Returns the size of a row of the table.
+ */
+int tablefile_row_width (struct table* node) {
+	int i;
+	int width = MAX_KEY_LEN + sizeof(uint32_t);
+	for (i = 0; i < node->numCol; i++)
+		width += tablefile_width (node->type[i]);
+	return width;
+}
+
+/**
+ * @brief Lays out a row (which must be zeroed) from a key, a version and column values.
+ */
+void tablefile_encode_row (struct table* node, char* row, const char* key, uint32_t version, char** values) {
+	int i, width;
+	int offset = MAX_KEY_LEN + sizeof version;
+	strncpy (row, key, MAX_KEY_LEN - 1);
+	memcpy (row + MAX_KEY_LEN, &version, sizeof version);
+	for (i = 0; i < node->numCol; i++) {
+		width = tablefile_width (node->type[i]);
+		strncpy (row + offset, values[i], width - 1);
+		offset += width;
+	}
+}
+
+/**
+ * @brief Reads the key and column values of a row.
+ * @return Returns the version stored in the row.
+ */
+uint32_t tablefile_decode_row (struct table* node, const char* row, char* key, char fields[][MAX_STRTYPE_SIZE]) {
+	uint32_t version;
+	int i, width;
+	int offset = MAX_KEY_LEN + sizeof version;
+	memcpy (key, row, MAX_KEY_LEN);
+	key[MAX_KEY_LEN - 1] = '\0';
+	memcpy (&version, row + MAX_KEY_LEN, sizeof version);
+	for (i = 0; i < node->numCol; i++) {
+		width = tablefile_width (node->type[i]);
+		memcpy (fields[i], row + offset, width);
+		fields[i][width - 1] = '\0';
+		offset += width;
+	}
+	return version;
+}
+
+// Loads a table file in the old text format (key and values separated by tabs).
+static int tablefile_load_text (struct table* node, FILE* in) {
+	char line[MAX_CMD_LEN];
+	char* values[MAX_COLUMNS_PER_TABLE];
+	char* save;
+	char* key;
+	int i, len;
+
+	while (fgets (line, sizeof line, in) != NULL) {
+		len = strlen (line);
+		if (len > 0 && line[len - 1] == '\n')
+			line[len - 1] = '\0';
+		if (line[0] == '#') {
+			sscanf (line, "#seq %lu", &node->snapSeq);
+			continue;
+		}
+		key = strtok_r (line, "\t", &save);
+		if (key == NULL)
+			continue;
+		if (strlen (key) > MAX_KEY_LEN - 1)
+			key[MAX_KEY_LEN - 1] = '\0';
+		for (i = 0; i < node->numCol; i++) {
+			values[i] = strtok_r (NULL, "\t", &save);
+			if (values[i] == NULL)
+				return -1;
+			values[i] = trim (values[i]);
+		}
+		if (putEntry (node, key, values, 1) == -1)
+			return -1;
+	}
+	return 0;
+}
+
+// Loads a binary table file, TABLEFILE_CHUNK bytes of rows at a time, so that
+// the rows of a pooled table go through the buffer pool as they are read.
+static int tablefile_load_binary (struct table* node, int fd, size_t size) {
+	struct tablefile_header header;
+	char chunk[TABLEFILE_CHUNK];
+	char key[MAX_KEY_LEN];
+	char fields[MAX_COLUMNS_PER_TABLE][MAX_STRTYPE_SIZE];
+	char* values[MAX_COLUMNS_PER_TABLE];
+	uint32_t version;
+	uint32_t crc;
+	uint32_t r, n, chunkRows;
+	off_t offset;
+	int i;
+
+	if (size < sizeof header || pread (fd, &header, sizeof header, 0) != sizeof header)
+		return -1;
+	if (header.headerCrc != tablefile_crc32 ((const unsigned char*)&header, offsetof(struct tablefile_header, headerCrc)))
+		return -1;
+	// The schema in the config file must match the one the file was written with.
+	if (header.numCol != node->numCol || header.rowWidth != tablefile_row_width (node))
+		return -1;
+	for (i = 0; i < node->numCol; i++) {
+		if (header.type[i] != node->type[i])
+			return -1;
+	}
+	if (size != sizeof header + (size_t)header.numRows * header.rowWidth)
+		return -1;
+	chunkRows = sizeof chunk / header.rowWidth;
+
+	// Check every row before loading any.
+	crc = 0xFFFFFFFFU;
+	offset = sizeof header;
+	for (r = 0; r < header.numRows; r += n) {
+		n = header.numRows - r < chunkRows ? header.numRows - r : chunkRows;
+		if (pread (fd, chunk, (size_t)n * header.rowWidth, offset) != (ssize_t)n * header.rowWidth)
+			return -1;
+		crc = crc_update (crc, (const unsigned char*)chunk, (size_t)n * header.rowWidth);
+		offset += (off_t)n * header.rowWidth;
+	}
+	if (header.rowsCrc != (crc ^ 0xFFFFFFFFU))
+		return -1;
+
+	node->snapSeq = header.seq;
+	for (i = 0; i < node->numCol; i++)
+		values[i] = fields[i];
+	offset = sizeof header;
+	for (r = 0; r < header.numRows; r += n) {
+		n = header.numRows - r < chunkRows ? header.numRows - r : chunkRows;
+		if (pread (fd, chunk, (size_t)n * header.rowWidth, offset) != (ssize_t)n * header.rowWidth)
+			return -1;
+		offset += (off_t)n * header.rowWidth;
+		for (i = 0; i < n; i++) {
+			version = tablefile_decode_row (node, chunk + (size_t)i * header.rowWidth, key, fields);
+			if (putEntry (node, key, values, version) == -1)
+				return -1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief Loads a table file into an empty table.
+ * @return Returns 0 on success, -1 otherwise.
+ */
+int tablefile_load (struct table* node, const char* path) {
+	struct stat info;
+	char magic[8];
+	int status;
+
+	node->snapSeq = 0;
+	// Rows loaded here bypass setEntry(), so the column statistics are rebuilt on next use.
+	colstats_invalidate (node);
+	int fd = open (path, O_RDONLY);
+	if (fd < 0)
+		return 0;	// Nothing stored for this table yet.
+	if (fstat (fd, &info) != 0) {
+		close (fd);
+		return -1;
+	}
+	if (info.st_size == 0) {
+		close (fd);
+		return 0;
+	}
+	posix_fadvise (fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	if (info.st_size >= 8 && pread (fd, magic, 8, 0) == 8 && memcmp (magic, TABLEFILE_MAGIC, 8) == 0) {
+		status = tablefile_load_binary (node, fd, info.st_size);
+	}
+	else {
+		FILE* in = fdopen (dup (fd), "r");
+		status = in == NULL ? -1 : tablefile_load_text (node, in);
+		if (in != NULL)
+			fclose (in);
+	}
+	close (fd);
+	return status;
+}
+
+/**
+ * @brief Reads the sequence number from the header (or first line) of a table file.
+ * @return Returns 0 on success, -1 otherwise.
+ */
+int tablefile_read_seq (const char* path, unsigned long* seq) {
+	struct tablefile_header header;
+	char line[MAX_CMD_LEN];
+	int status = 0;
+
+	*seq = 0;
+	FILE* in = fopen (path, "r");
+	if (in == NULL)
+		return 0;	// Nothing stored for this table yet.
+	if (fread (&header, sizeof header, 1, in) == 1 && memcmp (header.magic, TABLEFILE_MAGIC, 8) == 0) {
+		if (header.headerCrc != tablefile_crc32 ((const unsigned char*)&header, offsetof(struct tablefile_header, headerCrc)))
+			status = -1;
+		else
+			*seq = header.seq;
+	}
+	else {
+		// Old text files start with their "#seq" line, if they have one.
+		rewind (in);
+		if (fgets (line, sizeof line, in) != NULL)
+			sscanf (line, "#seq %lu", seq);
+	}
+	fclose (in);
+	return status;
+}
+
+/**
+ * @brief Arguments and result of one table loading thread.
+ */
+struct tablefile_job {
+	/// The table to load.
+	struct table* node;
+	/// Path of its file.
+	char path[MAX_PATH_LEN];
+	/// Result of tablefile_load().
+	int status;
+};
+
+// Thread body that loads one table.
+static void* tablefile_load_thread (void* ptr) {
+	struct tablefile_job* job = ptr;
+	job->status = tablefile_load (job->node, job->path);
+	return NULL;
+}
+
+/**
+ * @brief Loads every table on its own thread.
+ * @return Returns 0 if all tables loaded, -1 otherwise.
+ */
+int tablefile_load_all (struct table* head, const char* dir) {
+	struct tablefile_job jobs[MAX_TABLES];
+	pthread_t threads[MAX_TABLES];
+	int started[MAX_TABLES];
+	char buff[MAX_PATH_LEN + 50];
+	struct table* node;
+	int numJobs = 0;
+	int result = 0;
+	int i;
+
+	for (node = head; node != NULL && numJobs < MAX_TABLES; node = node->next) {
+		jobs[numJobs].node = node;
+		snprintf (jobs[numJobs].path, MAX_PATH_LEN, "%s%s", dir, node->name);
+		jobs[numJobs].status = -1;
+		// Pooled tables share the buffer pool's clock, so they are loaded one at a time.
+		started[numJobs] = node->pool == NULL
+				&& pthread_create (&threads[numJobs], NULL, tablefile_load_thread, &jobs[numJobs]) == 0;
+		// Otherwise (or if no thread could be created) load it on this thread.
+		if (!started[numJobs])
+			tablefile_load_thread (&jobs[numJobs]);
+		numJobs += 1;
+	}
+	for (i = 0; i < numJobs; i++) {
+		if (started[i])
+			pthread_join (threads[i], NULL);
+		if (jobs[i].status != 0) {
+			sprintf (buff, "Error loading table file %s.\n", jobs[i].path);
+			result = -1;
+		}
+		else
+			sprintf (buff, "Loaded %d entries from %s.\n", jobs[i].node->numEntries, jobs[i].path);
+		if (LOGGING == 1) logger(stdout, buff);
+		else if (LOGGING == 2) logger(file, buff);
+	}
+	return result;
+}
+
+/**
+ * @brief A table file being written: a temporary file that is renamed over the
+ * table file once complete.
+ */
+struct tablefile_out {
+	FILE* out;
+	/// Table files of snapshots are in a directory below the data directory.
+	char tmp[MAX_PATH_LEN * 2];
+	struct tablefile_header header;
+	/// CRC-32 of the rows written so far, not yet finalized.
+	uint32_t crc;
+};
+
+// Creates the temporary file and leaves room for the header.  Returns 0 on success, -1 otherwise.
+static int tablefile_begin (struct tablefile_out* w, struct table* node, const char* path, unsigned long seq) {
+	int i;
+	memset (&w->header, 0, sizeof w->header);
+	memcpy (w->header.magic, TABLEFILE_MAGIC, 8);
+	w->header.numCol = node->numCol;
+	for (i = 0; i < node->numCol; i++)
+		w->header.type[i] = node->type[i];
+	w->header.rowWidth = tablefile_row_width (node);
+	w->header.seq = seq;
+	w->crc = 0xFFFFFFFFU;
+	if (snprintf (w->tmp, sizeof w->tmp, "%s.tmp", path) >= sizeof w->tmp)
+		return -1;
+	w->out = fopen (w->tmp, "w");
+	if (w->out == NULL)
+		return -1;
+	if (fwrite (&w->header, sizeof w->header, 1, w->out) != 1) {
+		fclose (w->out);
+		unlink (w->tmp);
+		return -1;
+	}
+	return 0;
+}
+
+// Appends rows laid out with tablefile_encode_row().  Returns 0 on success, -1 otherwise.
+static int tablefile_put (struct tablefile_out* w, const char* rows, uint32_t numRows) {
+	if (numRows == 0)
+		return 0;
+	if (fwrite (rows, w->header.rowWidth, numRows, w->out) != numRows)
+		return -1;
+	w->crc = crc_update (w->crc, (const unsigned char*)rows, (size_t)numRows * w->header.rowWidth);
+	w->header.numRows += numRows;
+	return 0;
+}
+
+// Writes the header, syncs the file and renames it over the table file, or drops it
+// if status is not 0.  Returns 0 on success, -1 otherwise.
+static int tablefile_finish (struct tablefile_out* w, const char* path, int status) {
+	w->header.rowsCrc = w->crc ^ 0xFFFFFFFFU;
+	w->header.headerCrc = tablefile_crc32 ((const unsigned char*)&w->header, offsetof(struct tablefile_header, headerCrc));
+	if (status != 0 || fseek (w->out, 0, SEEK_SET) != 0
+			|| fwrite (&w->header, sizeof w->header, 1, w->out) != 1
+			|| fflush (w->out) != 0 || fsync (fileno (w->out)) != 0) {
+		fclose (w->out);
+		unlink (w->tmp);
+		return -1;
+	}
+	fclose (w->out);
+	if (rename (w->tmp, path) != 0) {
+		unlink (w->tmp);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * @brief Writes the table to a temporary file and renames it over the table file.
+ * @return Returns 0 on success, -1 otherwise.
+ */
+int tablefile_write (struct table* node, const char* path, unsigned long seq) {
+	struct tablefile_out w;
+	struct hashEntry* entry;
+	char chunk[TABLEFILE_CHUNK];
+	char* values[MAX_COLUMNS_PER_TABLE];
+	int width = tablefile_row_width (node);
+	uint32_t chunkRows = sizeof chunk / width;
+	uint32_t n = 0;
+	int numProbed = 0;
+	int status = 0;
+	int i;
+
+	if (tablefile_begin (&w, node, path, seq) != 0)
+		return -1;
+	// Rows are laid out a chunk at a time, so a pooled table is never all resident.
+	memset (chunk, 0, sizeof chunk);
+	if (node->numEntries > 0)
+		entry = node->entries[node->headIndex];
+	while (node->numEntries > numProbed && status == 0) {
+		bufpool_touch (node, entry, 0);
+		for (i = 0; i < node->numCol; i++)
+			values[i] = entry->value[i];
+		tablefile_encode_row (node, chunk + (size_t)n * width, entry->key, entry->transac_count, values);
+		n += 1;
+		if (n == chunkRows) {
+			status = tablefile_put (&w, chunk, n);
+			memset (chunk, 0, sizeof chunk);
+			n = 0;
+		}
+		entry = entry->next;
+		numProbed += 1;
+	}
+	if (status == 0)
+		status = tablefile_put (&w, chunk, n);
+	return tablefile_finish (&w, path, status);
+}
+
+/**
+ * @brief Writes rows laid out with tablefile_encode_row() as the table file of a table.
+ * @return Returns 0 on success, -1 otherwise.
+ */
+int tablefile_write_rows (struct table* node, const char* path, unsigned long seq, const char* rows, uint32_t numRows) {
+	struct tablefile_out w;
+	if (tablefile_begin (&w, node, path, seq) != 0)
+		return -1;
+	return tablefile_finish (&w, path, tablefile_put (&w, rows, numRows));
+}
@@ -0,0 +1,147 @@
+/**
+ * @file
+ * @brief This file declares the functions that read and write the table
+ * files kept in the data directory by the on-disk storage policy.
+ *
+ * Table files are binary: a fixed header followed by fixed-width rows.  Each
+ * row holds the key, the entry's transaction count and one field per column
+ * (MAX_STRTYPE_SIZE bytes for ints, the declared size for chars), all NUL
+ * padded.  The header records the schema, the sequence number of the last
+ * write-ahead log record contained in the file and a CRC-32 of the rows.
+ *
+ * Text files written by older servers (one tab separated line per entry) are
+ * still read, and are replaced by the binary format at the next checkpoint.
+ */
+
+#ifndef TABLEFILE_H
+#define TABLEFILE_H
+
+#include <stdint.h>
+#include "utils.h"
+
+/**
+ * @brief Magic bytes at the start of a binary table file.
+ */
+#define TABLEFILE_MAGIC "STBLv001"
+
+/**
+ * @brief Bytes of rows read or written at a time.  Table files are streamed
+ * rather than held in memory whole, so that loading or writing a table stays
+ * within the memory limit of the buffer pool.
+ */
+#define TABLEFILE_CHUNK (64 * 1024)
+
+/**
+ * @brief Header of a binary table file.
+ */
+struct tablefile_header {
+	/// TABLEFILE_MAGIC, without the terminating NUL.
+	char magic[8];
+	/// Number of columns.
+	uint32_t numCol;
+	/// Column types, as in struct table.
+	int32_t type[MAX_COLUMNS_PER_TABLE];
+	/// Size in bytes of every row.
+	uint32_t rowWidth;
+	/// Number of rows following the header.
+	uint32_t numRows;
+	/// Sequence number of the last write-ahead log record contained in the file.
+	uint64_t seq;
+	/// CRC-32 of all the rows.
+	uint32_t rowsCrc;
+	/// CRC-32 of the header up to (not including) this field.
+	uint32_t headerCrc;
+};
+
+/**
+ * @brief Load a table file into an (empty) table.
+ *
+ * @param node The table to fill.
+ * @param path The path of the table file.
+ * @return Return 0 on success (including when the file does not exist yet),
+ * -1 otherwise (unreadable file, schema mismatch or bad checksum).
+ *
+ * node->snapSeq is set from the file's header, or to 0 for text files without
+ * one.  Rows are inserted directly into the hash table without going through
+ * setEntry(), so several tables can be loaded at once from different threads.
+ */
+int tablefile_load(struct table* node, const char* path);
+
+/**
+ * @brief Read the log sequence number a table file was written at, without
+ * loading it.
+ *
+ * @param path The path of the table file.
+ * @param seq Set to the sequence number (0 if the file does not exist).
+ * @return Return 0 on success, -1 if the file cannot be read or is corrupt.
+ */
+int tablefile_read_seq(const char* path, unsigned long* seq);
+
+/**
+ * @brief Load the files of all tables in the data directory, one thread per
+ * table.
+ *
+ * @param head The first table of the server.
+ * @param dir The data directory (ending with '/').
+ * @return Return 0 if every table loaded, -1 otherwise.
+ */
+int tablefile_load_all(struct table* head, const char* dir);
+
+/**
+ * @brief Atomically replace a table file with the contents of a table.
+ *
+ * @param node The table to write.
+ * @param path The path of the table file.
+ * @param seq The log sequence number the contents correspond to.
+ * @return Return 0 on success, -1 otherwise.
+ *
+ * The data is written to a temporary file, synced, and renamed over the old
+ * file, so a crash leaves either the old or the new file in place.
+ */
+int tablefile_write(struct table* node, const char* path, unsigned long seq);
+
+/**
+ * @brief Atomically replace a table file with the given rows.
+ *
+ * @param node The table the rows belong to (only its schema is used).
+ * @param path The path of the table file.
+ * @param seq The log sequence number the rows correspond to.
+ * @param rows numRows rows laid out with tablefile_encode_row().
+ * @param numRows The number of rows, which may exceed MAX_RECORDS_PER_TABLE.
+ * @return Return 0 on success, -1 otherwise.
+ */
+int tablefile_write_rows(struct table* node, const char* path, unsigned long seq, const char* rows, uint32_t numRows);
+
+/**
+ * @brief Return the size in bytes of a row of the table in a table file.
+ */
+int tablefile_row_width(struct table* node);
+
+/**
+ * @brief Lay out a row in the table file format.
+ *
+ * @param node The table the row belongs to.
+ * @param row The row buffer, tablefile_row_width() bytes, zeroed.
+ * @param key The key.
+ * @param version The transaction count of the entry.
+ * @param values One string per column.
+ */
+void tablefile_encode_row(struct table* node, char* row, const char* key, uint32_t version, char** values);
+
+/**
+ * @brief Read a row in the table file format.
+ *
+ * @param node The table the row belongs to.
+ * @param row The row.
+ * @param key Receives the key (MAX_KEY_LEN bytes).
+ * @param fields Receives one string per column.
+ * @return Return the transaction count stored in the row.
+ */
+uint32_t tablefile_decode_row(struct table* node, const char* row, char* key, char fields[][MAX_STRTYPE_SIZE]);
+
+/**
+ * @brief Return the CRC-32 of a buffer.
+ */
+uint32_t tablefile_crc32(const unsigned char* buf, size_t len);
+
+#endif
@@ -0,0 +1,129 @@
+/**
+ * @file
+ * @brief This file implements the bounded heap declared in topk.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "topk.h"
+
+// Returns a negative number if row a comes before row b in the result, positive otherwise.
+static int topk_cmp (const struct topk* heap, const struct topk_row* a, const struct topk_row* b) {
+	int c;
+	if (heap->isInt)
+		c = a->ival < b->ival ? -1 : a->ival > b->ival;
+	else
+		c = strcmp (a->values[heap->col], b->values[heap->col]);
+	if (heap->desc)
+		c = -c;
+	if (c == 0)
+		c = a->seq < b->seq ? -1 : 1;
+	return c;
+}
+
+// Swaps two rows of the heap.
+static void topk_swap (struct topk* heap, int i, int j) {
+	struct topk_row tmp = heap->rows[i];
+	heap->rows[i] = heap->rows[j];
+	heap->rows[j] = tmp;
+}
+
+// Moves row i up until its parent comes after it.
+static void topk_sift_up (struct topk* heap, int i) {
+	while (i > 0 && topk_cmp (heap, &heap->rows[(i - 1) / 2], &heap->rows[i]) < 0) {
+		topk_swap (heap, i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+// Moves row i down until both its children come before it, among the first size rows.
+static void topk_sift_down (struct topk* heap, int i, int size) {
+	int last;
+	while (1) {
+		last = i;
+		if (2 * i + 1 < size && topk_cmp (heap, &heap->rows[2 * i + 1], &heap->rows[last]) > 0)
+			last = 2 * i + 1;
+		if (2 * i + 2 < size && topk_cmp (heap, &heap->rows[2 * i + 2], &heap->rows[last]) > 0)
+			last = 2 * i + 2;
+		if (last == i)
+			return;
+		topk_swap (heap, i, last);
+		i = last;
+	}
+}
+
+/**
+ * @brief Sets up an empty heap sorted on the plan's ORDER BY column.
+ * @return Returns 0 on success, -1 otherwise.
+ */
+int topk_init (struct topk* heap, const struct pred_plan* plan, int limit, int keepValues) {
+	heap->size = 0;
+	heap->alloc = limit > 0 && limit < 64 ? limit : 64;
+	heap->rows = malloc (heap->alloc * sizeof(struct topk_row));
+	heap->limit = limit;
+	heap->col = plan->orderCol;
+	heap->isInt = plan->node->type[plan->orderCol] == -1;
+	heap->desc = plan->orderDesc;
+	heap->keepValues = keepValues;
+	heap->numCol = plan->node->numCol;
+	heap->pushed = 0;
+	return heap->rows == NULL ? -1 : 0;
+}
+
+/**
+ * @brief Pushes a row, dropping the row that comes last once the heap is full.
+ * @return Returns 0 on success, -1 otherwise.
+ */
+int topk_push (struct topk* heap, const char* key, char (*values)[MAX_STRTYPE_SIZE]) {
+	struct topk_row row;
+	struct topk_row* rows;
+
+	strcpy (row.key, key);
+	row.ival = heap->isInt ? atol (values[heap->col]) : 0;
+	row.seq = heap->pushed;
+	heap->pushed += 1;
+	if (heap->keepValues)
+		memcpy (row.values, values, heap->numCol * MAX_STRTYPE_SIZE);	// A row only holds its table's columns.
+	else
+		strcpy (row.values[heap->col], values[heap->col]);
+
+	if (heap->limit > 0 && heap->size == heap->limit) {
+		// Full: the new row only stays if it comes before the current last row.
+		if (topk_cmp (heap, &row, &heap->rows[0]) > 0)
+			return 0;
+		heap->rows[0] = row;
+		topk_sift_down (heap, 0, heap->size);
+		return 0;
+	}
+	if (heap->size == heap->alloc) {
+		rows = realloc (heap->rows, 2 * heap->alloc * sizeof(struct topk_row));
+		if (rows == NULL)
+			return -1;
+		heap->rows = rows;
+		heap->alloc *= 2;
+	}
+	heap->rows[heap->size] = row;
+	heap->size += 1;
+	topk_sift_up (heap, heap->size - 1);
+	return 0;
+}
+
+/**
+ * @brief Heap-sorts the rows into their final order.
+ */
+void topk_sort (struct topk* heap) {
+	int end;
+	for (end = heap->size - 1; end > 0; end--) {
+		topk_swap (heap, 0, end);
+		topk_sift_down (heap, 0, end);
+	}
+}
+
+/**
+ * @brief Frees the rows of the heap.
+ */
+void topk_free (struct topk* heap) {
+	free (heap->rows);
+	heap->rows = NULL;
+	heap->size = 0;
+}
@@ -0,0 +1,82 @@
+/**
+ * @file
+ * @brief This file declares the bounded heap used to answer ORDER BY ...
+ * LIMIT k.
+ *
+ * Matching rows are pushed into a heap of at most k rows whose root is the
+ * row that would come last.  A new row either replaces the root (and sinks
+ * into place) or is dropped, so a query keeps k rows however many match.
+ * topk_sort() then heap-sorts the survivors into their final order.  Without
+ * a limit the heap simply grows, and the result is a full sort.
+ */
+
+#ifndef TOPK_H
+#define TOPK_H
+
+#include "pred.h"
+
+/**
+ * @brief A row kept by the heap.
+ */
+struct topk_row {
+	char key[MAX_KEY_LEN];
+	/// Value of the sort column for int columns.
+	long ival;
+	/// Order in which the row was pushed; ties keep it.
+	unsigned long seq;
+	/// Column values (only copied if the heap keeps values).
+	char values[MAX_COLUMNS_PER_TABLE][MAX_STRTYPE_SIZE];
+};
+
+/**
+ * @brief A bounded heap of rows.
+ */
+struct topk {
+	struct topk_row* rows;
+	/// Rows in the heap, and rows allocated.
+	int size;
+	int alloc;
+	/// Maximum number of rows, or 0 for no limit.
+	int limit;
+	/// Sort column, its type, and 1 for descending order.
+	int col;
+	int isInt;
+	int desc;
+	/// 1 to copy all column values, 0 to keep only the key and the sort column.
+	int keepValues;
+	/// Columns of the rows pushed.
+	int numCol;
+	/// Rows pushed so far.
+	unsigned long pushed;
+};
+
+/**
+ * @brief Set up an empty heap for the ORDER BY clause of a plan.
+ *
+ * @param heap The heap.
+ * @param plan A plan with an ORDER BY clause.
+ * @param limit The maximum number of rows to keep (0 for no limit).
+ * @param keepValues 1 if the rows' values are needed afterwards.
+ * @return Return 0 on success, -1 if out of memory.
+ */
+int topk_init(struct topk* heap, const struct pred_plan* plan, int limit, int keepValues);
+
+/**
+ * @brief Push a row, keeping only the first limit rows in sort order.
+ *
+ * @return Return 0 on success, -1 if out of memory.
+ */
+int topk_push(struct topk* heap, const char* key, char (*values)[MAX_STRTYPE_SIZE]);
+
+/**
+ * @brief Sort the rows of the heap into their final order (heap->rows[0]
+ * first).  No row can be pushed afterwards.
+ */
+void topk_sort(struct topk* heap);
+
+/**
+ * @brief Free the rows of the heap.
+ */
+void topk_free(struct topk* heap);
+
+#endif
@@ -4,68 +4,35 @@
  * can be used by the storage server and client library. 
  */
 
-#define _XOPEN_SOURCE
+// 600 for posix_memalign().
+#define _XOPEN_SOURCE 600
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <unistd.h>
 #include "utils.h"
+#include "wal.h"
+#include "mmaptable.h"
+#include "lsm.h"
+#include "bufpool.h"
+#include "pred.h"
+#include "topk.h"
+#include "keyindex.h"
+#include "workpool.h"
+#include "colstats.h"
+#include "watch.h"
+#include "slab.h"
+#include "dict.h"
+#include "bitmap.h"
+#include "zone.h"
 #include <time.h>
 #include <sys/stat.h>
 #include <errno.h>
 
-/**
- * @brief Parse and process a line across the network.
- */
-int sendall(const int sock, const char *buf, const size_t len)
-{
-	size_t tosend = len;
-	while (tosend > 0) {
-		ssize_t bytes = send(sock, buf, tosend, 0);
-		if (bytes <= 0) 
-			break; // send() was not successful, so stop.
-		tosend -= (size_t) bytes;
-		buf += bytes;
-	};
-
-	return tosend == 0 ? 0 : -1;
-}
-
-/**
- * In order to avoid reading more than a line from the stream,
- * this function only reads one byte at a time.  This is very
- * inefficient, and you are free to optimize it or implement your
- * own function.
- */
-int recvline(const int sock, char *buf, const size_t buflen)
-{
-	int status = 0; // Return status.
-	size_t bufleft = buflen;
-
-	while (bufleft > 1) {
-		// Read one byte from scoket.
-		ssize_t bytes = recv(sock, buf, 1, 0);
-		if (bytes <= 0) {
-			// recv() was not successful, so stop.
-			status = -1;
-			break;
-		} else if (*buf == '\n') {
-			// Found end of line, so stop.
-			*buf = 0; // Replace end of line with a null terminator.
-			status = 0;
-			break;
-		} else {
-			// Keep going.
-			bufleft -= 1;
-			buf += 1;
-		}
-	}
-	*buf = 0; // add null terminator in case it's not already there.
-	return status;
-}
 /**
  * @brief A helper function used to check if a table exists or not
  * @return If successful, return 1 if found, 0 if not found
@@ -149,47 +116,6 @@ int insertEntry (struct hashEntry* entry, struct hashEntry* head) {
 	return 0;
 }
 
-/**
- * @brief Checks if a value meets the specified predicates.
- * @return Returns 0 if value meets the predicates, -1 if it does not, and -2 if the value exceeds the maximum string length.
- */
-// Returns 0 if predicate is met and -1 otherwise
-int checkPred (char* value, int op, char* opvalue, int type) {
-	int isInt = my_strvalidate (opvalue, 2);
-	int isChar = my_strvalidate (opvalue, 4);
-	// Check the < operator
-	if (op == -1 && type == -1 && isInt == 0) {
-		if (atoi(value) < atoi (opvalue))
-			return 0;
-	}
-	else if (op == -1) {
-		return -2;	// Invalid data type.
-	}
-	// Check the == operator
-	else if (op == 0) {
-		if (strlen (value) > MAX_STRTYPE_SIZE - 1) {
-			return -2;
-		}
-		if (strlen (value) > type - 1) {
-			value[type - 1] = '\0';
-		}
-		if (strlen (value) > type || isChar == 1)
-			return -2;
-		if (strcmp (value, opvalue) == 0)
-			return 0;
-	}
-	// Check the > operator
-	else if (op == 1 && type == -1 && isInt == 0) {
-		if (atoi(value) > atoi (opvalue)) {
-			return 0;
-		}
-	}
-	else if (op == 1) {
-		return -2;	// Invalid data type.
-	}
-	return -1;
-}
-
 void initKeys (char*** A, int r, int c) {
 	int i, j;
 	*A = (char **)malloc(sizeof(char *)*r);
@@ -202,16 +128,79 @@ void initKeys (char*** A, int r, int c) {
 	return;
 }
 
-void freeTable (struct table* node) {
-	if (node->next != NULL)
-		freeTable (node->next);
-	int i = 0;
+/**
+ * @brief Allocates an empty table with the given schema.
+ * @return Returns a pointer to the new table.  Its next pointer is NULL.
+ */
+struct table* newTable (const char* name, int numCol, char col[][MAX_COLNAME_LEN], int* type) {
+	int i;
+	struct table* node = malloc (sizeof(struct table));
+	strncpy (node->name, name, MAX_TABLE_LEN - 1);
+	node->name[MAX_TABLE_LEN - 1] = '\0';
+	node->numCol = numCol;
+	for (i = 0; i < numCol; i++) {
+		strcpy (node->col[i], col[i]);
+		node->type[i] = type[i];
+	}
+	node->numEntries = 0;
+	node->headIndex = -1;
+	node->snapSeq = 0;
+	node->map = NULL;
+	node->mapSize = 0;
+	node->lsm = NULL;
+	node->pool = NULL;
+	node->keys = keyindex_new ();
+	node->stats = colstats_new ();
+	node->dict = NULL;
+	node->bitmaps = NULL;
+	node->zones = zone_new ();
+	node->version = 0;
+	node->lastVersion = 0;
+	node->watchers = 0;
+	node->loaded = 1;
+	pthread_mutex_init (&node->loadLock, NULL);
+	node->next = NULL;
+	// Entries and rows come from pages rather than one malloc each.
+	node->entrySlab = slab_new (sizeof(struct hashEntry));
+	node->rowSlab = slab_new (numCol * MAX_STRTYPE_SIZE);
+	// All slots start empty.
+	if (posix_memalign ((void**)&node->slots, SLAB_ALIGN, MAX_RECORDS_PER_TABLE * sizeof(struct slotMeta)) == 0)
+		memset (node->slots, 0, MAX_RECORDS_PER_TABLE * sizeof(struct slotMeta));
 	for (i = 0; i < MAX_RECORDS_PER_TABLE; i++) {
+		node->entries[i] = slab_alloc (node->entrySlab);
+		node->entries[i]->value = slab_alloc (node->rowSlab);
+		node->entries[i]->referenced = 0;
+		node->entries[i]->dirty = 0;
+		node->entries[i]->cold = 0;
+		node->entries[i]->key[0] = '\0';
+		node->entries[i]->transac_count = 1;
 		node->entries[i]->next = NULL;
 		node->entries[i]->prev = NULL;
-		free (node->entries[i]);
-
+		node->entries[i]->deleted = -1;
 	}
+	return node;
+}
+
+void freeTable (struct table* node) {
+	if (node->next != NULL)
+		freeTable (node->next);
+	if (node->lsm != NULL)
+		lsm_close (node);
+	if (node->pool != NULL)
+		bufpool_detach (node);
+	pthread_mutex_destroy (&node->loadLock);
+	keyindex_free (node->keys);
+	colstats_free (node->stats);
+	dict_free (node);
+	bitmap_free (node);
+	zone_free (node->zones);
+	// Mapped entries belong to the table's file.
+	if (node->map != NULL)
+		mmaptable_close (node);
+	// The entries and rows go back page by page.
+	slab_destroy (node->entrySlab);
+	slab_destroy (node->rowSlab);
+	free (node->slots);
 	free (node);
 	return;
 }
@@ -386,17 +375,98 @@ int process_config_line(char *line, struct config_params *params)
 			if (params->data_directory_exist > 1)
 				return 1;
 		}
+		else if (strcmp (value, "mmap") == 0) {
+			params->policy = 2;
+			params->storage_policy_exist = 1;
+		}
+		else if (strcmp (value, "lsm") == 0) {
+			params->policy = 3;
+			params->storage_policy_exist = 1;
+		}
 		else
 			return 1;
 	}
+	else if (strcmp(name, "durability") == 0) {
+		if (parse_flush_policy(value, &params->durability, &params->durability_interval) != 0)
+			return 1;
+	}
+	else if (strcmp(name, "mmap_flush") == 0) {
+		if (parse_flush_policy(value, &params->mmap_flush, &params->mmap_flush_interval) != 0)
+			return 1;
+	}
 	else if (strcmp(name, "data_directory") == 0) {
-		if (params->policy == 1 && params->data_directory_exist == 0) {
+		if (params->policy != 0 && params->data_directory_exist == 0) {
 			strncpy(params->data_directory, value, sizeof params->data_directory);
 			params->data_directory_exist += 1;
 		}
 		else if (params->policy == 0 && params->data_directory_exist == 1)
 			return 1;
 	}
+	else if (strcmp(name, "memory_limit") == 0) {
+		// A number of bytes, optionally followed by K, M or G.
+		char unit = '\0';
+		unsigned long limit;
+		if (sscanf(value, "%lu%c", &limit, &unit) < 1 || value[0] == '-')
+			return 1;
+		if (unit == 'K' || unit == 'k')
+			limit *= 1024;
+		else if (unit == 'M' || unit == 'm')
+			limit *= 1024 * 1024;
+		else if (unit == 'G' || unit == 'g')
+			limit *= 1024 * 1024 * 1024;
+		else if (unit != '\0')
+			return 1;
+		params->memory_limit = limit;
+	}
+	else if (strcmp(name, "table_loading") == 0) {
+		if (strcmp (value, "eager") == 0)
+			params->table_loading = LOAD_EAGER;
+		else if (strcmp (value, "lazy") == 0)
+			params->table_loading = LOAD_LAZY;
+		else if (strcmp (value, "prewarm") == 0)
+			params->table_loading = LOAD_PREWARM;
+		else
+			return 1;
+	}
+	else if (strcmp(name, "query_threads") == 0) {
+		if (my_strvalidate(value, 5) == 1 || atoi(value) < 1)
+			return 1;
+		params->query_threads = atoi(value);
+	}
+	else if (strcmp(name, "query_cache") == 0) {
+		if (my_strvalidate(value, 5) == 1)
+			return 1;
+		params->query_cache = atoi(value);
+	}
+	else if (strcmp(name, "dictionary") == 0) {
+		// "dictionary <table> <column>"
+		char table[MAX_CONFIG_LINE_LEN];
+		char column[MAX_CONFIG_LINE_LEN];
+		if (params->numDict == MAX_TABLES || sscanf(line, "%*s %s %s", table, column) != 2)
+			return 1;
+		if (strlen(table) > MAX_TABLE_LEN - 1 || strlen(column) > MAX_COLNAME_LEN - 1)
+			return 1;
+		strcpy(params->dict_table[params->numDict], table);
+		strcpy(params->dict_col[params->numDict], column);
+		params->numDict += 1;
+	}
+	else if (strcmp(name, "bitmap_index") == 0) {
+		// "bitmap_index <table> <column>"
+		char table[MAX_CONFIG_LINE_LEN];
+		char column[MAX_CONFIG_LINE_LEN];
+		if (params->numBitmap == MAX_TABLES || sscanf(line, "%*s %s %s", table, column) != 2)
+			return 1;
+		if (strlen(table) > MAX_TABLE_LEN - 1 || strlen(column) > MAX_COLNAME_LEN - 1)
+			return 1;
+		strcpy(params->bitmap_table[params->numBitmap], table);
+		strcpy(params->bitmap_col[params->numBitmap], column);
+		params->numBitmap += 1;
+	}
+	else if (strcmp(name, "checkpoint_interval") == 0) {
+		if (my_strvalidate(value, 5) == 1)
+			return 1;
+		params->checkpoint_interval = atoi(value);
+	}
 	else if (strcmp(name, "concurrency") == 0) {
 		if (params->concurrency_exist == 0){
 			if (atoi(value) != 0 && atoi(value) != 1)
@@ -415,6 +485,28 @@ int process_config_line(char *line, struct config_params *params)
 	return 0;
 }
 
+/**
+ * @brief Parses a flush policy ("none", "interval:<ms>" or "sync").
+ * @return Returns 0 on success, 1 if the value is invalid.
+ */
+int parse_flush_policy(char *value, int *mode, int *interval)
+{
+	*interval = 0;
+	if (strcmp(value, "none") == 0)
+		*mode = FLUSH_NONE;
+	else if (strcmp(value, "sync") == 0)
+		*mode = FLUSH_SYNC;
+	else if (strncmp(value, "interval:", 9) == 0) {
+		if (strlen(value) == 9 || my_strvalidate(value + 9, 5) == 1 || atoi(value + 9) <= 0)
+			return 1;
+		*mode = FLUSH_INTERVAL;
+		*interval = atoi(value + 9);
+	}
+	else
+		return 1;
+	return 0;
+}
+
 /**
  * @brief Reads the config file to compare the values later on
  * @return If successful, return 0 if found, -1 if not found
@@ -445,40 +537,21 @@ int read_config(const char *config_file, struct config_params *params)
 }
 
 /**
- * @brief helper funtion used to print
- * @return void
+ * @brief Hashes a key; the slot of the key is this hash modulo MAX_RECORDS_PER_TABLE.
  */
-void logger(FILE *file, char *message)
-{
-	fprintf(file,"%s",message);
-	fflush(file);
-}
-/**
- * @brief Encrypts the password
- * @return char*, i.e. the encrypted password
- */
-char *generate_encrypted_password(const char *passwd, const char *salt)
-{
-	if(salt != NULL)
-		return crypt(passwd, salt);
-	else
-		return crypt(passwd, DEFAULT_CRYPT_SALT);
+unsigned long keyHash (const char* str) {
+	unsigned long hash = 5381;
+	int c;
+	while ((c = *str++))
+		hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
+	return hash;
 }
 
-
 /**
  * @brief converts key into index; helper for hash table
  */
 int hash(char *str){
-	unsigned long hash = 5381;
-    int c;
-    while (c = *str++)
-    	hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
-    hash=hash%MAX_RECORDS_PER_TABLE;
-
-
-
-    return hash;
+	return keyHash (str) % MAX_RECORDS_PER_TABLE;
 }
 /**
  * @brief Helper funtion, used to probe through table to avoid collissions
@@ -491,11 +564,56 @@ int probeIndex (int index, int origIndex) {
 	if (newIndex > MAX_RECORDS_PER_TABLE - 1)
 		newIndex = 0;
 	//Return -1
-	else if (newIndex == origIndex) {
+	if (newIndex == origIndex) {
 		return -1;
 	}
 	return newIndex;
 }
+/**
+ * @brief Copies the state of the entry in a slot into the slot's probe state, the bitmap indexes and the zone map.
+ */
+void syncSlot (struct table* node, int index) {
+	struct hashEntry* entry = node->entries[index];
+	struct slotMeta* slot = &node->slots[index];
+	if (entry->key[0] == '\0') {
+		slot->state = SLOT_EMPTY;
+		slot->hash = 0;
+	}
+	else {
+		slot->state = entry->deleted == -1 ? SLOT_DELETED : SLOT_LIVE;
+		slot->hash = keyHash (entry->key);
+		if (entry->transac_count > node->lastVersion)
+			node->lastVersion = entry->transac_count;
+	}
+	bitmap_sync (node, index);
+	zone_sync (node, index);
+}
+
+/**
+ * @brief Finds an existing entry in the hash table of a table.
+ * @return Returns the entry, or NULL if the key is not in the hash table.
+ */
+struct hashEntry* findEntry (struct table* node, char* key) {
+	unsigned long h = keyHash (key);
+	int index = h % MAX_RECORDS_PER_TABLE;
+	int pIndex = index;
+	struct slotMeta* slot;
+	struct hashEntry* entry;
+	while (pIndex != -1) {
+		slot = &node->slots[pIndex];
+		// Slots that were never used end the probe sequence; deleted ones keep their key.
+		if (slot->state == SLOT_EMPTY)
+			return NULL;
+		// Only an entry whose hash matches is read.
+		if (slot->state == SLOT_LIVE && slot->hash == (unsigned int)h) {
+			entry = node->entries[pIndex];
+			if (strcmp (entry->key, key) == 0)
+				return entry;
+		}
+		pIndex = probeIndex (pIndex, index);
+	}
+	return NULL;
+}
 /**
  * @brief gets the entry from hash table
  * @return If successful, return 1 if found, 0 if not found
@@ -508,37 +626,38 @@ char* getEntry (struct table* root, char* tableName, char* key) {
 		tableName[MAX_TABLE_LEN - 1] = '\0';
 	}
 	struct table* node = root;
-	char result[MAX_VALUE_LEN] = "";
+	// Static so the result outlives the call; callers hold the server lock.
+	static char result[MAX_VALUE_LEN];
 	int i = 0;
-	int index = hash (key);
-	int pIndex = index;
-	int numProbes = 0;
-	struct hashEntry* entry;// = malloc(sizeof(struct hashEntry));
-	while (node != NULL && pIndex != -1) {
+	struct hashEntry* entry;
+	struct lsm_row row;
+	while (node != NULL) {
 		// Check for the right table
 		if (strcmp (tableName, node->name) == 0) {
-			pIndex = hash (key);
-			while (pIndex != -1  && node->numEntries > numProbes) {
-				entry = node->entries[pIndex];
-				// If not deleted, then check for same name and return value
-				if (entry->deleted != -1 && strcmp (entry->key, key) == 0) {
-					sprintf (result, "%d ", entry->transac_count);
-					for (i = 0; i < node->numCol; i++) {
-						strcat (result, node->col[i]);
-						strcat (result, " ");
-						strcat (result, entry->value[i]);
-						if (i < node->numCol - 1)
-							strcat (result, ", ");
-					}
-					//strcat (result, entry->value[0]);
-					return result;
+			entry = findEntry (node, key);
+			if (entry != NULL) {
+				bufpool_touch (node, entry, 0);
+				sprintf (result, "%d ", entry->transac_count);
+				for (i = 0; i < node->numCol; i++) {
+					strcat (result, node->col[i]);
+					strcat (result, " ");
+					strcat (result, entry->value[i]);
+					if (i < node->numCol - 1)
+						strcat (result, ", ");
 				}
-				// If entry is deleted/unused or wrong entry, then probe next index
-				else {
-					pIndex = probeIndex (pIndex, index);
-					if (strcmp (entry->key, key) != 0)
-						numProbes += 1;
+				return result;
+			}
+			// Entries flushed out of the hash table.
+			if (node->lsm != NULL && lsm_get (node, key, &row) == 0) {
+				sprintf (result, "%d ", row.transac_count);
+				for (i = 0; i < node->numCol; i++) {
+					strcat (result, node->col[i]);
+					strcat (result, " ");
+					strcat (result, row.value[i]);
+					if (i < node->numCol - 1)
+						strcat (result, ", ");
 				}
+				return result;
 			}
 			//Entry not found
 			return "-2";
@@ -549,11 +668,47 @@ char* getEntry (struct table* root, char* tableName, char* key) {
 	// If table does not exist, return -1
 	return "-1";
 }
+/**
+ * @brief Gets the version (transaction count) of an entry without formatting its value.
+ * @return Returns the version if found, -2 if the key is not found and -1 if the table does not exist.
+ */
+int getVersion (struct table* root, char* tableName, char* key) {
+	if (strlen(key)>MAX_KEY_LEN - 1) {
+		key[MAX_KEY_LEN - 1] = '\0';
+	}
+	if (strlen(tableName)>MAX_TABLE_LEN - 1) {
+		tableName[MAX_TABLE_LEN - 1] = '\0';
+	}
+	struct table* node = root;
+	struct hashEntry* entry;
+	struct lsm_row row;
+	while (node != NULL) {
+		// Check for the right table
+		if (strcmp (tableName, node->name) == 0) {
+			entry = findEntry (node, key);
+			if (entry != NULL)
+				return entry->transac_count;
+			if (node->lsm != NULL && lsm_get (node, key, &row) == 0)
+				return row.transac_count;
+			//Entry not found
+			return -2;
+		}
+		else
+			node = node->next;
+	}
+	// If table does not exist, return -1
+	return -1;
+}
+
 /**
  * @brief Sets the value of the specified entry.
  * @return Returns 0 for a successful set and -1 otherwise. If value is NULL, then the pair is to be deleted.
+ *
+ * writeEn is the storage policy of the table: with 1 (on-disk) or 3 (lsm) the change is appended to the
+ * write-ahead log (see wal.h), with 2 (mmap) the mapped file is flushed as its flush policy requires (see
+ * mmaptable.h).  Tables with SSTs (see lsm.h) bring the entry into the hash table first.
  */
-int setEntry (struct table* head, char* tableName, char* key, char* value, char* path, int writeEn, int transac_id) {
+int setEntry (struct table* head, char* tableName, char* key, char* value, int writeEn, int transac_id) {
 	if (strlen(key)>MAX_KEY_LEN - 1) {
 		key[MAX_KEY_LEN - 1] = '\0';
 	}
@@ -625,66 +780,74 @@ int setEntry (struct table* head, char* tableName, char* key, char* value, char*
 					}
 				}
 			}
-			// If input is in the right format continue to search hash table.
-			if (node->numEntries > 0)
-				entry = node->entries[node->headIndex];
-			// Loop to check for existing entry
-			while (node->numEntries > numProbes) {
-				// If entry exists, then check for same name and set value and return 0
-				if (entry->deleted != -1 && strcmp (entry->key, key) == 0) {
-					// Check to see if this is part of the same transaction.
-					if (transac_id != 0 && transac_id != entry->transac_count)
-						return -4;
-					// Deletes entry
-					if (strcmp (value, "NULL") == 0) {
-						struct hashEntry* newHead = deleteEntry (entry, node->entries[node->headIndex]);
-						if (newHead == NULL) {
-							node->headIndex = -1;
-						}
-						else {
-							node->headIndex = newHead->index;
-						}
-						entry->deleted = -1;
-						node->numEntries -= 1;
+			// Make room in the memtable and bring in the entry if it was flushed to an SST.
+			if (node->lsm != NULL && lsm_prepare (node, key) != 0)
+				return -1;
+			// If input is in the right format, look the key up through the slot states.
+			entry = findEntry (node, key);
+			// If entry exists, then set value and return 0
+			if (entry != NULL) {
+				// Check to see if this is part of the same transaction.
+				if (transac_id != 0 && transac_id != entry->transac_count)
+					return -4;
+				// Deletes entry
+				if (strcmp (value, "NULL") == 0) {
+					if (node->watchers > 0) {
+						bufpool_touch (node, entry, 0);
+						watch_before (node, entry->value);
 					}
-					// Edits entry
-					else {
-						// Store values.
-						for (i = 0; i < node->numCol; i++) {
-							if (node->type[i] != -1 && strlen(parsedValues[i])>node->type[i] - 1) {
-								parsedValues[i][node->type[i] - 1] = '\0';
-							}
-							if (strcmp (entry->value[i], parsedValues[i]) != 0)
-								strcpy (entry->value[i], parsedValues[i]);
-						}
-						entry->transac_count += 1;
+					struct hashEntry* newHead = deleteEntry (entry, node->entries[node->headIndex]);
+					if (newHead == NULL) {
+						node->headIndex = -1;
 					}
-					if (writeEn) {
-						char datapath[MAX_PATH_LEN];
-						strcpy (datapath, path);
-						FILE* tFile = fopen (datapath, "w");
-						numProbes = 0;
-						if (node->numEntries > 0)
-							entry = node->entries[node->headIndex];
-						while (node->numEntries > numProbes) {
-							fprintf (tFile, "%s", entry->key);
-							for (i = 0; i < node->numCol; i++) {
-								fprintf (tFile, "\t%s", entry->value[i]);
-							}
-							fprintf (tFile, "\n");
-							entry = entry->next;
-							numProbes += 1;
-						}
-						fclose (tFile);
+					else {
+						node->headIndex = newHead->index;
 					}
-					return 0;
+					entry->deleted = -1;
+					syncSlot (node, entry->index);
+					node->numEntries -= 1;
+					keyindex_remove (node->keys, key);
+					colstats_delete (node);
+					node->version += 1;
+					bufpool_drop (node, entry);
+					if (node->lsm != NULL)
+						lsm_deleted (node, key);
+					if (writeEn == 1 || writeEn == 3)
+						wal_append_delete (node, key);
+					else if (writeEn == 2)
+						mmaptable_written (node, entry);
+					if (node->watchers > 0)
+						watch_publish (node, key, NULL);
 				}
-				// If entry is deleted/unused or wrong entry, then probe next index
+				// Edits entry
 				else {
-					entry = entry->next;
-					numProbes += 1;
+					bufpool_touch (node, entry, 1);
+					if (node->watchers > 0)
+						watch_before (node, entry->value);
+					// Store values.
+					for (i = 0; i < node->numCol; i++) {
+						if (node->type[i] != -1 && strlen(parsedValues[i])>node->type[i] - 1) {
+							parsedValues[i][node->type[i] - 1] = '\0';
+						}
+						if (strcmp (entry->value[i], parsedValues[i]) != 0)
+							strcpy (entry->value[i], parsedValues[i]);
+					}
+					entry->transac_count += 1;
+					if (entry->transac_count > node->lastVersion)
+						node->lastVersion = entry->transac_count;
+					colstats_update (node, entry->value);
+					dict_set (node, entry);
+					bitmap_sync (node, entry->index);
+					zone_sync (node, entry->index);
+					node->version += 1;
+					if (writeEn == 1 || writeEn == 3)
+						wal_append_set (node, entry);
+					else if (writeEn == 2)
+						mmaptable_written (node, entry);
+					if (node->watchers > 0)
+						watch_publish (node, key, entry);
 				}
-
+				return 0;
 			}
 			if (strcmp (value, "NULL") == 0) {
 				return -3;	// Key not found.
@@ -694,13 +857,13 @@ int setEntry (struct table* head, char* tableName, char* key, char* value, char*
 			if (node->numEntries <= MAX_RECORDS_PER_TABLE) {
 				pIndex = hash (key);
 				while (pIndex != -1 && numProbes <= MAX_RECORDS_PER_TABLE) {
-					entry = node->entries[pIndex];
-					// If entry is deleted/unused, then set name and set value and return 0
-					if (entry->deleted == -1) {
-						if (strcmp (entry->key, key) != 0) {
-							entry->transac_count = 1;
-							strcpy (entry->key, key);
-						}
+					// If the slot is deleted/unused, then set name and set value and return 0
+					if (node->slots[pIndex].state != SLOT_LIVE) {
+						entry = node->entries[pIndex];
+						strcpy (entry->key, key);
+						entry->transac_count = node->lastVersion + 1;
+						entry->index = pIndex;
+						bufpool_touch (node, entry, 1);
 						// Store values
 						for (i = 0; i < node->numCol; i++) {
 							if (node->type[i] != -1 && strlen(parsedValues[i])>node->type[i] - 1) {
@@ -710,6 +873,7 @@ int setEntry (struct table* head, char* tableName, char* key, char* value, char*
 						}
 						entry->deleted = 0;
 						entry->index = pIndex;
+						syncSlot (node, pIndex);
 						int status;
 						if (node->headIndex == -1) {
 							status = insertEntry (entry, NULL);
@@ -719,23 +883,20 @@ int setEntry (struct table* head, char* tableName, char* key, char* value, char*
 							status = insertEntry (entry, node->entries[node->headIndex]);
 						}
 						node->numEntries += 1;
-						if (writeEn) {
-							char datapath[MAX_PATH_LEN];
-							strcpy (datapath, path);
-							FILE* tFile = fopen (datapath, "a");
-							fprintf (tFile, "%s", entry->key);
-							for (i = 0; i < node->numCol; i++) {
-								fprintf (tFile, "\t%s", entry->value[i]);
-							}
-							fprintf (tFile, "\n");
-							fclose (tFile);
-						}
+						keyindex_insert (node->keys, entry);
+						colstats_insert (node, entry->value);
+						dict_set (node, entry);
+						node->version += 1;
+						if (writeEn == 1 || writeEn == 3)
+							wal_append_set (node, entry);
+						else if (writeEn == 2)
+							mmaptable_written (node, entry);
+						if (node->watchers > 0)
+							watch_publish (node, key, entry);
 						return 0;
 					}
-					if (entry->deleted != -1) {
-						pIndex = probeIndex (pIndex, index);
-						numProbes += 1;
-					}
+					pIndex = probeIndex (pIndex, index);
+					numProbes += 1;
 				}
 
 			}
@@ -750,242 +911,615 @@ int setEntry (struct table* head, char* tableName, char* key, char* value, char*
 	return -1;
 }
 
+/**
+ * @brief Inserts an entry without parsing or validating its values.  Used to load table files.
+ * @return Returns 0 on success, -1 if the table is full and -2 if the key already exists.
+ */
+int putEntry (struct table* node, const char* key, char** values, int transac_count) {
+	unsigned long h = keyHash (key);
+	int index = h % MAX_RECORDS_PER_TABLE;
+	int pIndex = index;
+	int i;
+	struct hashEntry* entry;
+	if (node->numEntries >= MAX_RECORDS_PER_TABLE)
+		return -1;
+	while (pIndex != -1) {
+		if (node->slots[pIndex].state != SLOT_LIVE)
+			break;
+		if (node->slots[pIndex].hash == (unsigned int)h && strcmp (node->entries[pIndex]->key, key) == 0)
+			return -2;
+		pIndex = probeIndex (pIndex, index);
+	}
+	if (pIndex == -1)
+		return -1;
+	entry = node->entries[pIndex];
+	strncpy (entry->key, key, MAX_KEY_LEN - 1);
+	entry->key[MAX_KEY_LEN - 1] = '\0';
+	entry->index = pIndex;
+	bufpool_touch (node, entry, 1);
+	for (i = 0; i < node->numCol; i++) {
+		strncpy (entry->value[i], values[i], MAX_STRTYPE_SIZE - 1);
+		entry->value[i][MAX_STRTYPE_SIZE - 1] = '\0';
+		if (node->type[i] != -1 && strlen (entry->value[i]) > node->type[i] - 1)
+			entry->value[i][node->type[i] - 1] = '\0';
+	}
+	entry->transac_count = transac_count;
+	entry->deleted = 0;
+	entry->index = pIndex;
+	syncSlot (node, pIndex);
+	if (node->headIndex == -1) {
+		insertEntry (entry, NULL);
+		node->headIndex = pIndex;
+	}
+	else
+		insertEntry (entry, node->entries[node->headIndex]);
+	node->numEntries += 1;
+	keyindex_insert (node->keys, entry);
+	dict_set (node, entry);
+	node->version += 1;
+	return 0;
+}
+
 /**
  * @brief Queries the specified table using the specified predicates.
  * @return Returns a string with the number of keys returned and their names.
  */
 // Queries the specified table using the specified predicates and returns a string with the number of keys returned and their names.
 char* query (struct table* root, char* tableName, char* predicates, int maxKeys) {
+	struct pred_plan plan;
 	if (strlen(tableName)>MAX_TABLE_LEN) {
 		tableName[MAX_TABLE_LEN - 1] = '\0';
 	}
-	struct table* node = root;
+	// Parse the predicates into a plan, used for this query only.
+	int status = pred_compile (root, tableName, predicates, &plan);
+	if (status == -1)
+		return "-1";	// Table not found.
+	if (status != 0)
+		return "-2";
+	return query_plan (&plan, maxKeys);
+}
+
+/**
+ * @brief Entries of a table split into morsels that are matched in parallel.
+ */
+struct scan_morsels {
+	struct pred_plan* plan;
+	/// The entries, in list order.
+	struct hashEntry** entries;
+	int numEntries;
+	/// 1 for every entry that meets the predicates.
+	char* matches;
+};
+
+// Matches the entries of one morsel against the predicates.
+static void scan_morsel (int index, void* arg) {
+	struct scan_morsels* scan = arg;
+	int i = index * SCAN_MORSEL_ROWS;
+	int last = i + SCAN_MORSEL_ROWS < scan->numEntries ? i + SCAN_MORSEL_ROWS : scan->numEntries;
+	// Each thread reorders the predicates on its own copy of the plan's test order.
+	struct pred_stats stats = scan->plan->stats;
+	for (; i < last; i++)
+		scan->matches[i] = pred_match (scan->plan, &stats, scan->entries[i]->value, scan->entries[i]->index);
+}
+
+// Matches the entries of the hash table in morsels on the worker pool, then visits the
+// matching ones in list order, setting *status as scan_plan() would.  Returns 1 if it did, or
+// 0 if the entries are too few (or out of memory), so the caller scans them itself.
+static int scan_parallel (struct pred_plan* plan, int* remaining, int (*visit)(const char* key, char (*values)[MAX_STRTYPE_SIZE], void* arg), void* arg, int* status) {
+	struct table* node = plan->node;
+	struct scan_morsels scan;
 	struct hashEntry* entry;
-	char colNames[MAX_COLUMNS_PER_TABLE][MAX_COLNAME_LEN];
-	int colIndices[MAX_COLUMNS_PER_TABLE];
-	// Operators are <, =, > and are represented by -1, 0, 1 respectively.
-	int operators[MAX_COLUMNS_PER_TABLE];
-	char parsedValues[MAX_COLUMNS_PER_TABLE][MAX_STRTYPE_SIZE];
-	int numCols = 0;
-	int i, j;
-	int numProbed = 0;
-	int numKeys = 0;
-	int predsMet = 0;
-	int colMatch = 0;
-	char result[MAX_VALUE_LEN];
-	char buff[MAX_VALUE_LEN];
+	int i;
 
-	// Parse predicates here into colNames, operators and parsedValues in the order that you find them.  operators should be represented as stated above.
-	char* arg;
-	char temp[MAX_COLNAME_LEN];
-	int c;
+	// Rows in the buffer pool are loaded as they are read, which only the server thread may do.
+	if (workpool_size () < 2 || node->pool != NULL || plan->numGroups == 0 || node->numEntries < 2 * SCAN_MORSEL_ROWS)
+		return 0;
+	scan.plan = plan;
+	scan.numEntries = node->numEntries;
+	scan.entries = malloc (scan.numEntries * sizeof(struct hashEntry*));
+	scan.matches = malloc (scan.numEntries);
+	if (scan.entries == NULL || scan.matches == NULL) {
+		free (scan.entries);
+		free (scan.matches);
+		return 0;
+	}
+	entry = node->entries[node->headIndex];
+	for (i = 0; i < scan.numEntries; i++) {
+		scan.entries[i] = entry;
+		entry = entry->next;
+	}
+	workpool_run ((scan.numEntries + SCAN_MORSEL_ROWS - 1) / SCAN_MORSEL_ROWS, scan_morsel, &scan);
+	// Visits stay on this thread and in list order, as in a serial scan.
+	for (i = 0; i < scan.numEntries && *status == 0 && *remaining != 0; i++) {
+		if (scan.matches[i]) {
+			*status = visit (scan.entries[i]->key, scan.entries[i]->value, arg);
+			*remaining -= 1;
+		}
+	}
+	free (scan.entries);
+	free (scan.matches);
+	return 1;
+}
 
-	if ((int)trim(predicates)[0] == (int)',')
-		return "-2";
-	if ((int)trim(predicates)[strlen(trim(predicates)) - 1] == (int)',')
-		return "-2";
+/**
+ * @brief Calls visit for every row of the plan's table that meets its predicates, in one pass.
+ * @return Returns 0, or the first non-zero value returned by visit (which stops the scan).
+ */
+int scan_plan (struct pred_plan* plan, int rows, int (*visit)(const char* key, char (*values)[MAX_STRTYPE_SIZE], void* arg), void* arg) {
+	struct table* node = plan->node;
+	struct hashEntry* entry;
+	struct lsm_iter* it;
+	struct lsm_row row;
+	uint64_t candidates[BITMAP_WORDS];
+	int numProbed = 0;
+	int status = 0;
+	// A LIMIT without ORDER BY keeps the first rows found.
+	int remaining = plan->orderCol < 0 && plan->limit > 0 ? plan->limit : -1;
+	// Predicates on indexed columns narrow the rows down first (see bitmap.h).
+	int indexed = bitmap_plan (plan, candidates);
+	// Then the blocks whose ranges rule the predicates out (see zone.h).
+	if (zone_plan (plan, candidates, indexed < 0) > 0 && indexed < 0)
+		indexed = 0;
 
-	if (strcmp (predicates, "LOAD_ALL") == 0) {
-		// Loop through all existing tables.
-		while (node != NULL) {
-			// Check for right table.
-			if (strcmp (tableName, node->name) == 0) {
-				// Proceed to query.
-				if (node->numEntries > 0)
-					entry = node->entries[node->headIndex];
-				else
-					return "0";	// If there are no entries then return 0;
-
-				// Iterate through all the records in the linked list.
-				while (node->numEntries > numProbed) {
-					// Add it to the result.
-					if (numKeys < maxKeys) {
-						if (numKeys != 0) {
-							strcat (result, " ");
-							strcat (result, entry->key);
-						}
-						if (numKeys == 0)
-							strcpy (result, entry->key);
-					}
-					numKeys += 1;
-					// Add 1 to numProbed.
-					numProbed += 1;
-					entry = entry->next;
+	// Large tables are matched in morsels by the worker pool.
+	if (indexed >= 0 || !scan_parallel (plan, &remaining, visit, arg, &status)) {
+		if (node->numEntries > 0)
+			entry = node->entries[node->headIndex];
+		// Iterate through all the records in the linked list.
+		while (node->numEntries > numProbed && status == 0 && remaining != 0) {
+			// Rows the bitmaps rule out are skipped without being read.
+			if (indexed < 0 || BITMAP_TEST (candidates, entry->index)) {
+				// Without predicates left to test the row is only needed if visit reads it.
+				if (rows || (plan->numGroups > 0 && indexed != 1))
+					bufpool_touch (node, entry, 0);
+				if (indexed == 1 || pred_match (plan, &plan->stats, entry->value, entry->index)) {
+					status = visit (entry->key, entry->value, arg);
+					remaining -= 1;
 				}
-				// Once all entries have been accounted for, return the key list and the number of keys found. (numKeys key1 key2 ...)
-				sprintf (buff, "%d", numKeys);
-				strcat (buff, " ");
-				strcat (buff, result);
-				return buff;
 			}
-			node = node->next;
+			numProbed += 1;
+			entry = entry->next;
 		}
-		// Table not found.
-		return "-1";
+	}
+	// Then the entries that were flushed to SSTs.
+	if (node->lsm != NULL && status == 0 && remaining != 0) {
+		it = lsm_iter_open (node);
+		while (status == 0 && remaining != 0 && lsm_iter_next (it, &row) == 0) {
+			if (pred_match (plan, &plan->stats, row.value, -1)) {
+				status = visit (row.key, row.value, arg);
+				remaining -= 1;
+			}
+		}
+		lsm_iter_close (it);
+	}
+	return status;
+}
+
+/**
+ * @brief Rows of an ORDER BY collected by scan_plan().
+ */
+struct order_rows {
+	struct topk heap;
+	/// Rows matched, whether kept or not.
+	int numRows;
+};
+
+// Pushes a matching row into the heap of an ORDER BY.
+static int order_visit (const char* key, char (*values)[MAX_STRTYPE_SIZE], void* arg) {
+	struct order_rows* order = arg;
+	order->numRows += 1;
+	if (order->heap.limit < 0)
+		return 0;	// Only counting.
+	return topk_push (&order->heap, key, values);
+}
+
+// Scans the rows of a plan with an ORDER BY, keeping the first limit of them (0 for all)
+// in order->heap, sorted.  Returns 0, or -1 if out of memory.
+static int order_plan (struct pred_plan* plan, int limit, int keepValues, struct order_rows* order) {
+	order->numRows = 0;
+	if (topk_init (&order->heap, plan, limit, keepValues) != 0)
+		return -1;
+	if (scan_plan (plan, 1, order_visit, order) != 0) {
+		topk_free (&order->heap);
+		return -1;
+	}
+	topk_sort (&order->heap);
+	return 0;
+}
+
+/**
+ * @brief Keys collected by query_plan().
+ */
+struct query_keys {
+	char* result;
+	int numKeys;
+	int maxKeys;
+	/// 1 to stop the scan after maxKeys keys, when the matches are counted apart.
+	int stop;
+};
+
+// Adds a matching key to the result of query_plan().
+static int query_visit (const char* key, char (*values)[MAX_STRTYPE_SIZE], void* arg) {
+	struct query_keys* keys = arg;
+	if (keys->numKeys < keys->maxKeys) {
+		if (keys->numKeys != 0)
+			strcat (keys->result, " ");
+		strcat (keys->result, key);
+	}
+	keys->numKeys += 1;
+	return keys->stop && keys->numKeys >= keys->maxKeys;
+}
+
+/**
+ * @brief Runs a compiled query.
+ * @return Returns a string with the number of keys returned and their names.
+ */
+char* query_plan (struct pred_plan* plan, int maxKeys) {
+	struct query_keys keys;
+	// Static so the result outlives the call; callers hold the server lock.
+	static char result[MAX_VALUE_LEN];
+	static char buff[MAX_VALUE_LEN];
+	strcpy (result, "");
+
+	if (plan->node->numEntries == 0 && plan->node->lsm == NULL)
+		return "0";	// If there are no entries then return 0;
+	keys.result = result;
+	keys.numKeys = 0;
+	keys.maxKeys = maxKeys;
+	keys.stop = 0;
+	if (plan->orderCol >= 0) {
+		// Only the first maxKeys keys (or fewer with LIMIT) are sent, so only those are kept.
+		struct order_rows order;
+		int i;
+		int limit = plan->limit > 0 && plan->limit < maxKeys ? plan->limit : maxKeys;
+		if (order_plan (plan, limit > 0 ? limit : -1, 0, &order) != 0)
+			return "-2";
+		for (i = 0; i < order.heap.size; i++)
+			query_visit (order.heap.rows[i].key, order.heap.rows[i].values, &keys);
+		topk_free (&order.heap);
+		// The number of keys found counts every match, up to the LIMIT.
+		keys.numKeys = plan->limit > 0 && plan->limit < order.numRows ? plan->limit : order.numRows;
 	}
 	else {
-		arg = strtok (predicates, ",");
-		if (arg == NULL) {
-			return "-2";	// Shouldn't have to ever execute this.
+		// When the bitmaps count the matches, only the keys sent are scanned for.
+		int count = plan->limit == 0 ? bitmap_count (plan) : -1;
+		keys.stop = count >= 0;
+		scan_plan (plan, 0, query_visit, &keys);
+		if (count >= 0)
+			keys.numKeys = count;
+	}
+	// Once all entries have been accounted for, return the key list and the number of keys found. (numKeys key1 key2 ...)
+	sprintf (buff, "%d", keys.numKeys);
+	strcat (buff, " ");
+	strcat (buff, result);
+	return buff;
+}
+
+/**
+ * @brief State of an aggregate while the rows are scanned.
+ */
+struct aggregate_state {
+	/// One of AGG_COUNT, AGG_SUM, AGG_MIN, AGG_MAX or AGG_AVG.
+	int func;
+	/// Column aggregated (unused for AGG_COUNT).
+	int col;
+	long count;
+	long long sum;
+	long min;
+	long max;
+};
+
+// Adds a matching row to an aggregate.
+static int aggregate_visit (const char* key, char (*values)[MAX_STRTYPE_SIZE], void* arg) {
+	struct aggregate_state* agg = arg;
+	long value;
+	agg->count += 1;
+	if (agg->func == AGG_COUNT)
+		return 0;
+	value = atol (values[agg->col]);
+	agg->sum += value;
+	if (agg->count == 1 || value < agg->min)
+		agg->min = value;
+	if (agg->count == 1 || value > agg->max)
+		agg->max = value;
+	return 0;
+}
+
+/**
+ * @brief Computes COUNT(*), or SUM, MIN, MAX or AVG of an int column, over the rows meeting the predicates.
+ * @return Returns "<rows> <value>" (the value is 0 if no row matches), "-1" if the table does not exist, "-2" if the expression or the predicates are invalid.
+ */
+char* aggregate (struct table* root, char* tableName, char* expr, char* predicates) {
+	static const char* names[] = { "COUNT", "SUM", "MIN", "MAX", "AVG" };
+	static char buff[100];
+	struct aggregate_state agg;
+	struct pred_plan plan;
+	char func[10];
+	char column[MAX_COLNAME_LEN];
+
+	int status = pred_compile (root, tableName, predicates, &plan);
+	if (status == -1)
+		return "-1";	// Table not found.
+	// An aggregate covers every matching row.
+	if (status != 0 || plan.orderCol >= 0 || plan.limit > 0)
+		return "-2";
+	// Parse "FUNC(column)".
+	char* end = strchr (expr, ')');
+	if (sscanf (expr, "%9[A-Za-z](%19[^)])", func, column) != 2 || end == NULL || end[1] != '\0')
+		return "-2";
+	for (agg.func = 0; agg.func <= AGG_AVG; agg.func++) {
+		if (strcasecmp (func, names[agg.func]) == 0)
+			break;
+	}
+	if (agg.func > AGG_AVG || (agg.func == AGG_COUNT) != (strcmp (column, "*") == 0))
+		return "-2";
+	if (agg.func != AGG_COUNT) {
+		for (agg.col = 0; agg.col < plan.node->numCol; agg.col++) {
+			if (strcmp (column, plan.node->col[agg.col]) == 0)
+				break;
 		}
-		i = 0;
+		// Only int columns can be added up.
+		if (agg.col == plan.node->numCol || plan.node->type[agg.col] != -1)
+			return "-2";
+	}
+	agg.sum = 0;
+	agg.min = 0;
+	agg.max = 0;
+	// A count of indexed predicates is a popcount of their bitmap.
+	agg.count = agg.func == AGG_COUNT ? bitmap_count (&plan) : -1;
+	if (agg.count < 0) {
+		agg.count = 0;
+		scan_plan (&plan, agg.func != AGG_COUNT, aggregate_visit, &agg);
+	}
 
-		while (arg != NULL) {
-			j = strcspn (arg, "<=>");
-			if (j >= strlen (arg) - 2) {
-				return "-2";	// If operator is not found, return "-2".
-			}
-			strncpy (temp, arg, j);
-			temp[j] = '\0';
-			// Set column name
-			strcpy (colNames[i], trim(temp));	
-			// Set operators
-			c = (int)arg[j];
-			if (c == (int)'<')
-				operators[i] = -1;
-			else if (c == (int)'=')
-				operators[i] = 0;
-			else if (c == (int)'>')
-				operators[i] = 1;
-			else {
-				return "-2";	// Not an acceptable operator.
+	if (agg.func == AGG_COUNT)
+		sprintf (buff, "%ld %ld", agg.count, agg.count);
+	else if (agg.func == AGG_SUM)
+		sprintf (buff, "%ld %lld", agg.count, agg.sum);
+	else if (agg.func == AGG_MIN)
+		sprintf (buff, "%ld %ld", agg.count, agg.min);
+	else if (agg.func == AGG_MAX)
+		sprintf (buff, "%ld %ld", agg.count, agg.max);
+	else
+		sprintf (buff, "%ld %.6f", agg.count, agg.count > 0 ? (double)agg.sum / agg.count : 0.0);
+	return buff;
+}
+
+/**
+ * @brief Reply of select_rows() while it is built.
+ */
+struct select_reply {
+	char* text;
+	size_t len;
+	size_t size;
+	/// Columns sent, and their number.
+	int cols[MAX_COLUMNS_PER_TABLE];
+	int numCols;
+	int numRows;
+};
+
+// Appends a string to a select reply, growing it as needed.  Returns 0, or -1 if out of memory.
+static int select_append (struct select_reply* reply, const char* str) {
+	size_t len = strlen (str);
+	char* text;
+	if (reply->len + len + 1 > reply->size) {
+		reply->size = (reply->len + len + 1) * 2;
+		text = realloc (reply->text, reply->size);
+		if (text == NULL)
+			return -1;
+		reply->text = text;
+	}
+	memcpy (reply->text + reply->len, str, len + 1);
+	reply->len += len;
+	return 0;
+}
+
+// Adds the key and the selected columns of a matching row to the reply.
+static int select_visit (const char* key, char (*values)[MAX_STRTYPE_SIZE], void* arg) {
+	struct select_reply* reply = arg;
+	int i;
+	if (select_append (reply, key) != 0)
+		return -1;
+	for (i = 0; i < reply->numCols; i++) {
+		if (select_append (reply, "\t") != 0 || select_append (reply, values[reply->cols[i]]) != 0)
+			return -1;
+	}
+	reply->numRows += 1;
+	return select_append (reply, "\n");
+}
+
+/**
+ * @brief Formats chosen columns of the rows meeting the predicates.
+ * @return Returns the number of rows and sets *out to the reply (to be freed), or returns -1 if the table does not exist, -2 if the columns or predicates are invalid, -3 if out of memory.
+ */
+int select_rows (struct table* root, char* tableName, char* columns, char* predicates, char** out) {
+	struct select_reply reply;
+	struct pred_plan plan;
+	char line[50];
+	char* save;
+	char* arg;
+	int j;
+
+	int status = pred_compile (root, tableName, predicates, &plan);
+	if (status != 0)
+		return status;
+	// Resolve the column list ("*" for all of them).
+	reply.numCols = 0;
+	if (strcmp (columns, "*") == 0) {
+		for (j = 0; j < plan.node->numCol; j++)
+			reply.cols[j] = j;
+		reply.numCols = plan.node->numCol;
+	}
+	else {
+		for (arg = strtok_r (columns, ",", &save); arg != NULL; arg = strtok_r (NULL, ",", &save)) {
+			for (j = 0; j < plan.node->numCol; j++) {
+				if (strcmp (arg, plan.node->col[j]) == 0)
+					break;
 			}
-			// Set values
-			arg = arg + j + 1;
-			strcpy (parsedValues[i], trim(arg));
-			// Increment and set up for next set of predicates
-			i += 1;
-			numCols += 1;
-			arg = strtok (NULL, ",");
+			if (j == plan.node->numCol || reply.numCols == MAX_COLUMNS_PER_TABLE)
+				return -2;	// Wrong column format.
+			reply.cols[reply.numCols] = j;
+			reply.numCols += 1;
 		}
+		if (reply.numCols == 0)
+			return -2;
+	}
 
-		// Loop through all existing tables.
-		while (node != NULL) {
-			// Check for right table.
-			if (strcmp (tableName, node->name) == 0) {
-				// If right table is found, check if given column names match.
-				for (i = 0; i < numCols; i++) {
-					for (j = 0; j < node->numCol; j++) {
-						if (strcmp (colNames[i], node->col[j]) == 0) {
-							colMatch = 1;
-							colIndices[i] = j;	// Sets index
-							j = node->numCol;	// Stops this loop to check next column name.
-						}
-					}
-					if (colMatch == 0) {
-						return "-2";	// Wrong column format.
-					}
-					colMatch = 0;
-				}
-				// Once all column names have been checked, proceed to query.
-				if (node->numEntries > 0)
-					entry = node->entries[node->headIndex];
-				else
-					return "0";	// If there are no entries then return 0;
-
-				// Iterate through all the records in the linked list.
-				while (node->numEntries > numProbed) {
-					// Iterate through the specified predicate column names.
-					for (j = 0; j < numCols; j++) {
-						// If predicates are not met exit, this for loop.
-						i = checkPred (entry->value[colIndices[j]], operators[j], parsedValues[j], node->type[colIndices[j]]);
-						if (i == -2)
-							return "-2";	// Invalid data type.
-						if (i == -1) {
-							predsMet = -1;
-							// Stop checking this entry for valid predicates.
-							j = numCols;
-						}
-					}
-					// If all predicates are met then add it to the result.
-					if (predsMet == 0) {
-						if (numKeys < maxKeys) {
-							if (numKeys != 0) {
-								strcat (result, " ");
-								strcat (result, entry->key);
-							}
-							if (numKeys == 0)
-								strcpy (result, entry->key);
-						}
-						numKeys += 1;
-					}
-					// Reset predsMet for next entry and add 1 to numProbed.
-					predsMet = 0;
-					numProbed += 1;
-					entry = entry->next;
-				}
-				// Once all entries have been accounted for, return the key list and the number of keys found. (numKeys key1 key2 ...)
-				sprintf (buff, "%d", numKeys);
-				strcat (buff, " ");
-				strcat (buff, result);
-				return buff;
-			}
-			node = node->next;
+	reply.text = NULL;
+	reply.len = 0;
+	reply.size = 0;
+	reply.numRows = 0;
+	// The header names the columns once.
+	status = select_append (&reply, "key");
+	for (j = 0; j < reply.numCols && status == 0; j++) {
+		status = select_append (&reply, "\t");
+		if (status == 0)
+			status = select_append (&reply, plan.node->col[reply.cols[j]]);
+	}
+	if (status == 0)
+		status = select_append (&reply, "\n");
+	if (status == 0 && plan.orderCol >= 0) {
+		struct order_rows order;
+		status = order_plan (&plan, plan.limit, 1, &order);
+		if (status == 0) {
+			for (j = 0; status == 0 && j < order.heap.size; j++)
+				status = select_visit (order.heap.rows[j].key, order.heap.rows[j].values, &reply);
+			topk_free (&order.heap);
 		}
-		// Table not found.
-		return "-1";
 	}
+	else if (status == 0)
+		status = scan_plan (&plan, 1, select_visit, &reply);
+	sprintf (line, "END %d\n", reply.numRows);
+	if (status == 0)
+		status = select_append (&reply, line);
+	if (status != 0) {
+		free (reply.text);
+		return -3;
+	}
+	*out = reply.text;
+	return reply.numRows;
 }
 
 /**
- * @brief Validates a string based on the type specified.
- * @return Returns 1 if it fails and 0 otherwise.
+ * @brief Lists the keys of a table from start to end (inclusive) in key order, using its key index.
+ * @return Returns the number of keys and sets *out to the reply (to be freed), or returns -1 if the table does not exist, -2 if the range is invalid, -3 if out of memory.
  */
-int my_strvalidate(char *str, int type) {
-
-	int i,j;
-  	j=strlen(str);
-  	int k;
-	// Alphanumeric chars only.
-	if (type == 1) {
-   		for (i = 0; i < j; i++){
-	  		k=(int)str[i];
-      			if (!((k>=(int)'a'&&k<=(int)'z') || (k>=(int)'A'&&k<=(int)'Z') || (k>=(int)'0' && k<=(int)'9'))) {
-    	  			return 1;
-      			}
-   		}
-	}
-	// Integers only.
-	else if (type == 2) {
-		for (i = 0; i < j; i++){
-	  		k=(int)str[i];
-      			if (!(k >= (int)'0' && k <= (int)'9')) {
-      				if (i == 0 && k != 45 && k != 43)	// 45 = (int)'-', 43 = (int) '+'
-      					return 1;
-      			}
-   		}
-	}
-	// Specific to hostname.
-	else if (type == 3) {
-		if (strcmp (str, "localhost") == 0) {
-			return 0;
+int scan_keys (struct table* root, char* tableName, char* start, char* end, int limit, char** out) {
+	struct select_reply reply;
+	struct table* node = root;
+	struct keyindex_node* next;
+	struct lsm_iter* it = NULL;
+	struct lsm_row row;
+	char key[MAX_KEY_LEN];
+	char line[50];
+	int haveRow = 0;
+	int status = 0;
+
+	// "*" leaves a side of the range open.
+	if (strcmp (start, "*") == 0)
+		start = NULL;
+	if (strcmp (end, "*") == 0)
+		end = NULL;
+	if (limit <= 0 || (start != NULL && my_strvalidate (start, 1) == 1) || (end != NULL && my_strvalidate (end, 1) == 1))
+		return -2;
+	while (node != NULL && strcmp (node->name, tableName) != 0)
+		node = node->next;
+	if (node == NULL)
+		return -1;	// Table not found.
+
+	reply.text = NULL;
+	reply.len = 0;
+	reply.size = 0;
+	reply.numRows = 0;
+	next = keyindex_seek (node->keys, start);
+	// The keys flushed to SSTs come in order from their iterator, and are merged in.
+	if (node->lsm != NULL) {
+		it = lsm_iter_open (node);
+		while ((haveRow = lsm_iter_next (it, &row) == 0) && start != NULL && strcmp (row.key, start) < 0)
+			;
+	}
+	while (status == 0 && reply.numRows < limit) {
+		// Take the lower of the next indexed key and the next SST key.
+		if (next != NULL && (!haveRow || strcmp (next->entry->key, row.key) < 0)) {
+			strcpy (key, next->entry->key);
+			next = next->next[0];
+		}
+		else if (haveRow) {
+			strcpy (key, row.key);
+			haveRow = lsm_iter_next (it, &row) == 0;
+		}
+		else
+			break;
+		if (end != NULL && strcmp (key, end) > 0)
+			break;
+		status = select_append (&reply, key);
+		if (status == 0)
+			status = select_append (&reply, "\n");
+		reply.numRows += 1;
+	}
+	if (it != NULL)
+		lsm_iter_close (it);
+	sprintf (line, "END %d\n", reply.numRows);
+	if (status == 0)
+		status = select_append (&reply, line);
+	if (status != 0) {
+		free (reply.text);
+		return -3;
+	}
+	*out = reply.text;
+	return reply.numRows;
+}
+
+/**
+ * @brief Formats the statistics of every column of a table (see colstats.h).
+ * @return Returns the number of columns and sets *out to the reply (to be freed), or returns -1 if the table does not exist, -3 if out of memory.
+ */
+int column_stats (struct table* root, char* tableName, char** out) {
+	struct select_reply reply;
+	struct table* node = root;
+	struct colstats* stats;
+	struct colstats_column* col;
+	char line[MAX_COLNAME_LEN + 2 * MAX_STRTYPE_SIZE + 80];
+	int status, i, b;
+
+	while (node != NULL && strcmp (node->name, tableName) != 0)
+		node = node->next;
+	if (node == NULL)
+		return -1;	// Table not found.
+	stats = colstats_get (node);
+	if (stats == NULL)
+		return -3;
+	reply.text = NULL;
+	reply.len = 0;
+	reply.size = 0;
+	// "rows <n>", then "col<TAB>type<TAB>distinct<TAB>min<TAB>max<TAB>bound:count,..." per column.
+	sprintf (line, "rows %lu\n", stats->numRows);
+	status = select_append (&reply, line);
+	for (i = 0; i < node->numCol && status == 0; i++) {
+		col = &stats->cols[i];
+		if (!col->hasRange)
+			sprintf (line, "%s\t%s\t0\t\t\t", node->col[i], node->type[i] == -1 ? "int" : "char");
+		else if (node->type[i] == -1)
+			sprintf (line, "%s\tint\t%.0f\t%ld\t%ld\t", node->col[i], colstats_distinct (stats, i), col->min, col->max);
+		else
+			sprintf (line, "%s\tchar\t%.0f\t%s\t%s\t", node->col[i], colstats_distinct (stats, i), col->smin, col->smax);
+		status = select_append (&reply, line);
+		for (b = 0; b < col->numBuckets && status == 0; b++) {
+			sprintf (line, "%s%ld:%lu", b > 0 ? "," : "", col->bounds[b], col->counts[b]);
+			status = select_append (&reply, line);
 		}
-		for (i = 0; i < j; i++){
-	  		k=(int)str[i];
-      			if (!((k>=(int)'a'&&k<=(int)'z') || (k>=(int)'A'&&k<=(int)'Z') || (k >= (int)'0' && k <= (int)'9') || (k == (int)'.') )) {
-    	  			return 1;
-      			}
-   		}
-	}
-	// Alphanumeric with spaces.
-	else if (type == 4) {
-		for (i = 0; i < j; i++){
-	  		k=(int)str[i];
-      			if (!((k>=(int)'a'&&k<=(int)'z') || (k>=(int)'A'&&k<=(int)'Z') || (k>=(int)'0' && k<=(int)'9') || (k == (int)' '))) {
-    	  			return 1;
-      			}
-   		}
-	}
-	// Numbers only.
-	else if (type == 5) {
-		for (i = 0; i < j; i++){
-	  		k=(int)str[i];
-      			if (!(k >= (int)'0' && k <= (int)'9')) {
-      				return 1;
-      			}
-   		}
-	}
-  	return 0;
+		if (status == 0)
+			status = select_append (&reply, "\n");
+	}
+	sprintf (line, "END %d\n", node->numCol);
+	if (status == 0)
+		status = select_append (&reply, line);
+	if (status != 0) {
+		free (reply.text);
+		return -3;
+	}
+	*out = reply.text;
+	return node->numCol;
 }
 
 /**
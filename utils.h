@@ -58,8 +58,8 @@ struct hashEntry {
 	/// Key(name)
 	char key[MAX_KEY_LEN];
 
-	/// Value
-	char value[MAX_COLUMNS_PER_TABLE][MAX_VALUE_LEN];
+	/// Value: one string per column.  Points into the table's rows, or into a row of the buffer pool (NULL while evicted).
+	char (*value)[MAX_STRTYPE_SIZE];
 
 	/// If equal to -1, then entry is deleted/unused.  Otherwise it exists.
 	int deleted;
@@ -74,7 +74,34 @@ struct hashEntry {
 	struct hashEntry* next;
 	struct hashEntry* prev;
 
+	// Buffer pool state (see bufpool.h): used since the clock hand passed, changed since spilled, and spilled.
+	unsigned char referenced;
+	unsigned char dirty;
+	unsigned char cold;
+
 };
+
+/**
+ * @brief Probe-time state of a slot of a table's hash table.
+ *
+ * The states live in a dense array apart from the entries, 8 slots to a
+ * cache line, so a probe only touches the entry of a slot whose hash
+ * matches.  The entry stays authoritative; syncSlot() copies its state.
+ */
+struct slotMeta {
+	/// Low bits of the hash of the key, before it is reduced to a slot.
+	unsigned int hash;
+	/// SLOT_EMPTY, SLOT_DELETED or SLOT_LIVE.
+	int state;
+};
+
+/**
+ * @brief Slot states: never used (ends a probe sequence), deleted (keeps its key), or in use.
+ */
+#define SLOT_EMPTY 0
+#define SLOT_DELETED 1
+#define SLOT_LIVE 2
+
 /**
  * @brief Struct for including multiple tables
  *
@@ -98,9 +125,59 @@ struct table {
 	/// Corresponding hash table
 	struct hashEntry* entries[MAX_RECORDS_PER_TABLE];
 
+	// Probe state of every slot of the hash table (MAX_RECORDS_PER_TABLE, cache-line aligned).
+	struct slotMeta* slots;
+
 	// Index of the "head" of the entry linked list.  If it is -1 then there is no current head.
 	int headIndex;
 
+	// Sequence number of the last write-ahead log record contained in the table file (0 if none).
+	unsigned long snapSeq;
+
+	// File mapping holding the entries under the mmap storage policy, or NULL.
+	void* map;
+	size_t mapSize;
+
+	// SSTs holding the entries flushed out of the hash table under the LSM storage policy, or NULL.
+	void* lsm;
+
+	// Allocators of the entries and of the rows (numCol strings each) of the table (see slab.h).  The
+	// rows of a mapped table are in its file; those of a table in the buffer pool come and go.
+	void* entrySlab;
+	void* rowSlab;
+
+	// Buffer pool state of the table, or NULL if all its rows are resident.
+	void* pool;
+
+	// Skiplist of the entries sorted by key (see keyindex.h).
+	void* keys;
+
+	// Statistics of the columns (see colstats.h).
+	void* stats;
+
+	// Dictionaries of the encoded string columns (see dict.h), or NULL if none is.
+	void* dict;
+
+	// Bitmap indexes of the columns (see bitmap.h), or NULL if none is indexed.
+	void* bitmaps;
+
+	// Ranges of the int columns per block of slots (see zone.h).
+	void* zones;
+
+	// Incremented by every write, so cached query results of the table can tell they are stale (see qcache.h).
+	unsigned long version;
+
+	// Highest version given to a row of the table.  Inserted rows take the next one, so a key that is
+	// deleted and inserted again never goes back to a version a client may have cached.
+	int lastVersion;
+
+	// Connections watching the changes of the table (see watch.h).
+	int watchers;
+
+	// 0 while the table file of a lazily loaded table has not been read (see lazyload.h), 1 otherwise.
+	int loaded;
+	pthread_mutex_t loadLock;
+
 	/// Next table
 	struct table* next;
 
@@ -108,17 +185,29 @@ struct table {
 
 // Functions for hash table implementation
 int hash (char* key);
+unsigned long keyHash (const char* key);
 int probeIndex (int index, int origIndex);
+void syncSlot (struct table* node, int index);
+struct hashEntry* findEntry (struct table* node, char* key);
 char* getEntry (struct table* root, char* tableName, char* key);	// Change return value to account for -1 entry values
-int setEntry (struct table* root, char* tableName, char* key, char* value, char* datapath, int writeEn, int transac_id);
+int getVersion (struct table* root, char* tableName, char* key);
+int setEntry (struct table* root, char* tableName, char* key, char* value, int writeEn, int transac_id);
+int putEntry (struct table* node, const char* key, char** values, int transac_count);
 char* query (struct table* root, char* tableName, char* predicates, int maxKeys);
+struct pred_plan;
+char* query_plan (struct pred_plan* plan, int maxKeys);	// Runs a query compiled with pred_compile() (see pred.h).
+int scan_plan (struct pred_plan* plan, int rows, int (*visit)(const char* key, char (*values)[MAX_STRTYPE_SIZE], void* arg), void* arg);
+char* aggregate (struct table* root, char* tableName, char* expr, char* predicates);
+int select_rows (struct table* root, char* tableName, char* columns, char* predicates, char** out);
+int scan_keys (struct table* root, char* tableName, char* start, char* end, int limit, char** out);
+int column_stats (struct table* root, char* tableName, char** out);
 
 // Miscellaneous Helper Functions
 struct hashEntry* deleteEntry (struct hashEntry* entry, struct hashEntry* head);
 int insertEntry (struct hashEntry* entry, struct hashEntry* head);
-int checkPred (char* value, int op, char* opvalue, int type);
 void initKeys (char*** A, int r, int c);
 void freeTable (struct table* node);
+struct table* newTable (const char* name, int numCol, char col[][MAX_COLNAME_LEN], int* type);
 
 /**
  * @brief A struct to store config parameters.
@@ -164,16 +253,89 @@ struct config_params {
 	int numCol[MAX_TABLES];
 
 	// Storage Policy.  If policy is 0 then data is stored in memory.  Else if the policy is 1 then store on file to the data_directory.
+	// If the policy is 2 then each table is kept in a memory-mapped file in the data_directory.
+	// If the policy is 3 then each table is an LSM tree of sorted files in the data_directory.
 	int policy;
 	/// The directory where tables are stored.  Each table will have its own separate file containing its entries in column format (each column separated by a tab and each entry separated by a new line).
 	char data_directory[MAX_PATH_LEN];
 
 	// Concurrency Method
 	int concurrency;
+
+	// Seconds between background checkpoints of on-disk tables.  0 disables them.
+	int checkpoint_interval;
+
+	// Durability of on-disk writes (FLUSH_NONE, FLUSH_INTERVAL or FLUSH_SYNC) and its interval in ms.
+	int durability;
+	int durability_interval;
+
+	// Flush policy of memory-mapped tables (FLUSH_NONE, FLUSH_INTERVAL or FLUSH_SYNC) and its interval in ms.
+	int mmap_flush;
+	int mmap_flush_interval;
+
+	// Bytes of rows of on-disk tables kept in memory (see bufpool.h).  0 keeps them all.
+	size_t memory_limit;
+
+	// When on-disk tables are loaded (LOAD_EAGER, LOAD_LAZY or LOAD_PREWARM, see lazyload.h).
+	int table_loading;
+
+	// Threads scanning a query, the server thread included (see workpool.h).
+	int query_threads;
+
+	// Cached QUERY results (see qcache.h).  0 disables the cache.
+	int query_cache;
+
+	// Dictionary encoded columns (see dict.h): table and column of each.
+	char dict_table[MAX_TABLES][MAX_TABLE_LEN];
+	char dict_col[MAX_TABLES][MAX_COLNAME_LEN];
+	int numDict;
+
+	// Columns with bitmap indexes (see bitmap.h): table and column of each.
+	char bitmap_table[MAX_TABLES][MAX_TABLE_LEN];
+	char bitmap_col[MAX_TABLES][MAX_COLNAME_LEN];
+	int numBitmap;
 };
 
 int table_exist(struct config_params *params,char *value);
 
+/**
+ * @brief Flush policies: leave writes to the OS, flush every few ms, or flush before answering.
+ */
+#define FLUSH_NONE 0
+#define FLUSH_INTERVAL 1
+#define FLUSH_SYNC 2
+
+/**
+ * @brief Aggregate functions of the AGG command, in the order of their names.
+ */
+#define AGG_COUNT 0
+#define AGG_SUM 1
+#define AGG_MIN 2
+#define AGG_MAX 3
+#define AGG_AVG 4
+
+/**
+ * @brief Entries matched by one task when a query is scanned on the worker pool (see workpool.h).
+ */
+#define SCAN_MORSEL_ROWS 128
+
+/**
+ * @brief Table loading: all tables before serving, each on first access, or on first access and in the background.
+ */
+#define LOAD_EAGER 0
+#define LOAD_LAZY 1
+#define LOAD_PREWARM 2
+
+/**
+ * @brief Parses a flush policy of the form "none", "interval:<ms>" or "sync".
+ *
+ * @param value The config value.
+ * @param mode Set to FLUSH_NONE, FLUSH_INTERVAL or FLUSH_SYNC.
+ * @param interval Set to the interval in ms (0 unless mode is FLUSH_INTERVAL).
+ * @return Returns 0 on success, 1 if the value is invalid.
+ */
+int parse_flush_policy(char *value, int *mode, int *interval);
+
 /**
  * @brief Exit the program because a fatal error occured.
  *
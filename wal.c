@@ -0,0 +1,408 @@
+/**
+ * @file
+ * @brief This file implements the append-only write-ahead log declared in
+ * wal.h.
+ *
+ * Records are text lines with tab separated fields:
+ *
+ *     <seq> SET <table> <key> <value1> ... <valueN>
+ *     <seq> DEL <table> <key>
+ *
+ * Keys and values are validated to be alphanumeric (values may also contain
+ * spaces), so tabs and new lines can never appear inside a field.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <pthread.h>
+#include "wal.h"
+#include "file.h"
+
+/// The log file open for appending, or NULL.
+static FILE* wal = NULL;
+
+/// Sequence number of the last record written or replayed.
+static unsigned long walSeq = 0;
+
+/// Sequence number of the last record known to be on disk.
+static unsigned long syncedSeq = 0;
+
+/// Durability mode (FLUSH_NONE, FLUSH_INTERVAL or FLUSH_SYNC) and interval in ms.
+static int durability = FLUSH_NONE;
+static int durabilityInterval = 0;
+
+/// Guards the log file and the sequence numbers above.
+static pthread_mutex_t walLock = PTHREAD_MUTEX_INITIALIZER;
+
+/// Set while a thread is syncing the log without holding walLock.
+static int flushing = 0;
+
+/// Signalled whenever a sync finishes.
+static pthread_cond_t walFlushed = PTHREAD_COND_INITIALIZER;
+
+/// The log sealed by wal_rotate() until wal_sync_sealed() syncs it, or -1, and its last record.
+static int sealedFd = -1;
+static unsigned long sealedSeq = 0;
+
+// Applies one record (without its trailing new line) to the tables, unless the
+// table file already contains it.  With single set, only head is considered.
+// Sets *seq to the record's sequence number.  Returns 0 if the record could be
+// parsed, -1 if it is corrupt.
+static int wal_apply (struct table* head, int single, char* line, unsigned long* seq) {
+	char* fields[MAX_COLUMNS_PER_TABLE + 4];
+	char value[MAX_CMD_LEN];
+	char buff[MAX_CMD_LEN];
+	char* save;
+	int numFields = 0;
+	int i;
+	char* arg = strtok_r (line, "\t", &save);
+	while (arg != NULL && numFields < MAX_COLUMNS_PER_TABLE + 4) {
+		fields[numFields] = arg;
+		numFields += 1;
+		arg = strtok_r (NULL, "\t", &save);
+	}
+	if (numFields < 4 || my_strvalidate (fields[0], 5))
+		return -1;
+	*seq = strtoul (fields[0], NULL, 10);
+
+	// Skip records of tables that are not in the list (or no longer configured),
+	// of tables that will be loaded later, and records already contained in the
+	// table file.
+	struct table* node = head;
+	while (node != NULL && strcmp (node->name, fields[2]) != 0)
+		node = single ? NULL : node->next;
+	if (node == NULL || (!single && !node->loaded) || *seq <= node->snapSeq)
+		return 0;
+
+	if (strcmp (fields[1], "DEL") == 0) {
+		strcpy (value, "NULL");
+	}
+	else if (strcmp (fields[1], "SET") == 0) {
+		if (numFields != node->numCol + 4)
+			return -1;
+		// Rebuild the "col value, col value" form expected by setEntry.
+		strcpy (value, "");
+		for (i = 0; i < node->numCol; i++) {
+			if (i > 0)
+				strcat (value, ", ");
+			strcat (value, node->col[i]);
+			strcat (value, " ");
+			strcat (value, fields[i + 4]);
+		}
+	}
+	else
+		return -1;
+
+	if (setEntry (head, fields[2], fields[3], value, 0, 0) < 0) {
+		sprintf (buff, "Log record %lu could not be applied to table %s.\n", *seq, fields[2]);
+		if (LOGGING == 1) logger(stdout, buff);
+		else if (LOGGING == 2) logger(file, buff);
+	}
+	return 0;
+}
+
+// Replays one log file into the tables (only head with single set).  With repair
+// set, a torn record at its end is truncated away; otherwise the log may be in
+// use and reading just stops there.  Returns the number of records read, or -1
+// on error.
+static int wal_read (struct table* head, int single, const char* path, unsigned long* lastSeq, int repair) {
+	char line[MAX_CMD_LEN];
+	char buff[MAX_PATH_LEN + 50];
+	unsigned long seq;
+	long good = 0;
+	int count = 0;
+	int len;
+
+	FILE* in = fopen (path, "r");
+	if (in == NULL)
+		return 0;	// No log yet.
+	while (fgets (line, sizeof line, in) != NULL) {
+		len = strlen (line);
+		// A record without its new line was cut short by a crash.
+		if (len == 0 || line[len - 1] != '\n')
+			break;
+		line[len - 1] = '\0';
+		if (wal_apply (head, single, line, &seq) != 0)
+			break;
+		if (lastSeq != NULL && seq > *lastSeq)
+			*lastSeq = seq;
+		good = ftell (in);
+		count += 1;
+	}
+	fseek (in, 0, SEEK_END);
+	if (repair && ftell (in) > good) {
+		sprintf (buff, "Discarding torn records at the end of %s.\n", path);
+		if (LOGGING == 1) logger(stdout, buff);
+		else if (LOGGING == 2) logger(file, buff);
+		if (truncate (path, good) != 0) {
+			fclose (in);
+			return -1;
+		}
+	}
+	fclose (in);
+	return count;
+}
+
+/**
+ * @brief Replays one log file into the tables and truncates any torn record at its end.
+ * @return Returns the number of records read, or -1 on error.
+ */
+int wal_replay_file (struct table* head, const char* path, unsigned long* lastSeq) {
+	return wal_read (head, 0, path, lastSeq, 1);
+}
+
+/**
+ * @brief Replays the records of one table from the sealed and the live log, while the log is in use.
+ * @return Returns the number of records read, or -1 on error.
+ */
+int wal_replay_table (struct table* node, const char* dir) {
+	char path[MAX_PATH_LEN];
+	int sealed, live;
+
+	snprintf (path, sizeof path, "%s%s", dir, WAL_SEALED_NAME);
+	sealed = wal_read (node, 1, path, NULL, 0);
+	if (sealed < 0)
+		return -1;
+	snprintf (path, sizeof path, "%s%s", dir, WAL_FILE_NAME);
+	live = wal_read (node, 1, path, NULL, 0);
+	if (live < 0)
+		return -1;
+	return sealed + live;
+}
+
+/**
+ * @brief Replays the sealed and the live log into the tables.
+ * @return Returns the number of records read, or -1 on error.
+ */
+int wal_replay (struct table* head, const char* dir) {
+	char path[MAX_PATH_LEN];
+	int sealed, live;
+
+	snprintf (path, sizeof path, "%s%s", dir, WAL_SEALED_NAME);
+	sealed = wal_replay_file (head, path, &walSeq);
+	if (sealed < 0)
+		return -1;
+	snprintf (path, sizeof path, "%s%s", dir, WAL_FILE_NAME);
+	live = wal_replay_file (head, path, &walSeq);
+	if (live < 0)
+		return -1;
+	// Table files may be newer than what is left of the log.
+	struct table* node;
+	for (node = head; node != NULL; node = node->next) {
+		if (node->snapSeq > walSeq)
+			walSeq = node->snapSeq;
+	}
+	return sealed + live;
+}
+
+/**
+ * @brief Opens the log for appending.
+ * @return Returns 0 on success, -1 otherwise.
+ */
+int wal_open (const char* dir) {
+	char path[MAX_PATH_LEN];
+	snprintf (path, sizeof path, "%s%s", dir, WAL_FILE_NAME);
+	wal = fopen (path, "a");
+	if (wal == NULL)
+		return -1;
+	syncedSeq = walSeq;
+	return 0;
+}
+
+// Writes the buffered records and syncs them to disk.  Called with walLock held,
+// which is released during the fsync so writers can keep queueing records.
+static void wal_flush_locked () {
+	unsigned long target;
+	int fd;
+	// Another thread is already flushing; its batch may not cover our records.
+	while (flushing)
+		pthread_cond_wait (&walFlushed, &walLock);
+	if (wal == NULL || syncedSeq >= walSeq)
+		return;
+	flushing = 1;
+	target = walSeq;
+	fflush (wal);
+	fd = fileno (wal);
+	pthread_mutex_unlock (&walLock);
+	fsync (fd);
+	pthread_mutex_lock (&walLock);
+	flushing = 0;
+	if (target > syncedSeq)
+		syncedSeq = target;
+	pthread_cond_broadcast (&walFlushed);
+}
+
+/**
+ * @brief Seals the live log and starts a new one.
+ * @return Returns 0 if the log was rotated, 1 if a sealed log is still waiting to be compacted, and -1 on error.
+ */
+int wal_rotate (const char* dir) {
+	char path[MAX_PATH_LEN];
+	char sealed[MAX_PATH_LEN];
+	int status = 0;
+	snprintf (path, sizeof path, "%s%s", dir, WAL_FILE_NAME);
+	snprintf (sealed, sizeof sealed, "%s%s", dir, WAL_SEALED_NAME);
+	if (access (sealed, F_OK) == 0)
+		return 1;
+	pthread_mutex_lock (&walLock);
+	if (wal == NULL) {
+		pthread_mutex_unlock (&walLock);
+		return -1;
+	}
+	// Hand the records to the OS only; the sealed file is synced by wal_sync_sealed()
+	// once the server lock is released.  Until then no other flush may run, or it
+	// would count the records of the sealed file as synced.
+	while (flushing)
+		pthread_cond_wait (&walFlushed, &walLock);
+	fflush (wal);
+	sealedFd = dup (fileno (wal));
+	sealedSeq = walSeq;
+	flushing = 1;
+	fclose (wal);
+	wal = NULL;
+	if (rename (path, sealed) != 0)
+		status = -1;
+	wal = fopen (path, "a");
+	if (wal == NULL)
+		status = -1;
+	pthread_mutex_unlock (&walLock);
+	return status;
+}
+
+/**
+ * @brief Syncs the log sealed by wal_rotate() to disk.
+ */
+void wal_sync_sealed () {
+	pthread_mutex_lock (&walLock);
+	if (sealedFd < 0) {
+		pthread_mutex_unlock (&walLock);
+		return;
+	}
+	pthread_mutex_unlock (&walLock);
+	fsync (sealedFd);
+	pthread_mutex_lock (&walLock);
+	close (sealedFd);
+	sealedFd = -1;
+	flushing = 0;
+	if (sealedSeq > syncedSeq)
+		syncedSeq = sealedSeq;
+	pthread_cond_broadcast (&walFlushed);
+	pthread_mutex_unlock (&walLock);
+}
+
+/**
+ * @brief Appends a SET record with the current values of the entry.
+ * @return Returns the sequence number of the record, or 0 if the log is not open.
+ */
+unsigned long wal_append_set (struct table* node, struct hashEntry* entry) {
+	unsigned long seq;
+	int i;
+	pthread_mutex_lock (&walLock);
+	if (wal == NULL) {
+		pthread_mutex_unlock (&walLock);
+		return 0;
+	}
+	seq = ++walSeq;
+	fprintf (wal, "%lu\tSET\t%s\t%s", seq, node->name, entry->key);
+	for (i = 0; i < node->numCol; i++)
+		fprintf (wal, "\t%s", entry->value[i]);
+	fprintf (wal, "\n");
+	// In sync mode the record stays queued for the next group commit.
+	if (durability != FLUSH_SYNC)
+		fflush (wal);
+	pthread_mutex_unlock (&walLock);
+	return seq;
+}
+
+/**
+ * @brief Appends a DELETE record for the key.
+ * @return Returns the sequence number of the record, or 0 if the log is not open.
+ */
+unsigned long wal_append_delete (struct table* node, const char* key) {
+	unsigned long seq;
+	pthread_mutex_lock (&walLock);
+	if (wal == NULL) {
+		pthread_mutex_unlock (&walLock);
+		return 0;
+	}
+	seq = ++walSeq;
+	fprintf (wal, "%lu\tDEL\t%s\t%s\n", seq, node->name, key);
+	if (durability != FLUSH_SYNC)
+		fflush (wal);
+	pthread_mutex_unlock (&walLock);
+	return seq;
+}
+
+/**
+ * @brief Returns the sequence number of the last record.
+ */
+unsigned long wal_last_seq () {
+	unsigned long seq;
+	pthread_mutex_lock (&walLock);
+	seq = walSeq;
+	pthread_mutex_unlock (&walLock);
+	return seq;
+}
+
+/**
+ * @brief Waits until the record is durable, as required by the durability mode.
+ *
+ * In sync mode the first waiter becomes the leader: it writes and fsyncs every
+ * queued record in one batch and wakes the others, whose records were part of it.
+ */
+void wal_commit (unsigned long seq) {
+	if (durability != FLUSH_SYNC || seq == 0)
+		return;
+	pthread_mutex_lock (&walLock);
+	while (syncedSeq < seq && wal != NULL) {
+		// Follow the current leader; its batch may already hold our record.
+		if (flushing)
+			pthread_cond_wait (&walFlushed, &walLock);
+		else
+			wal_flush_locked ();
+	}
+	pthread_mutex_unlock (&walLock);
+}
+
+// Syncs the log every durabilityInterval milliseconds.
+static void* wal_sync_loop (void* ptr) {
+	while (1) {
+		usleep (durabilityInterval * 1000);
+		pthread_mutex_lock (&walLock);
+		wal_flush_locked ();
+		pthread_mutex_unlock (&walLock);
+	}
+	return NULL;
+}
+
+/**
+ * @brief Sets the durability mode of the log.
+ * @return Returns 0 on success, -1 otherwise.
+ */
+int wal_set_durability (int mode, int interval) {
+	pthread_t thread;
+	durability = mode;
+	durabilityInterval = interval;
+	if (mode != FLUSH_INTERVAL)
+		return 0;
+	if (pthread_create (&thread, NULL, wal_sync_loop, NULL) != 0)
+		return -1;
+	pthread_detach (thread);
+	return 0;
+}
+
+/**
+ * @brief Closes the log.
+ */
+void wal_close () {
+	pthread_mutex_lock (&walLock);
+	if (wal != NULL) {
+		wal_flush_locked ();
+		fclose (wal);
+	}
+	wal = NULL;
+	pthread_mutex_unlock (&walLock);
+}
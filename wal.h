@@ -0,0 +1,138 @@
+/**
+ * @file
+ * @brief This file declares the append-only write-ahead log used by the
+ * on-disk storage policy.
+ *
+ * Every successful SET or DELETE is appended to a single log file in the
+ * data directory as one line, tagged with an increasing sequence number.
+ * At startup the table files are loaded first and the log is replayed on
+ * top of them, so a write costs one appended line instead of a rewrite of
+ * the whole table file.
+ */
+
+#ifndef WAL_H
+#define WAL_H
+
+#include "utils.h"
+
+/**
+ * @brief Name of the log file inside the data directory.
+ */
+#define WAL_FILE_NAME "wal.log"
+
+/**
+ * @brief Name of a sealed log that is being compacted into the table files.
+ */
+#define WAL_SEALED_NAME "wal.log.1"
+
+/**
+ * @brief Replay the sealed and the live log in the data directory into the
+ * tables.
+ *
+ * @param head The first table of the server.
+ * @param dir The data directory (ending with '/').
+ * @return Return the number of records read, or -1 on error.
+ *
+ * Records whose sequence number is not above a table's snapSeq are already
+ * in its table file and are skipped, as are the records of tables that are
+ * not loaded yet.
+ */
+int wal_replay(struct table* head, const char* dir);
+
+/**
+ * @brief Replay a single log file into the tables of a list.
+ *
+ * @param head The first table of the list.  Records of other tables are
+ * skipped.
+ * @param path The path of the log file.
+ * @param lastSeq If not NULL, raised to the highest sequence number read.
+ * @return Return the number of records read, or -1 on error.
+ *
+ * A torn record at the end of the log (e.g. after a crash) is discarded and
+ * truncated away so that later appends start on a clean line.
+ */
+int wal_replay_file(struct table* head, const char* path, unsigned long* lastSeq);
+
+/**
+ * @brief Replay the records of one table from the sealed and the live log.
+ *
+ * @param node The table, which must have been skipped by wal_replay() (see
+ * lazyload.h).  Other tables in its list are not touched.
+ * @param dir The data directory (ending with '/').
+ * @return Return the number of records read, or -1 on error.
+ *
+ * Unlike wal_replay_file(), this can run while records are being appended: a
+ * record still being written is simply not read, and nothing is truncated.
+ */
+int wal_replay_table(struct table* node, const char* dir);
+
+/**
+ * @brief Seal the live log (rename it to WAL_SEALED_NAME) and start a new one.
+ *
+ * @return Return 0 if the log was rotated, 1 if an earlier sealed log still
+ * exists (nothing is done), and -1 on error.
+ *
+ * The caller must hold the server lock so no record is appended meanwhile.
+ * The sealed log is not synced here: the caller must call wal_sync_sealed()
+ * once it has released the server lock, whatever this returned.
+ */
+int wal_rotate(const char* dir);
+
+/**
+ * @brief Sync the log sealed by wal_rotate() to disk, and wake the writers
+ * waiting for its records in FLUSH_SYNC mode.  Does nothing if no log was
+ * sealed.
+ */
+void wal_sync_sealed();
+
+/**
+ * @brief Open the log in the data directory for appending.
+ * @return Return 0 on success, -1 otherwise.
+ */
+int wal_open(const char* dir);
+
+/**
+ * @brief Append a SET record holding the current values of an entry.
+ * @return Return the sequence number of the record, or 0 if the log is not open.
+ */
+unsigned long wal_append_set(struct table* node, struct hashEntry* entry);
+
+/**
+ * @brief Append a DELETE record for a key.
+ * @return Return the sequence number of the record, or 0 if the log is not open.
+ */
+unsigned long wal_append_delete(struct table* node, const char* key);
+
+/**
+ * @brief Return the sequence number of the last record written or replayed.
+ */
+unsigned long wal_last_seq();
+
+/**
+ * @brief Set the durability mode of the log.
+ *
+ * @param mode FLUSH_NONE: records are handed to the OS right away but never
+ * synced.  FLUSH_INTERVAL: a background thread syncs the log every interval
+ * ms.  FLUSH_SYNC: wal_commit() waits until the record is synced.
+ * @param interval Milliseconds between syncs for FLUSH_INTERVAL.
+ * @return Return 0 on success, -1 otherwise.
+ */
+int wal_set_durability(int mode, int interval);
+
+/**
+ * @brief Wait until a record is durable, as required by the durability mode.
+ *
+ * @param seq The sequence number returned when the record was appended.
+ *
+ * Only blocks in FLUSH_SYNC mode.  Concurrent callers share a single write and
+ * fsync (group commit): the first one flushes every queued record and wakes
+ * the others.  Must be called without holding the server lock.
+ */
+void wal_commit(unsigned long seq);
+
+/**
+ * @brief Close the log.
+ */
+void wal_close();
+
+#endif
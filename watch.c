@@ -0,0 +1,282 @@
+/**
+ * @file
+ * @brief This file implements the table subscriptions declared in watch.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "watch.h"
+#include "pred.h"
+
+// Connections with subscriptions.  Guarded by the server lock.
+static struct watcher* watchers = NULL;
+
+// Frees a queued change.
+static void watch_clear (struct watch_change* change) {
+	free (change->value);
+	change->value = NULL;
+}
+
+/**
+ * @brief Creates the subscriptions of a connection.
+ */
+struct watcher* watch_new () {
+	struct watcher* watcher = calloc (1, sizeof(struct watcher));
+	if (watcher == NULL)
+		return NULL;
+	pthread_mutex_init (&watcher->mutex, NULL);
+	pthread_cond_init (&watcher->changed, NULL);
+	return watcher;
+}
+
+/**
+ * @brief Drops the subscriptions of a connection.
+ */
+void watch_free (struct watcher* watcher) {
+	int i;
+	if (watcher == NULL)
+		return;
+	while (watcher->numSubs > 0)
+		watch_remove (watcher, watcher->subs[0].plan->node->name);
+	for (i = 0; i < watcher->numPending; i++)
+		watch_clear (&watcher->pending[i]);
+	pthread_mutex_destroy (&watcher->mutex);
+	pthread_cond_destroy (&watcher->changed);
+	free (watcher);
+}
+
+/**
+ * @brief Subscribes a connection to a table.
+ * @return Returns 0 on success, -1 if the table does not exist, -2 for invalid predicates and -3 otherwise.
+ */
+int watch_add (struct watcher* watcher, struct table* head, const char* tableName, const char* predicates) {
+	struct pred_plan* plan = malloc (sizeof(struct pred_plan));
+	int status, i;
+	if (plan == NULL)
+		return -3;
+	status = pred_compile (head, tableName, predicates, plan);
+	if (status != 0) {
+		free (plan);
+		return status;
+	}
+	// A new subscription to a watched table replaces the old one.
+	for (i = 0; i < watcher->numSubs; i++) {
+		if (watcher->subs[i].plan->node == plan->node) {
+			free (watcher->subs[i].plan);
+			watcher->subs[i].plan = plan;
+			return 0;
+		}
+	}
+	if (watcher->numSubs == WATCH_MAX_TABLES) {
+		free (plan);
+		return -3;
+	}
+	if (watcher->numSubs == 0) {
+		watcher->next = watchers;
+		watchers = watcher;
+	}
+	pthread_mutex_lock (&watcher->mutex);
+	watcher->subs[watcher->numSubs].plan = plan;
+	watcher->subs[watcher->numSubs].matched = 0;
+	watcher->numSubs += 1;
+	pthread_mutex_unlock (&watcher->mutex);
+	plan->node->watchers += 1;
+	return 0;
+}
+
+/**
+ * @brief Unsubscribes a connection from a table.
+ * @return Returns 0 on success, -1 if the table is not watched.
+ */
+int watch_remove (struct watcher* watcher, const char* tableName) {
+	struct watcher** link;
+	struct table* node;
+	int i, j;
+	for (i = 0; i < watcher->numSubs; i++) {
+		if (strcmp (watcher->subs[i].plan->node->name, tableName) == 0)
+			break;
+	}
+	if (i == watcher->numSubs)
+		return -1;
+	node = watcher->subs[i].plan->node;
+	node->watchers -= 1;
+	free (watcher->subs[i].plan);
+
+	pthread_mutex_lock (&watcher->mutex);
+	watcher->numSubs -= 1;
+	watcher->subs[i] = watcher->subs[watcher->numSubs];
+	// Changes to the table are no longer wanted.
+	for (i = 0, j = 0; i < watcher->numPending; i++) {
+		if (watcher->pending[i].node == node)
+			watch_clear (&watcher->pending[i]);
+		else
+			watcher->pending[j++] = watcher->pending[i];
+	}
+	watcher->numPending = j;
+	// Wake a WAIT of the connection, which has nothing left to wait for.
+	pthread_cond_broadcast (&watcher->changed);
+	pthread_mutex_unlock (&watcher->mutex);
+
+	if (watcher->numSubs == 0) {
+		for (link = &watchers; *link != watcher; link = &(*link)->next)
+			;
+		*link = watcher->next;
+	}
+	return 0;
+}
+
+// Returns the subscription of a connection to a table, or NULL.
+static struct watch_subscription* watch_find (struct watcher* watcher, struct table* node) {
+	int i;
+	for (i = 0; i < watcher->numSubs; i++) {
+		if (watcher->subs[i].plan->node == node)
+			return &watcher->subs[i];
+	}
+	return NULL;
+}
+
+/**
+ * @brief Notes which subscriptions match a row before it is edited or deleted.
+ */
+void watch_before (struct table* node, char (*values)[MAX_STRTYPE_SIZE]) {
+	struct watcher* watcher;
+	struct watch_subscription* sub;
+	for (watcher = watchers; watcher != NULL; watcher = watcher->next) {
+		sub = watch_find (watcher, node);
+		if (sub != NULL)
+			sub->matched = pred_match (sub->plan, &sub->plan->stats, values, -1);
+	}
+}
+
+// Formats a row as GET answers it.  Returns a malloc'd string, or NULL if out of memory.
+static char* watch_format (struct table* node, struct hashEntry* entry) {
+	char value[MAX_CMD_LEN];
+	int len, i;
+	len = sprintf (value, "%d ", entry->transac_count);
+	for (i = 0; i < node->numCol; i++)
+		len += sprintf (value + len, "%s %s%s", node->col[i], entry->value[i], i < node->numCol - 1 ? ", " : "");
+	return strdup (value);
+}
+
+// Queues a change, replacing a queued change to the same key.  Takes value.
+static void watch_queue (struct watcher* watcher, struct table* node, const char* key, char* value) {
+	struct watch_change* change = NULL;
+	int i;
+	pthread_mutex_lock (&watcher->mutex);
+	for (i = 0; i < watcher->numPending && change == NULL; i++) {
+		if (watcher->pending[i].node == node && strcmp (watcher->pending[i].key, key) == 0)
+			change = &watcher->pending[i];
+	}
+	if (change == NULL) {
+		// The subscriber is too far behind: drop its changes, it reads the rows again.
+		if (watcher->numPending == WATCH_MAX_PENDING) {
+			for (i = 0; i < watcher->numPending; i++)
+				watch_clear (&watcher->pending[i]);
+			watcher->numPending = 0;
+			watcher->resync = 1;
+		}
+		change = &watcher->pending[watcher->numPending];
+		watcher->numPending += 1;
+		change->node = node;
+		strcpy (change->key, key);
+	}
+	else
+		watch_clear (change);
+	change->value = value;
+	pthread_cond_signal (&watcher->changed);
+	pthread_mutex_unlock (&watcher->mutex);
+}
+
+/**
+ * @brief Queues a write for the subscriptions of its table.
+ */
+void watch_publish (struct table* node, const char* key, struct hashEntry* entry) {
+	struct watcher* watcher;
+	struct watch_subscription* sub;
+	char* value;
+	int matches;
+	for (watcher = watchers; watcher != NULL; watcher = watcher->next) {
+		sub = watch_find (watcher, node);
+		if (sub == NULL)
+			continue;
+		matches = entry != NULL && pred_match (sub->plan, &sub->plan->stats, entry->value, entry->index);
+		if (matches) {
+			value = watch_format (node, entry);
+			if (value != NULL)
+				watch_queue (watcher, node, key, value);
+			else {
+				// The change cannot be queued: have the subscriber read it again.
+				pthread_mutex_lock (&watcher->mutex);
+				watcher->resync = 1;
+				pthread_cond_signal (&watcher->changed);
+				pthread_mutex_unlock (&watcher->mutex);
+			}
+		}
+		// The row left the rows watched.
+		else if (sub->matched)
+			watch_queue (watcher, node, key, NULL);
+		sub->matched = 0;
+	}
+}
+
+/**
+ * @brief Waits for changes and takes them from the queue.
+ * @return Returns the number of changes, -1 if out of memory and -3 if no table is watched.
+ */
+int watch_wait (struct watcher* watcher, int timeout, int maxChanges, char** reply) {
+	struct timespec deadline;
+	struct watch_change* change;
+	size_t size, len;
+	int n, i;
+
+	clock_gettime (CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += timeout / 1000;
+	deadline.tv_nsec += (long)(timeout % 1000) * 1000000;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec += 1;
+		deadline.tv_nsec -= 1000000000;
+	}
+	pthread_mutex_lock (&watcher->mutex);
+	while (watcher->numPending == 0 && !watcher->resync && watcher->numSubs > 0) {
+		if (pthread_cond_timedwait (&watcher->changed, &watcher->mutex, &deadline) == ETIMEDOUT)
+			break;
+	}
+	if (watcher->numPending == 0 && !watcher->resync && watcher->numSubs == 0) {
+		pthread_mutex_unlock (&watcher->mutex);
+		return -3;
+	}
+
+	// A resync counts as a change.
+	n = maxChanges - watcher->resync;
+	if (n > watcher->numPending)
+		n = watcher->numPending;
+	size = 32;
+	for (i = 0; i < n; i++)
+		size += 16 + MAX_TABLE_LEN + MAX_KEY_LEN + (watcher->pending[i].value != NULL ? strlen (watcher->pending[i].value) : 0);
+	*reply = malloc (size);
+	if (*reply == NULL) {
+		pthread_mutex_unlock (&watcher->mutex);
+		return -1;
+	}
+	len = 0;
+	if (watcher->resync)
+		len += sprintf (*reply + len, "RESYNC\n");
+	watcher->resync = 0;
+	for (i = 0; i < n; i++) {
+		change = &watcher->pending[i];
+		if (change->value != NULL)
+			len += sprintf (*reply + len, "SET %s %s %s\n", change->node->name, change->key, change->value);
+		else
+			len += sprintf (*reply + len, "DEL %s %s\n", change->node->name, change->key);
+		watch_clear (change);
+	}
+	sprintf (*reply + len, "END %d\n", n);
+	// The changes not taken move to the front, still in order.
+	memmove (watcher->pending, watcher->pending + n, (watcher->numPending - n) * sizeof(struct watch_change));
+	watcher->numPending -= n;
+	pthread_mutex_unlock (&watcher->mutex);
+	return n;
+}
@@ -0,0 +1,139 @@
+/**
+ * @file
+ * @brief This file declares the subscriptions of connections to the changes
+ * of tables, used by the WATCH and WAIT commands.
+ *
+ * A connection subscribes to a table, optionally with predicates, and then
+ * collects the changes with WAIT, which blocks until there are some, instead
+ * of polling with GET or QUERY.  setEntry() publishes every successful write
+ * to the subscriptions of its table: a row that matches the predicates after
+ * the write is sent as SET, and a row that matched before a delete, or
+ * before an edit after which it no longer matches, is sent as DEL.
+ *
+ * The changes wait in a queue per connection until the client collects
+ * them.  A change to a key that is already queued replaces the queued one,
+ * so a slow subscriber skips the intermediate states of busy rows; if the
+ * queue still fills up, it is emptied and the client is told to RESYNC,
+ * that is, to read the rows it watches again.  Writers never wait for
+ * subscribers.
+ */
+
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <pthread.h>
+#include "utils.h"
+
+/**
+ * @brief Tables a connection can watch at once.
+ */
+#define WATCH_MAX_TABLES 8
+
+/**
+ * @brief Changes queued for a connection before it must resync.
+ */
+#define WATCH_MAX_PENDING 256
+
+/**
+ * @brief A queued change.
+ */
+struct watch_change {
+	struct table* node;
+	char key[MAX_KEY_LEN];
+	/// The row as GET answers it, or NULL if it was deleted.
+	char* value;
+};
+
+/**
+ * @brief The subscription of a connection to a table.
+ */
+struct watch_subscription {
+	/// The predicates (and table) watched.
+	struct pred_plan* plan;
+	/// 1 if the row being written matched before the write.
+	int matched;
+};
+
+/**
+ * @brief The subscriptions and queued changes of a connection.
+ *
+ * The subscriptions are changed and read with the server lock held; the
+ * queue is guarded by mutex, so WAIT can block without the server lock.
+ */
+struct watcher {
+	struct watch_subscription subs[WATCH_MAX_TABLES];
+	int numSubs;
+	pthread_mutex_t mutex;
+	/// Signalled when a change is queued.
+	pthread_cond_t changed;
+	struct watch_change pending[WATCH_MAX_PENDING];
+	int numPending;
+	/// 1 if changes were dropped since the last WAIT.
+	int resync;
+	/// Next connection with subscriptions.
+	struct watcher* next;
+};
+
+/**
+ * @brief Create the (empty) subscriptions of a connection.
+ *
+ * @return Return them, or NULL if out of memory.
+ */
+struct watcher* watch_new();
+
+/**
+ * @brief Drop the subscriptions of a closed connection.  The caller must
+ * hold the server lock.
+ */
+void watch_free(struct watcher* watcher);
+
+/**
+ * @brief Subscribe a connection to the changes of a table, replacing its
+ * previous subscription to the table.  The caller must hold the server lock.
+ *
+ * @param predicates The rows watched, as for pred_compile(), or "LOAD_ALL".
+ * @return Return 0 on success, -1 if the table does not exist, -2 if the
+ * predicates are invalid and -3 if the connection watches too many tables
+ * or out of memory.
+ */
+int watch_add(struct watcher* watcher, struct table* head, const char* tableName, const char* predicates);
+
+/**
+ * @brief Unsubscribe a connection from a table and drop its queued changes.
+ * The caller must hold the server lock.
+ *
+ * @return Return 0 on success, -1 if the table is not watched.
+ */
+int watch_remove(struct watcher* watcher, const char* tableName);
+
+/**
+ * @brief Note which subscriptions match a row about to be edited or deleted.
+ * Only called for tables with watchers.
+ */
+void watch_before(struct table* node, char (*values)[MAX_STRTYPE_SIZE]);
+
+/**
+ * @brief Queue a write for the subscriptions of its table.
+ *
+ * @param node The table written.
+ * @param key The key written.
+ * @param entry The row after the write, or NULL if it was deleted.
+ */
+void watch_publish(struct table* node, const char* key, struct hashEntry* entry);
+
+/**
+ * @brief Wait for changes and take them from the queue.  Called without the
+ * server lock.
+ *
+ * @param timeout Milliseconds to wait for a change.
+ * @param maxChanges The most changes taken, a resync included; the others
+ * stay queued.
+ * @param reply Set to a malloc'd answer: "RESYNC" if changes were dropped,
+ * then "SET table key value" or "DEL table key" for every change, and
+ * "END <changes>", one per line.
+ * @return Return the number of changes, -1 if out of memory and -3 if the
+ * connection watches no table.
+ */
+int watch_wait(struct watcher* watcher, int timeout, int maxChanges, char** reply);
+
+#endif
@@ -0,0 +1,105 @@
+/**
+ * @file
+ * @brief This file implements the worker pool declared in workpool.h.
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+#include "workpool.h"
+
+/// Guards the job below, and lets one job run at a time.
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t runLock = PTHREAD_MUTEX_INITIALIZER;
+/// Signaled when a job starts, and when its last task finishes.
+static pthread_cond_t poolWork = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t poolDone = PTHREAD_COND_INITIALIZER;
+
+/// Threads running a job, the caller included.
+static int poolSize = 1;
+
+/// The current job (jobTask is NULL between jobs).
+static void (*jobTask)(int index, void* arg) = NULL;
+static void* jobArg;
+static int jobTasks;
+/// Next task to take, and tasks finished.
+static int jobNext;
+static int jobDone;
+
+// Runs tasks of the current job until none are left.  Called with poolLock held.
+static void workpool_work () {
+	void (*task)(int, void*);
+	void* arg;
+	int index;
+	while (jobTask != NULL && jobNext < jobTasks) {
+		index = jobNext;
+		jobNext += 1;
+		task = jobTask;
+		arg = jobArg;
+		pthread_mutex_unlock (&poolLock);
+		task (index, arg);
+		pthread_mutex_lock (&poolLock);
+		jobDone += 1;
+		if (jobDone == jobTasks)
+			pthread_cond_signal (&poolDone);
+	}
+}
+
+// Thread body of a worker.
+static void* workpool_loop (void* ptr) {
+	pthread_mutex_lock (&poolLock);
+	while (1) {
+		while (jobTask == NULL || jobNext >= jobTasks)
+			pthread_cond_wait (&poolWork, &poolLock);
+		workpool_work ();
+	}
+	return NULL;
+}
+
+/**
+ * @brief Starts the worker threads.
+ * @return Returns 0 on success, -1 otherwise.
+ */
+int workpool_start (int threads) {
+	pthread_t thread;
+	while (poolSize < threads) {
+		if (pthread_create (&thread, NULL, workpool_loop, NULL) != 0)
+			return -1;
+		pthread_detach (thread);
+		poolSize += 1;
+	}
+	return 0;
+}
+
+/**
+ * @brief Returns the number of threads running a job.
+ */
+int workpool_size () {
+	return poolSize;
+}
+
+/**
+ * @brief Runs the tasks of a job on the pool and waits for them.
+ */
+void workpool_run (int numTasks, void (*task)(int index, void* arg), void* arg) {
+	int i;
+	if (poolSize == 1 || numTasks < 2) {
+		for (i = 0; i < numTasks; i++)
+			task (i, arg);
+		return;
+	}
+	pthread_mutex_lock (&runLock);
+	pthread_mutex_lock (&poolLock);
+	jobTask = task;
+	jobArg = arg;
+	jobTasks = numTasks;
+	jobNext = 0;
+	jobDone = 0;
+	pthread_cond_broadcast (&poolWork);
+	// The caller takes tasks too.
+	workpool_work ();
+	while (jobDone < jobTasks)
+		pthread_cond_wait (&poolDone, &poolLock);
+	jobTask = NULL;
+	pthread_mutex_unlock (&poolLock);
+	pthread_mutex_unlock (&runLock);
+}
@@ -0,0 +1,51 @@
+/**
+ * @file
+ * @brief This file declares the shared pool of worker threads that scans
+ * large tables in parallel.
+ *
+ * A job is a number of independent tasks, such as the morsels of a table
+ * scan (see scan_plan()).  The thread that runs the job and the workers all
+ * take the next task until none are left, and the job returns once every
+ * task has finished, so the tasks need no locking of their own as long as
+ * each one writes only its own part of the result.
+ *
+ * Until workpool_start() is called (as in the client library), jobs simply
+ * run their tasks one after the other on the calling thread.
+ */
+
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+/**
+ * @brief Default number of threads scanning a query, the server thread
+ * included (1 scans on the server thread only).
+ */
+#define DEFAULT_QUERY_THREADS 1
+
+/**
+ * @brief Start the worker threads.
+ *
+ * @param threads The number of threads running a job, including the thread
+ * that runs it; threads - 1 workers are started.
+ * @return Return 0 on success, -1 otherwise.
+ */
+int workpool_start(int threads);
+
+/**
+ * @brief Number of threads running a job (1 without workers).
+ */
+int workpool_size();
+
+/**
+ * @brief Run a job and wait for all of its tasks.
+ *
+ * Jobs from several threads run one at a time.
+ *
+ * @param numTasks The number of tasks.
+ * @param task Called once for every task, with its index (0 to numTasks - 1)
+ * and arg, on any thread of the pool.
+ * @param arg Passed to task.
+ */
+void workpool_run(int numTasks, void (*task)(int index, void* arg), void* arg);
+
+#endif
@@ -0,0 +1,186 @@
+/**
+ * @file
+ * @brief This file implements the zone maps declared in zone.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "zone.h"
+
+/**
+ * @brief Creates an empty zone map.
+ */
+struct zone_map* zone_new () {
+	struct zone_map* zones = calloc (1, sizeof(struct zone_map));
+	if (zones != NULL)
+		memset (zones->slotBlock, -1, sizeof zones->slotBlock);
+	return zones;
+}
+
+// Widens the ranges of a block with the int values of a row.
+static void zone_widen (struct table* node, struct zone_block* block, char (*values)[MAX_STRTYPE_SIZE]) {
+	long value;
+	int i;
+	for (i = 0; i < node->numCol; i++) {
+		if (node->type[i] != -1)
+			continue;
+		value = atol (values[i]);
+		if (block->numRows == 0 || value < block->min[i])
+			block->min[i] = value;
+		if (block->numRows == 0 || value > block->max[i])
+			block->max[i] = value;
+	}
+}
+
+// Returns the block an inserted row goes in: the one being filled, else an empty
+// one, else one with room left (there always is one).
+static int zone_pick (struct zone_map* zones) {
+	int b;
+	if (zones->blocks[zones->current].numRows < ZONE_BLOCK_ROWS)
+		return zones->current;
+	for (b = 0; b < ZONE_BLOCKS; b++) {
+		if (zones->blocks[b].numRows == 0)
+			break;
+	}
+	if (b == ZONE_BLOCKS) {
+		for (b = 0; b < ZONE_BLOCKS; b++) {
+			if (zones->blocks[b].numRows < ZONE_BLOCK_ROWS)
+				break;
+		}
+	}
+	zones->current = b;
+	return b;
+}
+
+/**
+ * @brief Brings the zone map of a table up to date with a slot.
+ */
+void zone_sync (struct table* node, int index) {
+	struct zone_map* zones = node->zones;
+	struct zone_block* block;
+	int b;
+	if (zones == NULL)
+		return;
+	b = zones->slotBlock[index];
+	if (node->slots[index].state != SLOT_LIVE) {
+		if (b < 0)
+			return;
+		// The range of the block is left as wide as it is.
+		block = &zones->blocks[b];
+		block->slots[index / 64] &= ~((uint64_t)1 << (index % 64));
+		block->numRows -= 1;
+		zones->slotBlock[index] = -1;
+		return;
+	}
+	if (b < 0) {
+		b = zone_pick (zones);
+		block = &zones->blocks[b];
+		zone_widen (node, block, node->entries[index]->value);
+		block->slots[index / 64] |= (uint64_t)1 << (index % 64);
+		block->numRows += 1;
+		zones->slotBlock[index] = b;
+	}
+	else {
+		// The row was edited; its old values may stay the bounds of the block.
+		block = &zones->blocks[b];
+		zone_widen (node, block, node->entries[index]->value);
+	}
+}
+
+// Returns 1 if a value of the range min..max may meet a predicate on an int column.
+static int zone_term_may_match (const struct pred_plan* plan, const struct pred_term* term, long min, long max) {
+	const long* c = &plan->ivalues[term->first];
+	int k;
+	switch (term->op) {
+	case PRED_NEVER:
+		return 0;
+	case PRED_LT:
+		return min < c[0];
+	case PRED_LE:
+		return min <= c[0];
+	case PRED_GT:
+		return max > c[0];
+	case PRED_GE:
+		return max >= c[0];
+	case PRED_EQ:
+		return min <= c[0] && c[0] <= max;
+	case PRED_NE:
+		return min != c[0] || max != c[0];
+	case PRED_BETWEEN:
+		return max >= c[0] && min <= c[1];
+	case PRED_IN:
+		for (k = 0; k < term->numValues; k++) {
+			if (min <= c[k] && c[k] <= max)
+				return 1;
+		}
+		return 0;
+	}
+	return 1;
+}
+
+// Returns 1 if every predicate of a group, joined by OR, is on an int column.
+static int zone_group_usable (const struct pred_plan* plan, const struct pred_group* group) {
+	int t;
+	for (t = group->first; t < group->first + group->numTerms; t++) {
+		if (!plan->terms[t].isInt)
+			return 0;
+	}
+	return 1;
+}
+
+// Returns 1 if a row of a block may meet every group of a plan.
+static int zone_block_may_match (const struct pred_plan* plan, const struct zone_block* block) {
+	const struct pred_group* group;
+	const struct pred_term* term;
+	int g, t;
+	for (g = 0; g < plan->numGroups; g++) {
+		group = &plan->groups[g];
+		if (!zone_group_usable (plan, group))
+			continue;
+		// A group is ruled out only if each of its predicates is.
+		for (t = group->first; t < group->first + group->numTerms; t++) {
+			term = &plan->terms[t];
+			if (zone_term_may_match (plan, term, block->min[term->col], block->max[term->col]))
+				break;
+		}
+		if (t == group->first + group->numTerms)
+			return 0;
+	}
+	return 1;
+}
+
+/**
+ * @brief Clears the slots of the blocks that no row meeting a plan can be in.
+ * @return Returns the number of blocks skipped.
+ */
+int zone_plan (const struct pred_plan* plan, uint64_t* bits, int fill) {
+	struct zone_map* zones = plan->node->zones;
+	int numSkipped = 0;
+	int b, g, w;
+	if (fill)
+		memset (bits, 0xff, BITMAP_WORDS * sizeof(uint64_t));
+	if (zones == NULL)
+		return 0;
+	for (g = 0; g < plan->numGroups; g++) {
+		if (zone_group_usable (plan, &plan->groups[g]))
+			break;
+	}
+	// Without a group of int predicates no block can be ruled out.
+	if (g == plan->numGroups)
+		return 0;
+	for (b = 0; b < ZONE_BLOCKS; b++) {
+		if (zones->blocks[b].numRows == 0 || zone_block_may_match (plan, &zones->blocks[b]))
+			continue;
+		for (w = 0; w < BITMAP_WORDS; w++)
+			bits[w] &= ~zones->blocks[b].slots[w];
+		numSkipped += 1;
+	}
+	return numSkipped;
+}
+
+/**
+ * @brief Frees a zone map.
+ */
+void zone_free (struct zone_map* zones) {
+	free (zones);
+}
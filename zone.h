@@ -0,0 +1,91 @@
+/**
+ * @file
+ * @brief This file declares the zone maps of tables: the range of the int
+ * columns in each block of rows, used to skip blocks when scanning.
+ *
+ * Rows are put in blocks of ZONE_BLOCK_ROWS in the order they are inserted,
+ * which is also the order of the entry list, so rows written together (and
+ * values that grow with time, such as ids or timestamps) share a block.  Each
+ * block keeps the smallest and largest value of every int column over its
+ * rows, and the slots of its rows, so a scan can tell from the predicates
+ * alone that no row of a block can match (for instance "value > 90" against
+ * a block whose values are all below 50) and skip the block without reading
+ * its rows.
+ *
+ * Writes only widen the ranges, through syncSlot() and the edits of
+ * setEntry(), so a range always holds every row of its block.  Deletes and
+ * edits never narrow a range: that would mean reading the other rows of the
+ * block.  A range starts over when the last row of its block is deleted,
+ * and the block takes new rows again.
+ */
+
+#ifndef ZONE_H
+#define ZONE_H
+
+#include <stdint.h>
+#include "utils.h"
+#include "pred.h"
+#include "bitmap.h"
+
+/**
+ * @brief Rows of a block.
+ */
+#define ZONE_BLOCK_ROWS 16
+
+/**
+ * @brief Blocks of a table, enough for a full table.
+ */
+#define ZONE_BLOCKS ((MAX_RECORDS_PER_TABLE + ZONE_BLOCK_ROWS - 1) / ZONE_BLOCK_ROWS)
+
+/**
+ * @brief The range of the int columns over the rows of a block.
+ */
+struct zone_block {
+	/// Rows in the block; min and max are meaningless while it is 0.
+	int numRows;
+	long min[MAX_COLUMNS_PER_TABLE];
+	long max[MAX_COLUMNS_PER_TABLE];
+	/// Slots of the rows of the block.
+	uint64_t slots[BITMAP_WORDS];
+};
+
+/**
+ * @brief The zone map of a table.
+ */
+struct zone_map {
+	struct zone_block blocks[ZONE_BLOCKS];
+	/// Block of the row of each slot, or -1 if the slot holds no row.
+	short slotBlock[MAX_RECORDS_PER_TABLE];
+	/// Block taking the rows being inserted.
+	int current;
+};
+
+/**
+ * @brief Create the (empty) zone map of a table.
+ *
+ * @return Return it, or NULL if out of memory.
+ */
+struct zone_map* zone_new();
+
+/**
+ * @brief Bring the zone map up to date with a slot whose row was inserted,
+ * edited or deleted.  An inserted row joins the block being filled.
+ */
+void zone_sync(struct table* node, int index);
+
+/**
+ * @brief Clear the slots of the blocks that cannot hold a row meeting the
+ * predicates of a plan.  No row is read.
+ *
+ * @param bits The slots to scan, cleared block by block.
+ * @param fill 1 to first set every slot of bits.
+ * @return Return the number of blocks skipped.
+ */
+int zone_plan(const struct pred_plan* plan, uint64_t* bits, int fill);
+
+/**
+ * @brief Free a zone map.
+ */
+void zone_free(struct zone_map* zones);
+
+#endif